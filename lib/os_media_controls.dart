@@ -64,6 +64,10 @@ class OsMediaControls {
   /// Subscribe to this stream to receive events when users interact with
   /// media controls (play button, pause button, seek bar, etc.).
   ///
+  /// On Linux, events that arrive before the stream is listened to (e.g. a
+  /// media key pressed during startup) are replayed once it is, keeping only
+  /// the latest seek, speed and play/pause event.
+  ///
   /// The stream emits various event types:
   /// - [PlayEvent]: Play button pressed
   /// - [PauseEvent]: Pause button pressed
@@ -76,17 +80,25 @@ class OsMediaControls {
   /// - [SkipBackwardEvent]: Skip backward button pressed (iOS/macOS)
   /// - [SetSpeedEvent]: Playback speed change requested
   static Stream<MediaControlEvent> get controlEvents {
-    _eventStream ??= _eventChannel.receiveBroadcastStream().map((
+    _eventStream ??= _eventChannel.receiveBroadcastStream().expand((
       dynamic event,
     ) {
-      if (event is Map) {
-        return MediaControlEvent.fromMap(event);
+      // With batched delivery (Linux), several events arrive as one list
+      if (event is List) {
+        return event.map(_parseEvent);
       }
-      throw ArgumentError('Invalid event format');
+      return [_parseEvent(event)];
     });
     return _eventStream!;
   }
 
+  static MediaControlEvent _parseEvent(dynamic event) {
+    if (event is Map) {
+      return MediaControlEvent.fromMap(event);
+    }
+    throw ArgumentError('Invalid event format');
+  }
+
   /// Updates the metadata displayed in system media controls.
   ///
   /// This information appears in various system UI elements:
@@ -268,6 +280,161 @@ class OsMediaControls {
     }
   }
 
+  /// Configures how bursts of control events are coalesced (Linux only).
+  ///
+  /// Scrubbing a seek bar or scrolling over a speed control can produce many
+  /// events in quick succession. Within [window], only the first [SeekEvent]
+  /// or [SetSpeedEvent] is delivered immediately and the latest value is
+  /// delivered when the window ends. Identical play/pause/stop/next/previous
+  /// events received within [dedupWindow] of each other are delivered once.
+  ///
+  /// Pass [Duration.zero] to disable either behavior. Defaults are 100 ms and
+  /// 50 ms.
+  ///
+  /// Example:
+  /// ```dart
+  /// await OsMediaControls.setEventCoalescing(
+  ///   window: Duration(milliseconds: 200),
+  ///   dedupWindow: Duration.zero,
+  /// );
+  /// ```
+  static Future<void> setEventCoalescing({
+    Duration? window,
+    Duration? dedupWindow,
+  }) async {
+    try {
+      await _methodChannel.invokeMethod('setEventCoalescing', {
+        if (window != null) 'window': window.inMilliseconds,
+        if (dedupWindow != null) 'dedupWindow': dedupWindow.inMilliseconds,
+      });
+    } on PlatformException catch (e) {
+      throw Exception('Failed to set event coalescing: ${e.message}');
+    }
+  }
+
+  /// Enables or disables batched delivery of control events (Linux only).
+  ///
+  /// When [enabled], events are accumulated and delivered to Dart together,
+  /// either on the next main loop iteration or, if [deadline] is given, once
+  /// it has elapsed. This lets one platform-to-isolate message carry many
+  /// events during bursts. Events keep their order, and [PlayEvent] and
+  /// [PauseEvent] are always delivered immediately.
+  ///
+  /// Example:
+  /// ```dart
+  /// await OsMediaControls.setEventBatching(
+  ///   enabled: true,
+  ///   deadline: Duration(milliseconds: 16),
+  /// );
+  /// ```
+  static Future<void> setEventBatching({
+    required bool enabled,
+    Duration? deadline,
+  }) async {
+    try {
+      await _methodChannel.invokeMethod('setEventBatching', {
+        'enabled': enabled,
+        if (deadline != null) 'deadline': deadline.inMilliseconds,
+      });
+    } on PlatformException catch (e) {
+      throw Exception('Failed to set event batching: ${e.message}');
+    }
+  }
+
+  /// Enables or disables optimistic playback status updates (Linux only).
+  ///
+  /// When [enabled], a play or pause command from the system immediately
+  /// updates the status shown by the shell instead of waiting for the next
+  /// [setPlaybackState] call. The change is confirmed by a
+  /// [setPlaybackState] call with the same state, and rolled back if no such
+  /// call arrives within [timeout] (1.5 seconds by default). A
+  /// [setPlaybackState] call with a different state does not end the wait,
+  /// but its position and speed are shown right away.
+  ///
+  /// Example:
+  /// ```dart
+  /// await OsMediaControls.setOptimisticUpdates(enabled: true);
+  /// ```
+  static Future<void> setOptimisticUpdates({
+    required bool enabled,
+    Duration? timeout,
+  }) async {
+    try {
+      await _methodChannel.invokeMethod('setOptimisticUpdates', {
+        'enabled': enabled,
+        if (timeout != null) 'timeout': timeout.inMilliseconds,
+      });
+    } on PlatformException catch (e) {
+      throw Exception('Failed to set optimistic updates: ${e.message}');
+    }
+  }
+
+  /// Reports that [event] has been handled (Linux only).
+  ///
+  /// Acknowledging events lets [getStats] break the time from a shell
+  /// command to the app acting on it into stages under `latency`. Call it
+  /// once the command has taken effect, e.g. after the player has paused.
+  /// Events without a [MediaControlEvent.sequence] are ignored.
+  ///
+  /// Example:
+  /// ```dart
+  /// OsMediaControls.controlEvents.listen((event) async {
+  ///   if (event is PauseEvent) await player.pause();
+  ///   OsMediaControls.acknowledgeEvent(event);
+  /// });
+  /// ```
+  static Future<void> acknowledgeEvent(MediaControlEvent event) async {
+    if (event.sequence == null || event.receivedAt == null) {
+      return;
+    }
+    try {
+      await _methodChannel.invokeMethod('acknowledgeEvent', {
+        'sequence': event.sequence,
+        'nativeReceivedAt': event.nativeReceivedAt,
+        'receivedAt': event.receivedAt,
+        'handledAt': DateTime.now().microsecondsSinceEpoch,
+      });
+    } on PlatformException catch (e) {
+      throw Exception('Failed to acknowledge event: ${e.message}');
+    }
+  }
+
+  /// Enables or disables the persisted state snapshot (Linux only).
+  ///
+  /// When [enabled], the published metadata, artwork, enabled controls and
+  /// position are saved in the user's cache directory whenever they change.
+  /// On the next start the plugin shows the saved state, paused, as soon as
+  /// the app launches, before any Dart code runs. Disabling deletes the
+  /// snapshot. The setting is remembered across restarts.
+  ///
+  /// Restored state stays until the app calls [confirmRestoredState],
+  /// [setMetadata] (which replaces the restored metadata) or [clear].
+  ///
+  /// Example:
+  /// ```dart
+  /// await OsMediaControls.setStatePersistence(enabled: true);
+  /// ```
+  static Future<void> setStatePersistence({required bool enabled}) async {
+    try {
+      await _methodChannel.invokeMethod('setStatePersistence', {
+        'enabled': enabled,
+      });
+    } on PlatformException catch (e) {
+      throw Exception('Failed to set state persistence: ${e.message}');
+    }
+  }
+
+  /// Keeps the state restored from the last run as if the app had set it
+  /// (Linux only), e.g. once the app has reloaded the same track. Until then,
+  /// the next [setMetadata] call replaces every restored field.
+  static Future<void> confirmRestoredState() async {
+    try {
+      await _methodChannel.invokeMethod('confirmRestoredState');
+    } on PlatformException catch (e) {
+      throw Exception('Failed to confirm restored state: ${e.message}');
+    }
+  }
+
   /// Clears all media information from system controls.
   ///
   /// Call this when stopping playback completely or when your app is
@@ -284,4 +451,88 @@ class OsMediaControls {
       throw Exception('Failed to clear media controls: ${e.message}');
     }
   }
+
+  /// Returns runtime statistics collected by the native plugin (Linux only).
+  ///
+  /// The `rateLimit` entry reports D-Bus calls that exceeded the per-sender
+  /// rate limit, as totals and per sender unique bus name:
+  /// - `dropped`: transport commands rejected with a LimitsExceeded error
+  /// - `merged`: seeks and rate changes folded into the latest value
+  ///
+  /// The `methodCalls` and `dbusCalls` entries report, per method channel
+  /// call and per incoming D-Bus method or property call, the number of
+  /// `calls` and the handler latency: `totalUs`, `maxUs`, `p50Us`, `p99Us`
+  /// and a `histogram` whose entry `i` counts calls that took between 2^i and
+  /// 2^(i+1) nanoseconds. The `signals` entry counts `PropertiesChanged`
+  /// signals `emitted` and their serialized `bytes`.
+  ///
+  /// The `stalls` entry is filled when the app runs with
+  /// `OS_MEDIA_CONTROLS_STALL_THRESHOLD_MS` set: main loop stalls of at least
+  /// `thresholdMs` with their `duration` (same shape as a call entry),
+  /// the D-Bus calls that arrived during them (`callsWaiting`,
+  /// `maxCallsWaiting` in one stall, `maxCallWaitUs`) and the member names
+  /// of the calls that waited in the latest such stall (`lastWaiting`).
+  ///
+  /// The `latency` entry splits the time from an MPRIS command to the app
+  /// handling it into stages, each shaped like a call entry: `busToNative`
+  /// (from the message arriving on the bus connection to the native handler
+  /// running), `nativeToIsolate` (from the handler to the event reaching
+  /// Dart) and `handler` (from there to [acknowledgeEvent]). The last two
+  /// need acknowledged events; `acknowledged` counts them.
+  ///
+  /// The `memory` entry reports the bytes held by each cache category
+  /// (`artworkDataBytes`, `artworkFileBytes`, `senderBucketBytes`), an
+  /// estimate of all `residentBytes` held by the plugin and the number of
+  /// low-memory warnings that caused the plugin to shed them.
+  ///
+  /// The `events` entry reports, per event type, how many events were
+  /// `delivered`, `merged` into a later value or `dropped` as duplicates.
+  ///
+  /// The `eventBuffer` entry counts events `buffered` while no listener was
+  /// subscribed to [controlEvents], and of those the ones `superseded` by a
+  /// newer event of the same kind, `evicted` from a full buffer and `expired`
+  /// as too old to replay, as well as the number of `channelMessages` sent to
+  /// Dart, the events `sent` in them and `sendFailures`.
+  ///
+  /// The `track` entry holds the current MPRIS track `id` and the number of
+  /// `staleSetPosition` seeks ignored because they targeted another track.
+  ///
+  /// The `optimistic` entry counts optimistic status changes that were
+  /// `applied`, `confirmed` by Dart and `rolledBack` after the timeout.
+  ///
+  /// The `artwork` entry counts artwork `writes`, `bytesWritten`,
+  /// `writesAvoided`, i.e. covers that were replaced before any client read
+  /// them, and `dedupHits`, i.e. covers that were already on disk.
+  ///
+  /// The `snapshot` entry reports whether [setStatePersistence] is
+  /// `enabled`, whether state was `restored` at startup and is still
+  /// `unconfirmed`, and the snapshot `writes`, `writeFailures` and
+  /// `bytesWritten`.
+  ///
+  /// The `log` entry counts native diagnostics `emitted` and `suppressed` by
+  /// the rate limiter, with `suppressedByCategory`. These counters are shared
+  /// by every instance in the process.
+  ///
+  /// The `startup` entry has `registerNs` and `constructNs` for plugin
+  /// registration and the native core, `activated` and `ready` for the lazily
+  /// started D-Bus export, and `busReadyNs` from activation until it was ready.
+  /// The `bus` entry counts lost session bus connections (`disconnects`),
+  /// `reconnects` and `failedAttempts` (the first connection included), with
+  /// a `recovery` histogram.
+  ///
+  /// Example:
+  /// ```dart
+  /// final stats = await OsMediaControls.getStats();
+  /// print(stats['rateLimit']);
+  /// ```
+  static Future<Map<String, dynamic>> getStats() async {
+    try {
+      final stats = await _methodChannel.invokeMapMethod<String, dynamic>(
+        'getStats',
+      );
+      return stats ?? {};
+    } on PlatformException catch (e) {
+      throw Exception('Failed to get stats: ${e.message}');
+    }
+  }
 }
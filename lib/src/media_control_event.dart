@@ -1,30 +1,78 @@
 /// Base class for all media control events received from the OS
 abstract class MediaControlEvent {
-  const MediaControlEvent();
+  const MediaControlEvent({
+    this.sequence,
+    this.nativeReceivedAt,
+    this.receivedAt,
+  });
+
+  /// Native sequence number of the event (Linux), used by
+  /// `OsMediaControls.acknowledgeEvent`
+  final int? sequence;
+
+  /// When the native side handled the command (Linux), in microseconds since
+  /// the epoch
+  final int? nativeReceivedAt;
+
+  /// When the event reached Dart (Linux), in microseconds since the epoch
+  final int? receivedAt;
 
   /// Creates a [MediaControlEvent] from a platform channel map
   factory MediaControlEvent.fromMap(Map<dynamic, dynamic> map) {
     final type = map['type'] as String;
+    final sequence = map['sequence'] as int?;
+    final nativeReceivedAt = map['receivedAt'] as int?;
+    final receivedAt = sequence != null
+        ? DateTime.now().microsecondsSinceEpoch
+        : null;
     switch (type) {
       case 'play':
-        return const PlayEvent();
+        return PlayEvent(
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'pause':
-        return const PauseEvent();
+        return PauseEvent(
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'stop':
-        return const StopEvent();
+        return StopEvent(
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'next':
-        return const NextTrackEvent();
+        return NextTrackEvent(
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'previous':
-        return const PreviousTrackEvent();
+        return PreviousTrackEvent(
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'seek':
         final position = (map['position'] as num).toDouble();
-        return SeekEvent(Duration(milliseconds: (position * 1000).round()));
+        return SeekEvent(
+          Duration(milliseconds: (position * 1000).round()),
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'skipForward':
         final interval = (map['interval'] as num?)?.toDouble();
         return SkipForwardEvent(
           interval != null
               ? Duration(milliseconds: (interval * 1000).round())
               : null,
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
         );
       case 'skipBackward':
         final interval = (map['interval'] as num?)?.toDouble();
@@ -32,12 +80,24 @@ abstract class MediaControlEvent {
           interval != null
               ? Duration(milliseconds: (interval * 1000).round())
               : null,
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
         );
       case 'setSpeed':
         final speed = (map['speed'] as num).toDouble();
-        return SetSpeedEvent(speed);
+        return SetSpeedEvent(
+          speed,
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       case 'togglePlayPause':
-        return const TogglePlayPauseEvent();
+        return TogglePlayPauseEvent(
+          sequence: sequence,
+          nativeReceivedAt: nativeReceivedAt,
+          receivedAt: receivedAt,
+        );
       default:
         throw ArgumentError('Unknown event type: $type');
     }
@@ -46,7 +106,7 @@ abstract class MediaControlEvent {
 
 /// Event triggered when the play button is pressed
 class PlayEvent extends MediaControlEvent {
-  const PlayEvent();
+  const PlayEvent({super.sequence, super.nativeReceivedAt, super.receivedAt});
 
   @override
   String toString() => 'PlayEvent()';
@@ -54,7 +114,7 @@ class PlayEvent extends MediaControlEvent {
 
 /// Event triggered when the pause button is pressed
 class PauseEvent extends MediaControlEvent {
-  const PauseEvent();
+  const PauseEvent({super.sequence, super.nativeReceivedAt, super.receivedAt});
 
   @override
   String toString() => 'PauseEvent()';
@@ -62,7 +122,7 @@ class PauseEvent extends MediaControlEvent {
 
 /// Event triggered when the stop button is pressed
 class StopEvent extends MediaControlEvent {
-  const StopEvent();
+  const StopEvent({super.sequence, super.nativeReceivedAt, super.receivedAt});
 
   @override
   String toString() => 'StopEvent()';
@@ -70,7 +130,11 @@ class StopEvent extends MediaControlEvent {
 
 /// Event triggered when the toggle play/pause button is pressed (iOS/macOS)
 class TogglePlayPauseEvent extends MediaControlEvent {
-  const TogglePlayPauseEvent();
+  const TogglePlayPauseEvent({
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'TogglePlayPauseEvent()';
@@ -78,7 +142,11 @@ class TogglePlayPauseEvent extends MediaControlEvent {
 
 /// Event triggered when the next track button is pressed
 class NextTrackEvent extends MediaControlEvent {
-  const NextTrackEvent();
+  const NextTrackEvent({
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'NextTrackEvent()';
@@ -86,7 +154,11 @@ class NextTrackEvent extends MediaControlEvent {
 
 /// Event triggered when the previous track button is pressed
 class PreviousTrackEvent extends MediaControlEvent {
-  const PreviousTrackEvent();
+  const PreviousTrackEvent({
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'PreviousTrackEvent()';
@@ -97,7 +169,12 @@ class SeekEvent extends MediaControlEvent {
   /// The position to seek to
   final Duration position;
 
-  const SeekEvent(this.position);
+  const SeekEvent(
+    this.position, {
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'SeekEvent(position: $position)';
@@ -117,7 +194,12 @@ class SkipForwardEvent extends MediaControlEvent {
   /// The interval to skip forward, if specified
   final Duration? interval;
 
-  const SkipForwardEvent(this.interval);
+  const SkipForwardEvent(
+    this.interval, {
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'SkipForwardEvent(interval: $interval)';
@@ -137,7 +219,12 @@ class SkipBackwardEvent extends MediaControlEvent {
   /// The interval to skip backward, if specified
   final Duration? interval;
 
-  const SkipBackwardEvent(this.interval);
+  const SkipBackwardEvent(
+    this.interval, {
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'SkipBackwardEvent(interval: $interval)';
@@ -157,7 +244,12 @@ class SetSpeedEvent extends MediaControlEvent {
   /// The requested playback speed (1.0 = normal speed)
   final double speed;
 
-  const SetSpeedEvent(this.speed);
+  const SetSpeedEvent(
+    this.speed, {
+    super.sequence,
+    super.nativeReceivedAt,
+    super.receivedAt,
+  });
 
   @override
   String toString() => 'SetSpeedEvent(speed: $speed)';
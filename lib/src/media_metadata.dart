@@ -34,6 +34,13 @@ class MediaMetadata {
   /// If both [artwork] and [artworkUrl] are provided, [artwork] takes precedence.
   final String? artworkUrl;
 
+  /// A stable identifier for the media item
+  ///
+  /// Used on Linux to derive the MPRIS track id, which shells use to cache
+  /// metadata and artwork and to discard seeks aimed at a previous track.
+  /// If omitted, an id is derived from the title, artists, album and duration.
+  final String? trackId;
+
   const MediaMetadata({
     required this.title,
     this.artist,
@@ -42,6 +49,7 @@ class MediaMetadata {
     this.duration,
     this.artwork,
     this.artworkUrl,
+    this.trackId,
   });
 
   /// Converts the metadata to a map for platform channel communication
@@ -54,6 +62,7 @@ class MediaMetadata {
       if (duration != null) 'duration': duration!.inSeconds.toDouble(),
       if (artwork != null) 'artwork': artwork,
       if (artworkUrl != null) 'artworkUrl': artworkUrl,
+      if (trackId != null) 'trackId': trackId,
     };
   }
 
@@ -71,7 +80,8 @@ class MediaMetadata {
         other.artist == artist &&
         other.album == album &&
         other.albumArtist == albumArtist &&
-        other.duration == duration;
+        other.duration == duration &&
+        other.trackId == trackId;
   }
 
   @override
@@ -82,6 +92,7 @@ class MediaMetadata {
       album,
       albumArtist,
       duration,
+      trackId,
     );
   }
 }
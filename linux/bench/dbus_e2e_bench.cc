@@ -0,0 +1,382 @@
+// End-to-end benchmark of the MPRIS surface through a real bus daemon.
+//
+// Starts a private dbus-daemon (GTestDBus), hosts the core on it and drives it
+// from a native client on a second thread, so every measurement includes the
+// daemon hop that shells see:
+//
+//   - Get/GetAll latency percentiles for PlaybackStatus, Metadata and the
+//     whole Player interface
+//   - PropertiesChanged throughput while the main thread calls
+//     SetPlaybackState as fast as it can
+//   - Time from a client calling Next until the event reaches the core's
+//     event callback, plus the call's round trip
+//
+// Results are JSON lines like os_media_controls_bench. No session bus,
+// display or shell is needed; only the dbus-daemon binary. Exits with 77
+// (skipped) when it is not installed.
+//
+// Usage: os_media_controls_dbus_bench [--samples=N] [--event-samples=N]
+//                                     [--load-ms=N]
+
+#include "os_media_controls/os_media_controls_core.h"
+
+#include <gio/gio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char kBusName[] = "org.mpris.MediaPlayer2.OsMediaControls";
+static const char kObjectPath[] = "/org/mpris/MediaPlayer2";
+static const char kPlayerInterface[] = "org.mpris.MediaPlayer2.Player";
+
+// Next calls are paced just under the core's per-sender rate limit (20/s) so
+// none are rejected, and outside the 50 ms duplicate command window
+static constexpr gint64 kEventSpacingUs = 55000;
+
+// Throughput is measured until no signal has arrived for this long after the
+// load stops
+static constexpr gint64 kDrainQuietUs = 250000;
+
+struct BenchState {
+  os_media_controls::MediaControlsCore* core;
+  GMainLoop* main_loop;
+  std::string address;
+  int samples;
+  int event_samples;
+  int load_ms;
+
+  // Written on the main thread, read by the client
+  std::atomic<gint64> last_event_time{0};
+  std::atomic<guint64> events{0};
+  std::atomic<guint64> updates{0};
+  gint64 load_deadline = 0;
+  std::atomic<gint64> load_end_time{0};
+  std::atomic<bool> load_done{false};
+
+  // Client side
+  std::atomic<guint64> signals{0};
+  std::atomic<gint64> last_signal_time{0};
+  bool failed = false;
+};
+
+// Print latency percentiles (microseconds) for one benchmark
+static void ReportLatency(const char* name, std::vector<gint64> samples) {
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double p) {
+    size_t index = static_cast<size_t>(std::ceil(p * samples.size()));
+    return samples[std::min(samples.size() - 1, index > 0 ? index - 1 : 0)];
+  };
+  double sum = 0;
+  for (gint64 sample : samples) {
+    sum += sample;
+  }
+  printf("{\"benchmark\":\"%s\",\"samples\":%zu,\"mean_us\":%.1f,\"p50_us\":%" G_GINT64_FORMAT
+         ",\"p90_us\":%" G_GINT64_FORMAT ",\"p99_us\":%" G_GINT64_FORMAT
+         ",\"max_us\":%" G_GINT64_FORMAT "}\n",
+         name, samples.size(), sum / samples.size(), percentile(0.50), percentile(0.90),
+         percentile(0.99), samples.back());
+  fflush(stdout);
+}
+
+// Synchronous call on the client connection, returning false on error
+static bool Call(GDBusConnection* connection, const char* bus_name, const char* interface,
+                 const char* method, GVariant* parameters, GVariant** reply) {
+  GError* error = nullptr;
+  GVariant* result = g_dbus_connection_call_sync(
+      connection, bus_name,
+      g_strcmp0(bus_name, "org.freedesktop.DBus") == 0 ? "/org/freedesktop/DBus" : kObjectPath,
+      interface, method, parameters, nullptr, G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+  if (!result) {
+    g_printerr("%s.%s failed: %s\n", interface, method, error->message);
+    g_error_free(error);
+    return false;
+  }
+  if (reply) {
+    *reply = result;
+  } else {
+    g_variant_unref(result);
+  }
+  return true;
+}
+
+// Wait until the core owns its well-known name on the private bus
+static bool WaitForName(GDBusConnection* connection) {
+  gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+  while (g_get_monotonic_time() < deadline) {
+    GVariant* reply = nullptr;
+    if (!Call(connection, "org.freedesktop.DBus", "org.freedesktop.DBus", "NameHasOwner",
+              g_variant_new("(s)", kBusName), &reply)) {
+      return false;
+    }
+    gboolean has_owner = FALSE;
+    g_variant_get(reply, "(b)", &has_owner);
+    g_variant_unref(reply);
+    if (has_owner) {
+      return true;
+    }
+    g_usleep(10000);
+  }
+  g_printerr("%s never appeared on the bus\n", kBusName);
+  return false;
+}
+
+static void BenchGetLatency(BenchState* state, GDBusConnection* connection) {
+  struct Case {
+    const char* name;
+    const char* method;
+    const char* property;
+  };
+  const Case cases[] = {
+      {"get/PlaybackStatus", "Get", "PlaybackStatus"},
+      {"get/Metadata", "Get", "Metadata"},
+      {"get_all/Player", "GetAll", nullptr},
+  };
+
+  for (const Case& test_case : cases) {
+    std::vector<gint64> latencies;
+    latencies.reserve(state->samples);
+    for (int i = 0; i < state->samples && !state->failed; i++) {
+      GVariant* parameters = test_case.property
+                                 ? g_variant_new("(ss)", kPlayerInterface, test_case.property)
+                                 : g_variant_new("(s)", kPlayerInterface);
+      gint64 start = g_get_monotonic_time();
+      if (!Call(connection, kBusName, "org.freedesktop.DBus.Properties", test_case.method,
+                parameters, nullptr)) {
+        state->failed = true;
+        return;
+      }
+      latencies.push_back(g_get_monotonic_time() - start);
+    }
+    ReportLatency(test_case.name, std::move(latencies));
+  }
+}
+
+static void HandlePropertiesChanged(GDBusConnection* connection, const gchar* sender_name,
+                                    const gchar* object_path, const gchar* interface_name,
+                                    const gchar* signal_name, GVariant* parameters,
+                                    gpointer user_data) {
+  auto* state = static_cast<BenchState*>(user_data);
+  state->signals++;
+  state->last_signal_time = g_get_monotonic_time();
+}
+
+// Main thread: call SetPlaybackState in batches until load_ms has passed
+static gboolean GenerateLoad(gpointer user_data) {
+  auto* state = static_cast<BenchState*>(user_data);
+  for (int i = 0; i < 64; i++) {
+    guint64 update = state->updates++;
+    state->core->SetPlaybackState(
+        update % 2 ? OS_MEDIA_CONTROLS_PLAYBACK_PAUSED : OS_MEDIA_CONTROLS_PLAYBACK_PLAYING,
+        update * 0.001, 1.0);
+  }
+
+  if (g_get_monotonic_time() < state->load_deadline) {
+    return G_SOURCE_CONTINUE;
+  }
+  state->load_end_time = g_get_monotonic_time();
+  state->load_done = true;
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean StartLoad(gpointer user_data) {
+  auto* state = static_cast<BenchState*>(user_data);
+  state->load_deadline = g_get_monotonic_time() + state->load_ms * 1000;
+  g_idle_add(GenerateLoad, state);
+  return G_SOURCE_REMOVE;
+}
+
+static void BenchPropertiesChangedThroughput(BenchState* state, GDBusConnection* connection,
+                                             GMainContext* context) {
+  guint subscription = g_dbus_connection_signal_subscribe(
+      connection, kBusName, "org.freedesktop.DBus.Properties", "PropertiesChanged",
+      kObjectPath, kPlayerInterface, G_DBUS_SIGNAL_FLAGS_NONE, HandlePropertiesChanged, state,
+      nullptr);
+
+  // Make sure the match rule is installed before the load starts
+  Call(connection, "org.freedesktop.DBus", "org.freedesktop.DBus.Peer", "Ping", nullptr,
+       nullptr);
+
+  gint64 start = g_get_monotonic_time();
+  g_main_context_invoke(nullptr, StartLoad, state);
+
+  while (true) {
+    while (g_main_context_iteration(context, FALSE)) {
+    }
+    gint64 now = g_get_monotonic_time();
+    if (state->load_done) {
+      gint64 quiet_since = std::max<gint64>(state->load_end_time, state->last_signal_time);
+      if (now - quiet_since >= kDrainQuietUs) {
+        break;
+      }
+    }
+    g_usleep(1000);
+  }
+  g_dbus_connection_signal_unsubscribe(connection, subscription);
+
+  double load_seconds = (state->load_end_time - start) / 1e6;
+  double signal_seconds =
+      state->last_signal_time > start ? (state->last_signal_time - start) / 1e6 : load_seconds;
+  gint64 drain_us = std::max<gint64>(0, state->last_signal_time - state->load_end_time);
+  printf("{\"benchmark\":\"properties_changed_throughput\",\"load_ms\":%.0f,"
+         "\"updates\":%" G_GUINT64_FORMAT ",\"signals_received\":%" G_GUINT64_FORMAT
+         ",\"updates_per_sec\":%.0f,\"signals_per_sec\":%.0f,\"drain_ms\":%.1f}\n",
+         load_seconds * 1000, state->updates.load(), state->signals.load(),
+         state->updates / load_seconds,
+         state->signals / signal_seconds, drain_us / 1000.0);
+  fflush(stdout);
+}
+
+static void BenchNextToEvent(BenchState* state, GDBusConnection* connection) {
+  std::vector<gint64> delivery;
+  std::vector<gint64> round_trip;
+  delivery.reserve(state->event_samples);
+  round_trip.reserve(state->event_samples);
+
+  for (int i = 0; i < state->event_samples; i++) {
+    guint64 events_before = state->events;
+    gint64 start = g_get_monotonic_time();
+    if (!Call(connection, kBusName, kPlayerInterface, "Next", nullptr, nullptr)) {
+      state->failed = true;
+      return;
+    }
+    gint64 end = g_get_monotonic_time();
+
+    // The core delivers the event before it replies
+    if (state->events == events_before) {
+      g_printerr("Next was not delivered as an event\n");
+      state->failed = true;
+      return;
+    }
+    delivery.push_back(state->last_event_time - start);
+    round_trip.push_back(end - start);
+
+    gint64 next = start + kEventSpacingUs;
+    if (next > g_get_monotonic_time()) {
+      g_usleep(next - g_get_monotonic_time());
+    }
+  }
+
+  ReportLatency("next_to_event", std::move(delivery));
+  ReportLatency("next_round_trip", std::move(round_trip));
+}
+
+static void RunClient(BenchState* state) {
+  GMainContext* context = g_main_context_new();
+  g_main_context_push_thread_default(context);
+
+  GError* error = nullptr;
+  GDBusConnection* connection = g_dbus_connection_new_for_address_sync(
+      state->address.c_str(),
+      static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                        G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+      nullptr, nullptr, &error);
+  if (!connection) {
+    g_printerr("Failed to connect to the private bus: %s\n", error->message);
+    g_error_free(error);
+    state->failed = true;
+  } else if (!WaitForName(connection)) {
+    state->failed = true;
+  }
+
+  if (!state->failed) {
+    BenchGetLatency(state, connection);
+  }
+  if (!state->failed) {
+    BenchNextToEvent(state, connection);
+  }
+  if (!state->failed) {
+    BenchPropertiesChangedThroughput(state, connection, context);
+  }
+
+  if (connection) {
+    g_dbus_connection_close_sync(connection, nullptr, nullptr);
+    g_object_unref(connection);
+  }
+  g_main_context_pop_thread_default(context);
+  g_main_context_unref(context);
+  g_main_loop_quit(state->main_loop);
+}
+
+int main(int argc, char** argv) {
+  int samples = 2000;
+  int event_samples = 100;
+  int load_ms = 2000;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--samples=", 10) == 0) {
+      samples = atoi(argv[i] + 10);
+    } else if (strncmp(argv[i], "--event-samples=", 16) == 0) {
+      event_samples = atoi(argv[i] + 16);
+    } else if (strncmp(argv[i], "--load-ms=", 10) == 0) {
+      load_ms = atoi(argv[i] + 10);
+    } else {
+      samples = 0;
+      break;
+    }
+  }
+  if (samples <= 0 || event_samples <= 0 || load_ms <= 0) {
+    g_printerr("Usage: %s [--samples=N] [--event-samples=N] [--load-ms=N]\n", argv[0]);
+    return 1;
+  }
+
+  g_autofree gchar* daemon = g_find_program_in_path("dbus-daemon");
+  if (!daemon) {
+    g_printerr("dbus-daemon not found, skipping\n");
+    return 77;
+  }
+
+  // Point the session bus at a private daemon before anything connects
+  GTestDBus* bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(bus);
+
+  BenchState state;
+  state.address = g_test_dbus_get_bus_address(bus);
+  state.samples = samples;
+  state.event_samples = event_samples;
+  state.load_ms = load_ms;
+
+  int status = 0;
+  {
+    os_media_controls::MediaControlsCore core;
+    state.core = &core;
+
+    OsMediaControlsMetadata metadata = {};
+    metadata.title = "Hoppípolla";
+    metadata.artist = "Sigur Rós";
+    metadata.album = "Takk...";
+    metadata.duration = 268.0;
+    metadata.artwork_url = "https://example.com/covers/takk.jpg";
+    core.SetMetadata(metadata);
+    core.SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_NEXT, true);
+    core.SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 0, 1.0);
+
+    // Measure raw delivery: no duplicate-command window
+    core.SetEventCoalescing(-1, 0);
+    core.SetEventCallback([&state](const OsMediaControlsEvent& event) {
+      state.last_event_time = g_get_monotonic_time();
+      state.events++;
+    });
+
+    state.main_loop = g_main_loop_new(nullptr, FALSE);
+    std::thread client(RunClient, &state);
+    g_main_loop_run(state.main_loop);
+    client.join();
+    g_main_loop_unref(state.main_loop);
+
+    core.SetEventCallback(nullptr);
+    status = state.failed ? 1 : 0;
+  }
+
+  g_test_dbus_down(bus);
+  g_object_unref(bus);
+  return status;
+}
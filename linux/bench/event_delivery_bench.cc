@@ -0,0 +1,82 @@
+// Throughput benchmark comparing per-event and batched delivery of control
+// events to Dart.
+//
+// Every event channel message is encoded with the standard codec and then
+// crosses from the platform thread to the Dart isolate, so batching changes
+// the number of messages and the encoding work per event. This benchmark
+// measures the encoding side without a Flutter engine and reports how many
+// messages (isolate hops) each mode needs.
+//
+// Usage: os_media_controls_event_bench [events] [batch_size]
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+// Build an event the way HandleMethodCallDBus does for SetPosition
+static FlValue* NewSeekEvent(int i) {
+  FlValue* event = fl_value_new_map();
+  fl_value_set_string_take(event, "type", fl_value_new_string("seek"));
+  fl_value_set_string_take(event, "position", fl_value_new_float(i * 0.25));
+  return event;
+}
+
+// Encode one message, returning its size in bytes
+static size_t EncodeMessage(FlMessageCodec* codec, FlValue* message) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GBytes) bytes = fl_message_codec_encode_message(codec, message, &error);
+  if (!bytes) {
+    g_printerr("Failed to encode message: %s\n", error->message);
+    exit(1);
+  }
+  return g_bytes_get_size(bytes);
+}
+
+static void Report(const char* mode, int events, int messages, size_t bytes,
+                   gint64 elapsed_us) {
+  double seconds = elapsed_us / 1000000.0;
+  printf("mode=%s events=%d messages=%d bytes=%zu events_per_sec=%.0f ns_per_event=%.1f\n",
+         mode, events, messages, bytes, events / seconds,
+         elapsed_us * 1000.0 / events);
+}
+
+int main(int argc, char** argv) {
+  int events = argc > 1 ? atoi(argv[1]) : 1000000;
+  int batch_size = argc > 2 ? atoi(argv[2]) : 16;
+  if (events <= 0 || batch_size <= 0) {
+    g_printerr("Usage: %s [events] [batch_size]\n", argv[0]);
+    return 1;
+  }
+
+  g_autoptr(FlStandardMessageCodec) standard_codec = fl_standard_message_codec_new();
+  FlMessageCodec* codec = FL_MESSAGE_CODEC(standard_codec);
+
+  // One message per event
+  size_t bytes = 0;
+  gint64 start = g_get_monotonic_time();
+  for (int i = 0; i < events; i++) {
+    g_autoptr(FlValue) event = NewSeekEvent(i);
+    bytes += EncodeMessage(codec, event);
+  }
+  Report("single", events, events, bytes, g_get_monotonic_time() - start);
+
+  // One list message per batch_size events
+  bytes = 0;
+  int messages = 0;
+  start = g_get_monotonic_time();
+  FlValue* batch = fl_value_new_list();
+  for (int i = 0; i < events; i++) {
+    fl_value_append_take(batch, NewSeekEvent(i));
+    if (static_cast<int>(fl_value_get_length(batch)) == batch_size || i == events - 1) {
+      bytes += EncodeMessage(codec, batch);
+      messages++;
+      fl_value_unref(batch);
+      batch = fl_value_new_list();
+    }
+  }
+  fl_value_unref(batch);
+  Report("batched", events, messages, bytes, g_get_monotonic_time() - start);
+
+  return 0;
+}
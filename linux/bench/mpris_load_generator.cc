@@ -0,0 +1,716 @@
+// Multi-client MPRIS load generator.
+//
+// Hosts the core on a private dbus-daemon (GTestDBus) and, for each client
+// count in --clients, re-executes itself as a client process with that many
+// synthetic MPRIS consumers (shells, applets, playerctld, monitoring agents).
+// Every client has its own bus connection, subscribes to the player's signals,
+// polls Get and GetAll and issues control calls at the configured rates. In the
+// meantime the host drives the core with a scripted update stream: position
+// updates at --update-hz, a track change every 100 updates, and a playback
+// state update in reply to every Play/Pause event, as an app would.
+//
+// Clients run in a separate process, so the host's CPU time only covers the
+// core and its GDBus worker thread. Each step prints one JSON line:
+//
+//   core_cpu_ms, core_cpu_us_per_update   host process CPU time
+//   loop_latency_*_us                     lateness of a 5 ms main loop probe
+//   daemon_cpu_ms,                        dbus-daemon CPU time, which pays for
+//   daemon_cpu_us_per_delivered_signal    the signal fan-out
+//   signals_delivered, calls, call_*_us   as seen by the clients
+//
+// Usage: os_media_controls_load_generator [--clients=1,2,5,...]
+//          [--duration-ms=N] [--update-hz=N] [--get-hz=N] [--getall-hz=N]
+//          [--control-hz=N]
+
+#include "os_media_controls/os_media_controls_core.h"
+
+#include <gio/gio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char kBusName[] = "org.mpris.MediaPlayer2.OsMediaControls";
+static const char kObjectPath[] = "/org/mpris/MediaPlayer2";
+static const char kPlayerInterface[] = "org.mpris.MediaPlayer2.Player";
+
+// Interval of the main loop latency probe
+static constexpr guint kProbeIntervalMs = 5;
+
+// Track changes in the scripted update stream
+static constexpr guint64 kUpdatesPerTrack = 100;
+
+struct Options {
+  std::vector<int> clients = {1, 2, 5, 10, 25, 50, 100};
+  int duration_ms = 3000;
+  double update_hz = 20;
+  double get_hz = 2;
+  double getall_hz = 0.5;
+  double control_hz = 0.2;
+};
+
+static bool ParseOptions(int argc, char** argv, Options* options, bool* client_mode,
+                         std::string* address) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (g_str_has_prefix(arg, "--clients=")) {
+      options->clients.clear();
+      g_auto(GStrv) counts = g_strsplit(arg + 10, ",", -1);
+      for (gchar** count = counts; *count; count++) {
+        int value = atoi(*count);
+        if (value <= 0) {
+          return false;
+        }
+        options->clients.push_back(value);
+      }
+    } else if (g_str_has_prefix(arg, "--duration-ms=")) {
+      options->duration_ms = atoi(arg + 14);
+    } else if (g_str_has_prefix(arg, "--update-hz=")) {
+      options->update_hz = g_ascii_strtod(arg + 12, nullptr);
+    } else if (g_str_has_prefix(arg, "--get-hz=")) {
+      options->get_hz = g_ascii_strtod(arg + 9, nullptr);
+    } else if (g_str_has_prefix(arg, "--getall-hz=")) {
+      options->getall_hz = g_ascii_strtod(arg + 12, nullptr);
+    } else if (g_str_has_prefix(arg, "--control-hz=")) {
+      options->control_hz = g_ascii_strtod(arg + 13, nullptr);
+    } else if (g_str_has_prefix(arg, "--client-address=")) {
+      *client_mode = true;
+      *address = arg + 17;
+    } else {
+      return false;
+    }
+  }
+  return !options->clients.empty() && options->duration_ms > 0 && options->update_hz > 0 &&
+         options->get_hz >= 0 && options->getall_hz >= 0 && options->control_hz >= 0;
+}
+
+static gint64 Percentile(std::vector<gint64>* samples, double p) {
+  if (samples->empty()) {
+    return 0;
+  }
+  std::sort(samples->begin(), samples->end());
+  size_t index = static_cast<size_t>(std::ceil(p * samples->size()));
+  return (*samples)[std::min(samples->size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+static guint IntervalMs(double hz) {
+  return static_cast<guint>(std::max(1.0, 1000.0 / hz));
+}
+
+// Client process
+
+struct ClientTotals {
+  guint64 signals = 0;
+  guint64 calls = 0;
+  guint64 errors = 0;
+  std::vector<gint64> call_latencies;  // Get and GetAll, microseconds
+};
+
+struct SyntheticClient {
+  GDBusConnection* connection;
+  ClientTotals* totals;
+  guint64 polls;
+};
+
+struct PendingCall {
+  ClientTotals* totals;
+  gint64 start;
+  bool timed;
+};
+
+static void HandleClientSignal(GDBusConnection* connection, const gchar* sender_name,
+                               const gchar* object_path, const gchar* interface_name,
+                               const gchar* signal_name, GVariant* parameters,
+                               gpointer user_data) {
+  static_cast<ClientTotals*>(user_data)->signals++;
+}
+
+static void HandleClientCallDone(GObject* source, GAsyncResult* result, gpointer user_data) {
+  auto* call = static_cast<PendingCall*>(user_data);
+  GError* error = nullptr;
+  GVariant* reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+  if (reply) {
+    g_variant_unref(reply);
+    if (call->timed) {
+      call->totals->call_latencies.push_back(g_get_monotonic_time() - call->start);
+    }
+  } else {
+    call->totals->errors++;
+    g_error_free(error);
+  }
+  delete call;
+}
+
+static void ClientCall(SyntheticClient* client, const char* interface, const char* method,
+                       GVariant* parameters, bool timed) {
+  client->totals->calls++;
+  auto* call = new PendingCall{client->totals, g_get_monotonic_time(), timed};
+  g_dbus_connection_call(client->connection, kBusName, kObjectPath, interface, method,
+                         parameters, nullptr, G_DBUS_CALL_FLAGS_NONE, 5000, nullptr,
+                         HandleClientCallDone, call);
+}
+
+// Shells mostly read the status and position, and re-read metadata on change
+static gboolean PollGet(gpointer user_data) {
+  auto* client = static_cast<SyntheticClient*>(user_data);
+  static const char* const kProperties[] = {"PlaybackStatus", "Position", "Metadata"};
+  const char* property = kProperties[client->polls++ % G_N_ELEMENTS(kProperties)];
+  ClientCall(client, "org.freedesktop.DBus.Properties", "Get",
+             g_variant_new("(ss)", kPlayerInterface, property), true);
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean PollGetAll(gpointer user_data) {
+  auto* client = static_cast<SyntheticClient*>(user_data);
+  ClientCall(client, "org.freedesktop.DBus.Properties", "GetAll",
+             g_variant_new("(s)", kPlayerInterface), true);
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean SendControl(gpointer user_data) {
+  auto* client = static_cast<SyntheticClient*>(user_data);
+  switch (g_random_int_range(0, 4)) {
+    case 0:
+      ClientCall(client, kPlayerInterface, "PlayPause", nullptr, false);
+      break;
+    case 1:
+      ClientCall(client, kPlayerInterface, "Next", nullptr, false);
+      break;
+    case 2:
+      ClientCall(client, kPlayerInterface, "Previous", nullptr, false);
+      break;
+    default:
+      ClientCall(client, kPlayerInterface, "Seek",
+                 g_variant_new("(x)", G_GINT64_CONSTANT(5000000)), false);
+      break;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+// Start a periodic timer after a random phase, so clients do not poll in step
+struct StaggeredTimer {
+  guint interval_ms;
+  GSourceFunc function;
+  gpointer data;
+};
+
+static gboolean StartStaggeredTimer(gpointer user_data) {
+  auto* timer = static_cast<StaggeredTimer*>(user_data);
+  if (timer->function(timer->data)) {
+    g_timeout_add(timer->interval_ms, timer->function, timer->data);
+  }
+  delete timer;
+  return G_SOURCE_REMOVE;
+}
+
+static void AddStaggeredTimer(double hz, GSourceFunc function, gpointer data) {
+  if (hz <= 0) {
+    return;
+  }
+  guint interval_ms = IntervalMs(hz);
+  g_timeout_add(g_random_int_range(0, interval_ms), StartStaggeredTimer,
+                new StaggeredTimer{interval_ms, function, data});
+}
+
+static gboolean QuitLoop(gpointer user_data) {
+  g_main_loop_quit(static_cast<GMainLoop*>(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+static int RunClients(const Options& options, const std::string& address) {
+  int count = options.clients[0];
+  ClientTotals totals;
+  std::vector<SyntheticClient> clients(count);
+
+  for (SyntheticClient& client : clients) {
+    GError* error = nullptr;
+    client.connection = g_dbus_connection_new_for_address_sync(
+        address.c_str(),
+        static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+        nullptr, nullptr, &error);
+    if (!client.connection) {
+      g_printerr("Failed to connect client: %s\n", error->message);
+      g_error_free(error);
+      return 1;
+    }
+    client.totals = &totals;
+    client.polls = 0;
+    g_dbus_connection_signal_subscribe(client.connection, kBusName, nullptr, nullptr,
+                                       kObjectPath, nullptr, G_DBUS_SIGNAL_FLAGS_NONE,
+                                       HandleClientSignal, &totals, nullptr);
+  }
+
+  // Match rules are in place once a round trip to the daemon completes
+  for (SyntheticClient& client : clients) {
+    GVariant* reply = g_dbus_connection_call_sync(
+        client.connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+        "org.freedesktop.DBus", "GetId", nullptr, nullptr, G_DBUS_CALL_FLAGS_NONE, -1,
+        nullptr, nullptr);
+    if (reply) {
+      g_variant_unref(reply);
+    }
+  }
+
+  // The host owns the name asynchronously, shortly after it starts
+  gboolean has_owner = FALSE;
+  for (int i = 0; i < 500 && !has_owner; i++) {
+    GVariant* reply = g_dbus_connection_call_sync(
+        clients[0].connection, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+        "org.freedesktop.DBus", "NameHasOwner", g_variant_new("(s)", kBusName),
+        G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    if (reply) {
+      g_variant_get(reply, "(b)", &has_owner);
+      g_variant_unref(reply);
+    }
+    if (!has_owner) {
+      g_usleep(10000);
+    }
+  }
+  if (!has_owner) {
+    g_printerr("%s was not acquired\n", kBusName);
+    return 1;
+  }
+
+  GMainLoop* loop = g_main_loop_new(nullptr, FALSE);
+  for (SyntheticClient& client : clients) {
+    AddStaggeredTimer(options.get_hz, PollGet, &client);
+    AddStaggeredTimer(options.getall_hz, PollGetAll, &client);
+    AddStaggeredTimer(options.control_hz, SendControl, &client);
+  }
+
+  printf("ready\n");
+  fflush(stdout);
+  g_timeout_add(options.duration_ms, QuitLoop, loop);
+  g_main_loop_run(loop);
+  g_main_loop_unref(loop);
+
+  printf("result signals=%" G_GUINT64_FORMAT " calls=%" G_GUINT64_FORMAT
+         " errors=%" G_GUINT64_FORMAT " call_p50_us=%" G_GINT64_FORMAT
+         " call_p99_us=%" G_GINT64_FORMAT "\n",
+         totals.signals, totals.calls, totals.errors, Percentile(&totals.call_latencies, 0.50),
+         Percentile(&totals.call_latencies, 0.99));
+  fflush(stdout);
+
+  for (SyntheticClient& client : clients) {
+    g_dbus_connection_close_sync(client.connection, nullptr, nullptr);
+    g_object_unref(client.connection);
+  }
+  return 0;
+}
+
+// Host process
+
+// CPU time of this process in microseconds
+static gint64 ProcessCpuTime() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// The private dbus-daemon is a child of this process
+static int FindDaemonPid() {
+  GDir* dir = g_dir_open("/proc", 0, nullptr);
+  if (!dir) {
+    return -1;
+  }
+  int daemon_pid = -1;
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != nullptr && daemon_pid < 0) {
+    if (!g_ascii_isdigit(name[0])) {
+      continue;
+    }
+    g_autofree gchar* path = g_build_filename("/proc", name, "stat", nullptr);
+    g_autofree gchar* stat = nullptr;
+    if (!g_file_get_contents(path, &stat, nullptr, nullptr)) {
+      continue;
+    }
+    int pid, ppid;
+    char comm[64];
+    char state;
+    if (sscanf(stat, "%d (%63[^)]) %c %d", &pid, comm, &state, &ppid) == 4 &&
+        ppid == getpid() && strcmp(comm, "dbus-daemon") == 0) {
+      daemon_pid = pid;
+    }
+  }
+  g_dir_close(dir);
+  return daemon_pid;
+}
+
+// CPU time of another process in microseconds, or -1
+static gint64 ProcessCpuTime(int pid) {
+  if (pid < 0) {
+    return -1;
+  }
+  g_autofree gchar* path = g_strdup_printf("/proc/%d/stat", pid);
+  g_autofree gchar* stat = nullptr;
+  if (!g_file_get_contents(path, &stat, nullptr, nullptr)) {
+    return -1;
+  }
+  // utime and stime are fields 14 and 15, after the parenthesized command
+  const char* fields = strrchr(stat, ')');
+  unsigned long utime = 0, stime = 0;
+  if (!fields || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                        &utime, &stime) != 2) {
+    return -1;
+  }
+  return static_cast<gint64>(utime + stime) * G_USEC_PER_SEC / sysconf(_SC_CLK_TCK);
+}
+
+class LoadGenerator {
+ public:
+  LoadGenerator(const Options& options, const std::string& address, GMainLoop* loop)
+      : options_(options), address_(address), loop_(loop), daemon_pid_(FindDaemonPid()) {
+    core_.SetEventCallback([this](const OsMediaControlsEvent& event) { HandleEvent(event); });
+    core_.SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_NEXT | OS_MEDIA_CONTROLS_CONTROL_PREVIOUS |
+                                 OS_MEDIA_CONTROLS_CONTROL_SEEK,
+                             true);
+    ChangeTrack();
+    core_.SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 0, 1.0);
+  }
+
+  bool failed() const { return failed_; }
+
+  // Run the next client count, or quit when all are done
+  void StartNextStep();
+
+ private:
+  void ChangeTrack();
+  void HandleEvent(const OsMediaControlsEvent& event);
+  void StartMeasuring();
+  void StopMeasuring();
+  void HandleClientLine(const char* line);
+  void MaybeFinishStep();
+
+  static gboolean HandleClientOutput(GIOChannel* channel, GIOCondition condition,
+                                     gpointer user_data);
+  static void HandleClientExit(GPid pid, gint status, gpointer user_data);
+  static gboolean HandleUpdateTimer(gpointer user_data);
+  static gboolean HandleProbe(gpointer user_data);
+  static gboolean HandleMeasureEnd(gpointer user_data);
+
+  const Options& options_;
+  std::string address_;
+  GMainLoop* loop_;
+  os_media_controls::MediaControlsCore core_;
+  int daemon_pid_;
+  bool failed_ = false;
+
+  size_t step_ = 0;
+  GPid client_pid_ = 0;
+  GIOChannel* client_output_ = nullptr;
+  bool client_exited_ = false;
+  bool client_succeeded_ = false;
+  bool have_result_ = false;
+  bool measuring_ = false;
+
+  // Scripted player state
+  guint64 updates_ = 0;
+  guint64 tracks_ = 0;
+  double position_ = 0;
+  bool playing_ = true;
+  guint64 events_ = 0;
+
+  // Current step
+  guint update_timer_id_ = 0;
+  guint probe_id_ = 0;
+  guint measure_end_id_ = 0;
+  gint64 probe_expected_ = 0;
+  std::vector<gint64> loop_latencies_;
+  gint64 start_time_ = 0;
+  gint64 start_cpu_ = 0;
+  gint64 start_daemon_cpu_ = 0;
+  guint64 start_updates_ = 0;
+  guint64 start_events_ = 0;
+  gint64 elapsed_ = 0;
+  gint64 cpu_ = 0;
+  gint64 daemon_cpu_ = 0;
+  guint64 step_updates_ = 0;
+  guint64 step_events_ = 0;
+
+  // Reported by the client process
+  guint64 signals_ = 0;
+  guint64 calls_ = 0;
+  guint64 errors_ = 0;
+  gint64 call_p50_ = 0;
+  gint64 call_p99_ = 0;
+};
+
+void LoadGenerator::ChangeTrack() {
+  tracks_++;
+  g_autofree gchar* title = g_strdup_printf("Track %" G_GUINT64_FORMAT, tracks_);
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = title;
+  metadata.artist = "Load Generator";
+  metadata.album = "Synthetic";
+  metadata.duration = 240;
+  metadata.artwork_url = "https://example.com/cover.jpg";
+  core_.SetMetadata(metadata);
+  position_ = 0;
+}
+
+// React to control events like an app: confirm play/pause, jump on seek/skip
+void LoadGenerator::HandleEvent(const OsMediaControlsEvent& event) {
+  events_++;
+  switch (event.type) {
+    case OS_MEDIA_CONTROLS_EVENT_PLAY:
+    case OS_MEDIA_CONTROLS_EVENT_PAUSE:
+      playing_ = event.type == OS_MEDIA_CONTROLS_EVENT_PLAY;
+      break;
+    case OS_MEDIA_CONTROLS_EVENT_SEEK:
+      position_ = event.value;
+      break;
+    case OS_MEDIA_CONTROLS_EVENT_NEXT:
+    case OS_MEDIA_CONTROLS_EVENT_PREVIOUS:
+      ChangeTrack();
+      break;
+    default:
+      return;
+  }
+  updates_++;
+  core_.SetPlaybackState(
+      playing_ ? OS_MEDIA_CONTROLS_PLAYBACK_PLAYING : OS_MEDIA_CONTROLS_PLAYBACK_PAUSED,
+      position_, 1.0);
+}
+
+gboolean LoadGenerator::HandleUpdateTimer(gpointer user_data) {
+  auto* self = static_cast<LoadGenerator*>(user_data);
+  self->updates_++;
+  if (self->updates_ % kUpdatesPerTrack == 0) {
+    self->ChangeTrack();
+  } else if (self->playing_) {
+    self->position_ += 1.0 / self->options_.update_hz;
+  }
+  self->core_.SetPlaybackState(
+      self->playing_ ? OS_MEDIA_CONTROLS_PLAYBACK_PLAYING : OS_MEDIA_CONTROLS_PLAYBACK_PAUSED,
+      self->position_, 1.0);
+  return G_SOURCE_CONTINUE;
+}
+
+// Lateness of a one-shot timer measures how long the main loop was busy
+gboolean LoadGenerator::HandleProbe(gpointer user_data) {
+  auto* self = static_cast<LoadGenerator*>(user_data);
+  gint64 now = g_get_monotonic_time();
+  self->loop_latencies_.push_back(std::max<gint64>(0, now - self->probe_expected_));
+  self->probe_expected_ = now + kProbeIntervalMs * 1000;
+  self->probe_id_ = g_timeout_add(kProbeIntervalMs, HandleProbe, self);
+  return G_SOURCE_REMOVE;
+}
+
+gboolean LoadGenerator::HandleMeasureEnd(gpointer user_data) {
+  auto* self = static_cast<LoadGenerator*>(user_data);
+  self->measure_end_id_ = 0;
+  self->StopMeasuring();
+  return G_SOURCE_REMOVE;
+}
+
+void LoadGenerator::StartNextStep() {
+  if (step_ >= options_.clients.size()) {
+    g_main_loop_quit(loop_);
+    return;
+  }
+
+  g_autofree gchar* self_path = g_file_read_link("/proc/self/exe", nullptr);
+  std::string clients = "--clients=" + std::to_string(options_.clients[step_]);
+  std::string duration = "--duration-ms=" + std::to_string(options_.duration_ms);
+  std::string address = "--client-address=" + address_;
+  g_autofree gchar* get_hz = g_strdup_printf("--get-hz=%g", options_.get_hz);
+  g_autofree gchar* getall_hz = g_strdup_printf("--getall-hz=%g", options_.getall_hz);
+  g_autofree gchar* control_hz = g_strdup_printf("--control-hz=%g", options_.control_hz);
+  const gchar* argv[] = {self_path,     clients.c_str(), duration.c_str(), address.c_str(),
+                         get_hz,        getall_hz,       control_hz,       nullptr};
+
+  gint output_fd = -1;
+  GError* error = nullptr;
+  if (!g_spawn_async_with_pipes(nullptr, const_cast<gchar**>(argv), nullptr,
+                                G_SPAWN_DO_NOT_REAP_CHILD, nullptr, nullptr, &client_pid_,
+                                nullptr, &output_fd, nullptr, &error)) {
+    g_printerr("Failed to start clients: %s\n", error->message);
+    g_error_free(error);
+    failed_ = true;
+    g_main_loop_quit(loop_);
+    return;
+  }
+
+  client_exited_ = false;
+  client_succeeded_ = false;
+  have_result_ = false;
+  client_output_ = g_io_channel_unix_new(output_fd);
+  g_io_channel_set_close_on_unref(client_output_, TRUE);
+  g_io_add_watch(client_output_, static_cast<GIOCondition>(G_IO_IN | G_IO_HUP),
+                 HandleClientOutput, this);
+  g_child_watch_add(client_pid_, HandleClientExit, this);
+}
+
+gboolean LoadGenerator::HandleClientOutput(GIOChannel* channel, GIOCondition condition,
+                                           gpointer user_data) {
+  auto* self = static_cast<LoadGenerator*>(user_data);
+  while (true) {
+    gchar* line = nullptr;
+    GIOStatus status = g_io_channel_read_line(channel, &line, nullptr, nullptr, nullptr);
+    if (status == G_IO_STATUS_NORMAL) {
+      self->HandleClientLine(line);
+      g_free(line);
+      // Lines are short and written whole; keep reading what is buffered
+      if (!(g_io_channel_get_buffer_condition(channel) & G_IO_IN)) {
+        return G_SOURCE_CONTINUE;
+      }
+      continue;
+    }
+    if (status == G_IO_STATUS_AGAIN) {
+      return G_SOURCE_CONTINUE;
+    }
+    // End of output
+    g_io_channel_unref(self->client_output_);
+    self->client_output_ = nullptr;
+    self->MaybeFinishStep();
+    return G_SOURCE_REMOVE;
+  }
+}
+
+void LoadGenerator::HandleClientLine(const char* line) {
+  if (g_str_has_prefix(line, "ready")) {
+    StartMeasuring();
+    return;
+  }
+  if (sscanf(line,
+             "result signals=%" G_GUINT64_FORMAT " calls=%" G_GUINT64_FORMAT
+             " errors=%" G_GUINT64_FORMAT " call_p50_us=%" G_GINT64_FORMAT
+             " call_p99_us=%" G_GINT64_FORMAT,
+             &signals_, &calls_, &errors_, &call_p50_, &call_p99_) == 5) {
+    have_result_ = true;
+  }
+}
+
+void LoadGenerator::HandleClientExit(GPid pid, gint status, gpointer user_data) {
+  auto* self = static_cast<LoadGenerator*>(user_data);
+  g_spawn_close_pid(pid);
+  self->client_exited_ = true;
+  self->client_succeeded_ = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  self->MaybeFinishStep();
+}
+
+void LoadGenerator::StartMeasuring() {
+  measuring_ = true;
+  loop_latencies_.clear();
+  start_time_ = g_get_monotonic_time();
+  start_cpu_ = ProcessCpuTime();
+  start_daemon_cpu_ = ProcessCpuTime(daemon_pid_);
+  start_updates_ = updates_;
+  start_events_ = events_;
+
+  update_timer_id_ = g_timeout_add(IntervalMs(options_.update_hz), HandleUpdateTimer, this);
+  probe_expected_ = start_time_ + kProbeIntervalMs * 1000;
+  probe_id_ = g_timeout_add(kProbeIntervalMs, HandleProbe, this);
+  measure_end_id_ = g_timeout_add(options_.duration_ms, HandleMeasureEnd, this);
+}
+
+void LoadGenerator::StopMeasuring() {
+  if (!measuring_) {
+    return;
+  }
+  measuring_ = false;
+  g_source_remove(update_timer_id_);
+  g_source_remove(probe_id_);
+  if (measure_end_id_) {
+    g_source_remove(measure_end_id_);
+  }
+  update_timer_id_ = 0;
+  probe_id_ = 0;
+  measure_end_id_ = 0;
+
+  elapsed_ = g_get_monotonic_time() - start_time_;
+  cpu_ = ProcessCpuTime() - start_cpu_;
+  gint64 daemon_cpu = ProcessCpuTime(daemon_pid_);
+  daemon_cpu_ = daemon_cpu >= 0 && start_daemon_cpu_ >= 0 ? daemon_cpu - start_daemon_cpu_ : -1;
+  step_updates_ = updates_ - start_updates_;
+  step_events_ = events_ - start_events_;
+}
+
+// A step ends once the client process has exited and its output is drained
+void LoadGenerator::MaybeFinishStep() {
+  if (!client_exited_ || client_output_) {
+    return;
+  }
+  // The client process may finish a little before the host's window closes
+  StopMeasuring();
+  if (!client_succeeded_ || !have_result_) {
+    g_printerr("Client process for %d clients failed\n", options_.clients[step_]);
+    failed_ = true;
+  }
+
+  if (!failed_) {
+    int clients = options_.clients[step_];
+    printf("{\"clients\":%d,\"duration_ms\":%.0f,\"updates\":%" G_GUINT64_FORMAT
+           ",\"events\":%" G_GUINT64_FORMAT ",\"core_cpu_ms\":%.1f,"
+           "\"core_cpu_us_per_update\":%.1f,\"loop_latency_p50_us\":%" G_GINT64_FORMAT
+           ",\"loop_latency_p99_us\":%" G_GINT64_FORMAT ",\"loop_latency_max_us\":%" G_GINT64_FORMAT
+           ",\"daemon_cpu_ms\":%.1f,\"daemon_cpu_us_per_delivered_signal\":%.2f,"
+           "\"signals_delivered\":%" G_GUINT64_FORMAT ",\"signals_per_client\":%.1f,"
+           "\"calls\":%" G_GUINT64_FORMAT ",\"call_errors\":%" G_GUINT64_FORMAT
+           ",\"call_p50_us\":%" G_GINT64_FORMAT ",\"call_p99_us\":%" G_GINT64_FORMAT "}\n",
+           clients, elapsed_ / 1000.0, step_updates_, step_events_, cpu_ / 1000.0,
+           step_updates_ ? static_cast<double>(cpu_) / step_updates_ : 0.0,
+           Percentile(&loop_latencies_, 0.50), Percentile(&loop_latencies_, 0.99),
+           Percentile(&loop_latencies_, 1.0), daemon_cpu_ / 1000.0,
+           signals_ && daemon_cpu_ >= 0 ? static_cast<double>(daemon_cpu_) / signals_ : 0.0,
+           signals_, static_cast<double>(signals_) / clients, calls_, errors_, call_p50_,
+           call_p99_);
+    fflush(stdout);
+  }
+
+  step_++;
+  if (failed_) {
+    g_main_loop_quit(loop_);
+  } else {
+    StartNextStep();
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  bool client_mode = false;
+  std::string address;
+  if (!ParseOptions(argc, argv, &options, &client_mode, &address)) {
+    g_printerr("Usage: %s [--clients=1,2,5,...] [--duration-ms=N] [--update-hz=N] "
+               "[--get-hz=N] [--getall-hz=N] [--control-hz=N]\n",
+               argv[0]);
+    return 1;
+  }
+
+  if (client_mode) {
+    return RunClients(options, address);
+  }
+
+  g_autofree gchar* daemon = g_find_program_in_path("dbus-daemon");
+  if (!daemon) {
+    g_printerr("dbus-daemon not found, skipping\n");
+    return 77;
+  }
+
+  // Point the session bus at a private daemon before the core connects
+  GTestDBus* bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(bus);
+
+  bool failed;
+  {
+    GMainLoop* loop = g_main_loop_new(nullptr, FALSE);
+    LoadGenerator generator(options, g_test_dbus_get_bus_address(bus), loop);
+    generator.StartNextStep();
+    g_main_loop_run(loop);
+    failed = generator.failed();
+    g_main_loop_unref(loop);
+  }
+
+  g_test_dbus_down(bus);
+  g_object_unref(bus);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,763 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_CORE_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_CORE_H_
+
+// Flutter-independent MPRIS engine.
+//
+// The core owns the org.mpris.MediaPlayer2 D-Bus objects, the player state,
+// artwork publishing, rate limiting and event coalescing. The Flutter plugin
+// is a thin adapter that converts method channel calls into this API and
+// control events back into event channel messages; native tools and
+// benchmarks can link the os_media_controls_core library directly.
+//
+// The core is driven by the default GLib main context: every function must be
+// called from the thread that runs it, and events are delivered there too.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "os_media_controls/os_media_controls_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Control events sent by MPRIS clients (shells, media keys, playerctl)
+typedef enum {
+  OS_MEDIA_CONTROLS_EVENT_PLAY,
+  OS_MEDIA_CONTROLS_EVENT_PAUSE,
+  OS_MEDIA_CONTROLS_EVENT_STOP,
+  OS_MEDIA_CONTROLS_EVENT_NEXT,
+  OS_MEDIA_CONTROLS_EVENT_PREVIOUS,
+  OS_MEDIA_CONTROLS_EVENT_SEEK,
+  OS_MEDIA_CONTROLS_EVENT_SET_SPEED,
+} OsMediaControlsEventType;
+
+typedef struct {
+  OsMediaControlsEventType type;
+  double value;  // Position in seconds for SEEK, rate for SET_SPEED
+  uint64_t sequence;  // Increases with every event; 0 until the core assigns it
+  int64_t received_ns;  // CLOCK_MONOTONIC time the D-Bus call was handled
+} OsMediaControlsEvent;
+
+// Mirrors PlaybackState in the Dart API
+typedef enum {
+  OS_MEDIA_CONTROLS_PLAYBACK_NONE,
+  OS_MEDIA_CONTROLS_PLAYBACK_STOPPED,
+  OS_MEDIA_CONTROLS_PLAYBACK_PAUSED,
+  OS_MEDIA_CONTROLS_PLAYBACK_PLAYING,
+  OS_MEDIA_CONTROLS_PLAYBACK_BUFFERING,  // Keeps the current PlaybackStatus
+} OsMediaControlsPlaybackState;
+
+// Bit flags for os_media_controls_core_set_controls_enabled
+typedef enum {
+  OS_MEDIA_CONTROLS_CONTROL_PLAY = 1 << 0,
+  OS_MEDIA_CONTROLS_CONTROL_PAUSE = 1 << 1,
+  OS_MEDIA_CONTROLS_CONTROL_STOP = 1 << 2,
+  OS_MEDIA_CONTROLS_CONTROL_NEXT = 1 << 3,
+  OS_MEDIA_CONTROLS_CONTROL_PREVIOUS = 1 << 4,
+  OS_MEDIA_CONTROLS_CONTROL_SEEK = 1 << 5,
+} OsMediaControlsControl;
+
+// Track metadata. NULL or empty strings and a non-positive duration leave the
+// current value unchanged. artwork_url takes precedence over artwork bytes.
+typedef struct {
+  const char* title;
+  const char* artist;
+  const char* album;
+  const char* album_artist;
+  double duration;  // Seconds
+  const char* track_id;  // App-defined id used to derive mpris:trackid
+  const char* artwork_url;  // file://, http:// or https:// URL, or absolute path
+  const uint8_t* artwork;  // Encoded image bytes
+  size_t artwork_length;
+} OsMediaControlsMetadata;
+
+// Totals of the counters reported by the C++ MediaControlsCore::GetStats
+typedef struct {
+  uint64_t rate_limit_dropped;
+  uint64_t rate_limit_merged;
+  uint64_t events_delivered;
+  uint64_t events_merged;
+  uint64_t events_dropped;
+  uint64_t stale_set_position;
+  uint64_t optimistic_applied;
+  uint64_t optimistic_confirmed;
+  uint64_t optimistic_rolled_back;
+  uint64_t artwork_writes;
+  uint64_t artwork_writes_avoided;
+  uint64_t artwork_dedup_hits;  // Covers already on disk under their content name
+  uint64_t low_memory_warnings;
+  uint64_t artwork_bytes_written;
+  uint64_t resident_bytes;
+  uint64_t signals_emitted;
+  uint64_t signal_bytes;  // Serialized PropertiesChanged bodies
+  uint64_t stalls;  // Main loop stalls, with stall detection enabled
+  uint64_t stall_max_ns;
+  uint64_t stall_calls_waiting;
+  uint64_t snapshot_writes;  // State snapshots written, with persistence enabled
+  uint64_t restored_unconfirmed;  // 1 while restored state awaits confirmation
+  uint64_t log_suppressed;  // Diagnostics dropped by the rate limiter (process-wide)
+  uint64_t construct_ns;  // Time spent creating the core
+  uint64_t bus_ready_ns;  // From activation until the objects were exported, 0 until then
+  uint64_t bus_disconnects;  // Session bus connections lost
+  uint64_t bus_reconnects;  // Bus name reacquired after a lost connection
+  uint64_t bus_recovery_max_ns;
+} OsMediaControlsCoreStats;
+
+typedef void (*OsMediaControlsEventCallback)(const OsMediaControlsEvent* event,
+                                             void* user_data);
+
+typedef struct _OsMediaControlsCore OsMediaControlsCore;
+
+// Creates the core without touching the session bus; it connects and exports
+// the MPRIS objects once activated
+OsMediaControlsCore* os_media_controls_core_new(void);
+
+void os_media_controls_core_free(OsMediaControlsCore* core);
+
+// Connect in the background and export the player. The first metadata,
+// playback state or controls call does this implicitly.
+void os_media_controls_core_activate(OsMediaControlsCore* core);
+
+// Sets the function control events are delivered to; NULL drops them
+void os_media_controls_core_set_event_callback(OsMediaControlsCore* core,
+                                               OsMediaControlsEventCallback callback,
+                                               void* user_data);
+
+void os_media_controls_core_set_metadata(OsMediaControlsCore* core,
+                                         const OsMediaControlsMetadata* metadata);
+
+// position is in seconds; a non-positive speed keeps the current rate
+void os_media_controls_core_set_playback_state(OsMediaControlsCore* core,
+                                               OsMediaControlsPlaybackState state,
+                                               double position,
+                                               double speed);
+
+// controls is a mask of OsMediaControlsControl values
+void os_media_controls_core_set_controls_enabled(OsMediaControlsCore* core,
+                                                 uint32_t controls,
+                                                 bool enabled);
+
+void os_media_controls_core_clear(OsMediaControlsCore* core);
+
+// Windows in milliseconds, 0 disables; a negative value keeps the current one
+void os_media_controls_core_set_event_coalescing(OsMediaControlsCore* core,
+                                                 int64_t window_ms,
+                                                 int64_t dedup_window_ms);
+
+// A timeout of 0 keeps the current one
+void os_media_controls_core_set_optimistic_updates(OsMediaControlsCore* core,
+                                                   bool enabled,
+                                                   uint32_t timeout_ms);
+
+void os_media_controls_core_get_stats(OsMediaControlsCore* core,
+                                      OsMediaControlsCoreStats* stats);
+
+// Record main loop stalls of at least threshold_ms; 0 disables
+void os_media_controls_core_set_stall_detection(OsMediaControlsCore* core,
+                                                uint32_t threshold_ms);
+
+// Keep a snapshot of the published state on disk and restore it when the next
+// core is created, until the app confirms or replaces it
+void os_media_controls_core_set_state_persistence(OsMediaControlsCore* core, bool enabled);
+
+// Keep the restored state as if the app had set it
+void os_media_controls_core_confirm_restored_state(OsMediaControlsCore* core);
+
+// Record API and D-Bus calls to a binary trace for os_media_controls_replay
+bool os_media_controls_core_start_trace(OsMediaControlsCore* core, const char* path);
+
+void os_media_controls_core_stop_trace(OsMediaControlsCore* core);
+
+// Event name used on the Flutter event channel ("play", "seek", ...)
+const char* os_media_controls_event_type_name(OsMediaControlsEventType type);
+
+#ifdef __cplusplus
+}  // extern "C"
+
+#include <gio/gio.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace os_media_controls {
+
+class StallDetector;
+class StateFileWriter;
+class StateSnapshot;
+struct PlayerSnapshot;
+class TraceWriter;
+class TraceReplayer;
+enum class TraceRecordType : uint8_t;
+class MediaControlsBench;
+
+// Log2-bucketed latency histogram. Bucket i counts durations in
+// [2^i, 2^(i+1)) nanoseconds; the last bucket also takes anything longer.
+// Recording never allocates.
+struct LatencyHistogram {
+  static constexpr size_t kBuckets = 32;
+
+  guint64 count;
+  guint64 total_ns;
+  guint64 max_ns;
+  guint64 buckets[kBuckets];
+
+  void Record(guint64 ns);
+
+  // Upper bound of the bucket holding quantile q (0..1), 0 when empty
+  guint64 Quantile(double q) const;
+};
+
+// Calls of one handler and how long they took
+struct CallStats {
+  guint64 calls;
+  LatencyHistogram latency;
+};
+
+// Counts a call into stats and records its duration on scope exit
+class ScopedCallTimer {
+ public:
+  explicit ScopedCallTimer(CallStats* stats) : stats_(stats), start_(NowNs()) {}
+  ~ScopedCallTimer() {
+    stats_->calls++;
+    stats_->latency.Record(NowNs() - start_);
+  }
+
+  // Disallow copy and assign.
+  ScopedCallTimer(const ScopedCallTimer&) = delete;
+  ScopedCallTimer& operator=(const ScopedCallTimer&) = delete;
+
+  // CLOCK_MONOTONIC in nanoseconds
+  static guint64 NowNs();
+
+  guint64 start_ns() const { return start_; }
+
+ private:
+  CallStats* stats_;
+  guint64 start_;
+};
+
+// C++ interface of the core. OsMediaControlsCore is an opaque handle to one
+// of these.
+class MediaControlsCore {
+ public:
+  using EventCallback = std::function<void(const OsMediaControlsEvent& event)>;
+
+  // Per event type counters
+  struct EventCounters {
+    guint64 delivered;  // Handed to the event callback
+    guint64 merged;  // Superseded by a later value within the window
+    guint64 dropped;  // Duplicate transport command within the dedup window
+  };
+
+  // Calls from one D-Bus sender that were over the rate limit
+  struct SenderStats {
+    guint64 dropped;  // Calls rejected with LimitsExceeded
+    guint64 merged;  // Calls merged into a pending seek/rate event
+  };
+
+  // Main loop stalls seen by the optional watchdog (SetStallDetection)
+  struct StallStats {
+    guint threshold_ms;  // 0 while disabled
+    guint64 stalls;
+    LatencyHistogram duration;  // Time past the heartbeat period without dispatching
+    guint64 calls_waiting;  // D-Bus calls that arrived during a stall
+    guint64 max_calls_waiting;  // In a single stall
+    guint64 max_call_wait_ns;
+    std::vector<std::string> last_waiting;  // Members waiting in the latest stall that had any
+  };
+
+  // Persisted state snapshot (SetStatePersistence)
+  struct SnapshotStats {
+    bool enabled;
+    bool restored;  // State was restored when the core was created
+    bool unconfirmed;  // Restored state not yet confirmed or replaced
+    guint64 writes;
+    guint64 write_failures;
+    guint64 bytes_written;
+  };
+
+  // Diagnostics written and dropped by the rate-limited logger. Shared by
+  // every core in the process.
+  struct LogStats {
+    guint64 emitted;
+    guint64 suppressed;
+    std::map<std::string, guint64> suppressed_by_category;  // Only categories that dropped any
+  };
+
+  // Lazy bus setup (Activate)
+  struct StartupStats {
+    guint64 construct_ns;  // Time spent in the constructor
+    bool activated;
+    bool ready;  // MPRIS objects exported and the bus name requested
+    guint64 bus_ready_ns;  // From activation until ready, 0 until then
+  };
+
+  // Session bus connections lost and recovered
+  struct BusStats {
+    guint64 disconnects;
+    guint64 reconnects;  // Bus name reacquired after a disconnect
+    guint64 failed_attempts;  // Connection attempts that did not connect, first one included
+    LatencyHistogram recovery;  // From the disconnect to the name being reacquired
+  };
+
+  struct Stats {
+    guint64 rate_limit_dropped;
+    guint64 rate_limit_merged;
+    std::map<std::string, SenderStats> senders;  // Only senders that hit the limit
+    guint64 artwork_data_bytes;
+    guint64 artwork_file_bytes;
+    guint artwork_files;
+    guint64 sender_bucket_bytes;
+    guint64 low_memory_warnings;
+    std::map<OsMediaControlsEventType, EventCounters> events;
+    std::string track_id;
+    guint64 stale_set_position;
+    guint64 optimistic_applied;
+    guint64 optimistic_confirmed;
+    guint64 optimistic_rolled_back;
+    guint64 artwork_writes;
+    guint64 artwork_writes_avoided;
+    guint64 artwork_dedup_hits;
+    guint64 artwork_bytes_written;
+    bool artwork_pending;
+    guint64 resident_bytes;  // Heap held for player state, artwork and senders
+    guint64 signals_emitted;
+    guint64 signal_bytes;  // Serialized signal bodies
+    std::map<std::string, CallStats> api_calls;  // Only handlers that ran
+    std::map<std::string, CallStats> dbus_calls;  // Methods, Get and Set
+    StallStats stalls;
+    // From a method call arriving on the connection to its handler running
+    LatencyHistogram bus_to_native;
+    SnapshotStats snapshot;
+    LogStats log;
+    StartupStats startup;
+    BusStats bus;
+  };
+
+  MediaControlsCore();
+  ~MediaControlsCore();
+
+  // Disallow copy and assign.
+  MediaControlsCore(const MediaControlsCore&) = delete;
+  MediaControlsCore& operator=(const MediaControlsCore&) = delete;
+
+  // Create the artwork directory and state file and connect to the session
+  // bus in the background, then export the MPRIS objects and request the bus
+  // name. The constructor does none of this, so creating a core that never
+  // plays anything is cheap; SetMetadata, SetPlaybackState and
+  // SetControlsEnabled activate it, as does restoring a snapshot. State set
+  // while connecting is kept and is what the exported objects first show.
+  //
+  // If the connection closes later (e.g. the bus daemon restarts), the core
+  // reconnects with exponential backoff, exports the objects again and
+  // publishes the current state in one PropertiesChanged once it owns the
+  // name again.
+  void Activate();
+
+  void SetEventCallback(EventCallback callback);
+  void SetMetadata(const OsMediaControlsMetadata& metadata);
+  void SetPlaybackState(OsMediaControlsPlaybackState state, double position, double speed);
+  void SetControlsEnabled(uint32_t controls, bool enabled);
+  void SetSkipIntervals(int forward, int backward);
+  void SetEventCoalescing(int64_t window_ms, int64_t dedup_window_ms);
+  void SetOptimisticUpdates(bool enabled, guint timeout_ms);
+  void Clear();
+  Stats GetStats();
+
+  // Replace the monitor used for low-memory warnings (e.g. with a simulated
+  // GMemoryMonitor implementation). Passing nullptr disables shedding.
+  void SetMemoryMonitor(GMemoryMonitor* monitor);
+
+  // Replace the monotonic clock (microseconds) behind rate limiting, duplicate
+  // command windows and position extrapolation, e.g. with a fake clock in
+  // tests. Passing nullptr restores g_get_monotonic_time(). Timers still run
+  // on the main loop.
+  using MonotonicClock = gint64 (*)(gpointer user_data);
+  void SetMonotonicClock(MonotonicClock clock, gpointer user_data);
+
+  // Record every API call and incoming D-Bus call, with arguments, to a
+  // binary trace at path (replaced if it exists). Setting
+  // OS_MEDIA_CONTROLS_TRACE starts a trace when the core is created.
+  bool StartTrace(const std::string& path);
+  void StopTrace();
+
+  // Export GetStats() as GetStats() -> a{sv} on the
+  // org.mpris.MediaPlayer2.OsMediaControls.Debug interface at
+  // /org/mpris/MediaPlayer2/OsMediaControls. Setting
+  // OS_MEDIA_CONTROLS_DEBUG_DBUS=1 enables it when the core is created.
+  void SetDebugInterfaceEnabled(bool enabled);
+
+  // Watch the main context from a separate thread and record stalls of at
+  // least threshold_ms, with the D-Bus calls that waited on them; 0 stops
+  // watching. Setting OS_MEDIA_CONTROLS_STALL_THRESHOLD_MS enables it when
+  // the core is created.
+  void SetStallDetection(guint threshold_ms);
+
+  // Keep a snapshot of the published state (metadata, artwork, capabilities,
+  // position) in the user's cache directory, written in the background when
+  // it changes. A core created while a snapshot exists publishes it, paused,
+  // before the app sets anything. Disabling deletes the snapshot.
+  void SetStatePersistence(bool enabled);
+
+  // Keep restored state as if the embedder had set it. Until then the first
+  // SetMetadata replaces the restored metadata instead of merging into it,
+  // and Clear() discards it.
+  void ConfirmRestoredState();
+
+ private:
+  // Microbenchmarks (bench/os_media_controls_bench.cc) time the private hot paths
+  friend class MediaControlsBench;
+  // Replays recorded D-Bus calls through the private handlers
+  friend class TraceReplayer;
+  // Conformance tests (test/mpris_conformance_test.cc) apply memory tiers directly
+  friend class MemoryShedTest;
+
+  // Where binary artwork is published for mpris:artUrl
+  enum class ArtworkBackend {
+    kDirectory,  // Files under artwork_dir_
+    kMemfd,  // Sealed memfds exposed as /proc/<pid>/fd/<n>
+  };
+
+  // Latest-value-wins slot for one coalesced event type (seek, setSpeed)
+  struct CoalesceSlot {
+    MediaControlsCore* owner;
+    OsMediaControlsEvent pending;  // Latest merged event, delivered on the trailing edge
+    bool has_pending;
+    guint source_id;  // Open coalescing window
+  };
+
+  // Token bucket tracking one D-Bus sender (keyed by unique bus name)
+  struct SenderBucket {
+    double tokens;
+    gint64 last_refill_time;  // Monotonic time in microseconds
+    guint64 dropped;  // Calls rejected with LimitsExceeded
+    guint64 merged;  // Calls merged into a pending seek/rate event
+  };
+
+  // Handlers with counters and latency histograms, named in the .cc
+  enum ApiCall {
+    kApiSetMetadata,
+    kApiSetPlaybackState,
+    kApiSetControlsEnabled,
+    kApiSetSkipIntervals,
+    kApiSetEventCoalescing,
+    kApiSetOptimisticUpdates,
+    kApiClear,
+    kApiCallCount,
+  };
+
+  enum DBusCall {
+    kDBusPlay,
+    kDBusPause,
+    kDBusPlayPause,
+    kDBusStop,
+    kDBusNext,
+    kDBusPrevious,
+    kDBusSeek,
+    kDBusSetPosition,
+    kDBusRaise,
+    kDBusQuit,
+    kDBusOtherMethod,
+    kDBusGet,  // Also once per property of GetAll
+    kDBusSet,
+    kDBusCallCount,
+  };
+
+  // MPRIS D-Bus interface
+  GDBusConnection* connection_;
+  guint bus_id_;
+  guint media_player_registration_id_;
+  guint root_interface_registration_id_;
+  GDBusNodeInfo* introspection_data_;
+  bool mpris_initialized_;  // Track if MPRIS initialization succeeded
+
+  // Lazy bus setup
+  bool activated_;
+  GCancellable* bus_cancellable_;  // Pending address lookup or connection, else nullptr
+  guint64 activate_time_ns_;
+  guint64 construct_ns_;
+  guint64 bus_ready_ns_;
+
+  // Reconnection after the connection closed
+  gulong closed_handler_id_;
+  bool reconnecting_;  // Until the name is reacquired
+  guint reconnect_attempts_;  // Since the last successful reconnect
+  guint reconnect_id_;  // Pending backoff timeout
+  guint64 disconnect_time_ns_;
+  guint64 bus_disconnects_;
+  guint64 bus_reconnects_;
+  guint64 bus_failed_attempts_;
+  LatencyHistogram bus_recovery_;
+
+  EventCallback event_callback_;
+
+  // Current state
+  std::string playback_status_;  // "Playing", "Paused", "Stopped"
+  double position_;  // Position in microseconds at position_anchor_time_
+  gint64 position_anchor_time_;  // Monotonic time in microseconds
+  double rate_;  // Playback rate
+  std::map<std::string, std::string> metadata_;
+  std::string track_id_;  // mpris:trackid object path of the current track
+  guint64 stale_set_position_;  // Seeks aimed at another track
+  std::vector<uint8_t> artwork_data_;
+  std::string artwork_hash_;  // SHA1 of the current cover, kept when artwork_data_ is shed
+  std::string artwork_path_;
+  std::string artwork_dir_;  // Directory for storing artwork files
+  ArtworkBackend artwork_backend_;
+  std::string memfd_url_prefix_;  // "file:///proc/<pid>/fd/"
+  std::vector<int> artwork_memfds_;  // Open artwork memfds (current and pending cleanup)
+  guint64 memfd_generation_;  // Rotates fd numbers so URLs are not reused
+  bool artwork_pending_;  // artwork_data_ has not been written out yet
+  bool metadata_observed_;  // A D-Bus client has read Metadata
+  guint64 artwork_writes_;
+  guint64 artwork_writes_avoided_;  // Pending covers replaced before any read
+  guint64 artwork_dedup_hits_;  // Writes skipped because the file existed
+  guint64 artwork_bytes_written_;
+
+  // Always-on counters; fixed arrays so the hot paths never allocate
+  CallStats api_calls_[kApiCallCount];
+  CallStats dbus_calls_[kDBusCallCount];
+  guint64 signals_emitted_;
+  guint64 signal_bytes_;
+
+  // Control event stamps and how long method calls waited for dispatch
+  guint64 last_event_sequence_;
+  guint arrival_filter_id_;
+  LatencyHistogram bus_to_native_;
+
+  // Optional debug interface exposing GetStats()
+  bool debug_interface_enabled_;
+  GDBusNodeInfo* debug_introspection_data_;
+  guint debug_registration_id_;
+
+  // Optional main loop watchdog, nullptr unless enabled
+  std::unique_ptr<StallDetector> stall_detector_;
+
+  // Memory-mapped state file for readers that do not want to use D-Bus
+  std::unique_ptr<StateFileWriter> state_file_;
+
+  // Opt-in snapshot restored at startup, nullptr unless persistence is enabled
+  std::unique_ptr<StateSnapshot> state_snapshot_;
+  bool snapshot_artwork_changed_;  // Binary artwork changed since the last capture
+  bool state_restored_;
+  bool restored_unconfirmed_;
+
+  // Opt-in record of incoming calls, nullptr unless tracing
+  std::unique_ptr<TraceWriter> trace_;
+  bool trace_has_artwork_;  // Artwork bytes were written since the trace started
+
+  MonotonicClock clock_;  // nullptr for g_get_monotonic_time()
+  gpointer clock_data_;
+
+  // Control capabilities
+  bool can_play_;
+  bool can_pause_;
+  bool can_stop_;
+  bool can_go_next_;
+  bool can_go_previous_;
+  bool can_seek_;
+  bool can_quit_;
+  bool can_raise_;
+  bool has_track_list_;
+  std::string identity_;
+  std::vector<std::string> supported_uri_schemes_;
+  std::vector<std::string> supported_mime_types_;
+
+  // Skip intervals
+  int skip_forward_interval_;
+  int skip_backward_interval_;
+
+  // Per-sender rate limiting for incoming D-Bus calls
+  std::unordered_map<std::string, SenderBucket> sender_buckets_;
+  guint64 evicted_dropped_;  // Counters of senders pruned from the map
+  guint64 evicted_merged_;
+  bool has_pending_seek_;
+  double pending_seek_position_;  // Position in seconds
+  std::string pending_seek_track_id_;  // Track the merged seek was aimed at
+  bool has_pending_rate_;
+  double pending_rate_;
+  guint rate_limit_flush_id_;
+
+  // Memory pressure handling
+  GMemoryMonitor* memory_monitor_;
+  gulong low_memory_handler_id_;
+  guint64 low_memory_warnings_;
+
+  // Coalescing and deduplication of outgoing control events
+  guint coalesce_window_ms_;  // 0 disables coalescing
+  guint dedup_window_ms_;  // 0 disables deduplication
+  std::map<OsMediaControlsEventType, CoalesceSlot> coalesce_slots_;
+  std::map<OsMediaControlsEventType, EventCounters> event_counters_;
+  bool has_last_transport_;
+  OsMediaControlsEventType last_transport_type_;
+  gint64 last_transport_time_;
+
+  // Optimistic PlaybackStatus updates for Play/Pause/PlayPause
+  bool optimistic_updates_;
+  guint optimistic_timeout_ms_;
+  guint optimistic_timeout_id_;  // Pending confirmation from the embedder
+  std::string rollback_status_;  // Confirmed state restored on timeout
+  double rollback_position_;
+  gint64 rollback_anchor_time_;
+  guint64 optimistic_applied_;
+  guint64 optimistic_confirmed_;
+  guint64 optimistic_rolled_back_;
+
+  // MPRIS-specific helper methods
+  void Connect();
+  static void ResolveBusAddress(GTask* task,
+                                gpointer source_object,
+                                gpointer task_data,
+                                GCancellable* cancellable);
+  static void HandleBusAddressResolved(GObject* source, GAsyncResult* result, gpointer user_data);
+  static void HandleBusAcquired(GObject* source, GAsyncResult* result, gpointer user_data);
+  static void HandleConnectionClosed(GDBusConnection* connection,
+                                     gboolean remote_peer_vanished,
+                                     GError* error,
+                                     gpointer user_data);
+  static void HandleNameAcquired(GDBusConnection* connection,
+                                 const gchar* name,
+                                 gpointer user_data);
+  void ScheduleReconnect();
+  static gboolean HandleReconnectTimeout(gpointer user_data);
+  void InitializeMPRIS();
+  void ReleaseConnection();
+  void CleanupMPRIS();
+  void AddPlayerProperties(GVariantBuilder* builder);
+  void EmitFullState();
+  void UpdateMPRISProperties();
+  void UpdateMetadataProperty();
+  void UpdatePlaybackStatusProperty();
+
+  // D-Bus handler methods
+  // Handle an MPRIS method call; all methods reply with no value on success
+  bool DispatchMethodCall(const gchar* sender,
+                          const gchar* interface_name,
+                          const gchar* method_name,
+                          GVariant* parameters,
+                          GError** error);
+
+  // The exported MPRIS interfaces, parsed once and never freed
+  static GDBusNodeInfo* MprisNodeInfo();
+
+  static void HandleMethodCallDBus(
+      GDBusConnection* connection,
+      const gchar* sender,
+      const gchar* object_path,
+      const gchar* interface_name,
+      const gchar* method_name,
+      GVariant* parameters,
+      GDBusMethodInvocation* invocation,
+      gpointer user_data);
+
+  static GVariant* HandleGetProperty(
+      GDBusConnection* connection,
+      const gchar* sender,
+      const gchar* object_path,
+      const gchar* interface_name,
+      const gchar* property_name,
+      GError** error,
+      gpointer user_data);
+
+  static gboolean HandleSetProperty(
+      GDBusConnection* connection,
+      const gchar* sender,
+      const gchar* object_path,
+      const gchar* interface_name,
+      const gchar* property_name,
+      GVariant* value,
+      GError** error,
+      gpointer user_data);
+
+  // Helper methods
+  GVariant* SafeVariantNewString(const std::string& str);
+  void UpdateTrackId(const std::string& app_track_id);
+  std::string SaveArtworkToFile(const std::vector<uint8_t>& data);
+  std::string SaveArtworkToMemfd(const std::vector<uint8_t>& data);
+  std::string ArtworkFileUrl(const std::vector<uint8_t>& data);
+  void MaterializeArtwork();
+  void DiscardPendingArtwork();
+  bool MemfdArtworkSupported();
+  void CreateArtworkDirectory();
+  void CleanupArtworkFile(const std::string& path);
+  void CleanupArtworkDirectory();
+  void EmitPropertiesChanged(const char* interface_name,
+                             GVariantBuilder* changed_properties_builder);
+
+  // Rate limiting helpers
+  bool AdmitDBusCall(const gchar* sender);
+  void RecordRateLimited(const gchar* sender, bool merged);
+  void PruneSenderBuckets(gint64 now);
+  void MergeRateLimitedSeek(double position);
+  void MergeRateLimitedRate(double rate);
+  void ScheduleRateLimitFlush();
+  static gboolean FlushRateLimitedEvents(gpointer user_data);
+
+  // Memory pressure helpers
+  static void HandleLowMemoryWarning(GMemoryMonitor* monitor,
+                                     GMemoryMonitorWarningLevel level,
+                                     gpointer user_data);
+  void ShedMemory(GMemoryMonitorWarningLevel level);
+  void EvictStaleArtworkFiles();
+  guint64 GetArtworkFileBytes(guint* file_count);
+
+  // Event coalescing helpers
+  void StampEvent(OsMediaControlsEvent* event, guint64 received_ns);
+  void SendEvent(const OsMediaControlsEvent& event);
+  void DeliverEvent(const OsMediaControlsEvent& event);
+  static gboolean FlushCoalescedEvent(gpointer user_data);
+  void ResetCoalescing(bool deliver_pending);
+
+  // Current time from clock_ (microseconds)
+  gint64 Now();
+
+  // Position extrapolation and optimistic state helpers
+  double CurrentPosition();
+  void SetPositionAnchor(double position);
+  void ApplyOptimisticStatus(const char* status);
+  static gboolean HandleOptimisticTimeout(gpointer user_data);
+
+  // State file helpers
+  void OpenStateFile();
+  void PublishStateFile();
+
+  // State snapshot helpers
+  void RestoreStateSnapshot();
+  void ApplyStateSnapshot(const PlayerSnapshot& snapshot);
+  void CaptureStateSnapshot(PlayerSnapshot* snapshot);
+
+  // Debug interface helpers
+  void RegisterDebugInterface();
+  void UnregisterDebugInterface();
+  static void HandleDebugMethodCall(
+      GDBusConnection* connection,
+      const gchar* sender,
+      const gchar* object_path,
+      const gchar* interface_name,
+      const gchar* method_name,
+      GVariant* parameters,
+      GDBusMethodInvocation* invocation,
+      gpointer user_data);
+  static DBusCall DBusCallForMethod(const gchar* method_name);
+  static GDBusMessage* StampMessageArrival(GDBusConnection* connection,
+                                           GDBusMessage* message,
+                                           gboolean incoming,
+                                           gpointer user_data);
+
+  // Trace helpers; payload is floating and consumed
+  bool IsTracing() const { return trace_ != nullptr; }
+  void TraceCall(TraceRecordType type, GVariant* payload);
+  void TraceSetMetadata(const OsMediaControlsMetadata& metadata);
+};
+
+}  // namespace os_media_controls
+
+#endif  // __cplusplus
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_CORE_H_
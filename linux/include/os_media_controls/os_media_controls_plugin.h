@@ -4,11 +4,11 @@
 #include <flutter_linux/flutter_linux.h>
 #include <gio/gio.h>
 
-#include <memory>
 #include <string>
-#include <map>
 #include <vector>
 
+#include "os_media_controls/os_media_controls_core.h"
+
 G_BEGIN_DECLS
 
 #ifdef FLUTTER_PLUGIN_IMPL
@@ -29,9 +29,11 @@ FLUTTER_PLUGIN_EXPORT void os_media_controls_plugin_register_with_registrar(
 
 G_END_DECLS
 
-// C++ implementation class
+// Flutter adapter on top of the MPRIS core
 namespace os_media_controls {
 
+class MediaControlsBench;
+
 class OsMediaControlsPluginImpl {
  public:
   OsMediaControlsPluginImpl(FlPluginRegistrar* registrar,
@@ -46,108 +48,96 @@ class OsMediaControlsPluginImpl {
   void StartListening();
   void StopListening();
   void SendEvent(FlValue* event);
+  FlValue* GetStats();
+
+  // Time os_media_controls_plugin_register_with_registrar took, for getStats
+  void set_registration_ns(guint64 ns) { registration_ns_ = ns; }
 
  private:
-  // MPRIS D-Bus interface
-  GDBusConnection* connection_;
-  guint bus_id_;
-  guint media_player_registration_id_;
-  guint root_interface_registration_id_;
-  GDBusNodeInfo* introspection_data_;
-  bool mpris_initialized_;  // Track if MPRIS initialization succeeded
+  // Microbenchmarks (bench/os_media_controls_bench.cc) time the FlValue helpers
+  friend class MediaControlsBench;
+  // Event buffer tests (test/event_buffer_test.cc) drive BufferEvent directly
+  friend class EventBufferTest;
+
+  // Event held while Dart is not listening
+  struct PendingEvent {
+    FlValue* event;  // nullptr in free slots
+    gint64 time;  // Monotonic time in microseconds
+  };
+
+  // MPRIS state, D-Bus objects and event coalescing
+  MediaControlsCore core_;
 
   // Event channel for sending events to Dart
   FlEventChannel* event_channel_;
   bool is_listening_;
 
-  // Current state
-  std::string playback_status_;  // "Playing", "Paused", "Stopped"
-  double position_;  // Position in microseconds
-  double rate_;  // Playback rate
-  std::map<std::string, std::string> metadata_;
-  std::vector<uint8_t> artwork_data_;
-  std::string artwork_path_;
-  std::string artwork_dir_;  // Directory for storing artwork files
-
-  // Control capabilities
-  bool can_play_;
-  bool can_pause_;
-  bool can_stop_;
-  bool can_go_next_;
-  bool can_go_previous_;
-  bool can_seek_;
-  bool can_quit_;
-  bool can_raise_;
-  bool has_track_list_;
-  std::string identity_;
-  std::vector<std::string> supported_uri_schemes_;
-  std::vector<std::string> supported_mime_types_;
-
-  // Skip intervals
-  int skip_forward_interval_;
-  int skip_backward_interval_;
-
-  // Helper methods for plugin functionality
+  // Events buffered while Dart is not listening (preallocated ring buffer)
+  std::vector<PendingEvent> pending_events_;
+  size_t pending_head_;
+  size_t pending_count_;
+  guint pending_flush_id_;
+  guint64 events_buffered_;
+  guint64 events_superseded_;  // Replaced by a newer event of the same kind
+  guint64 events_evicted_;  // Dropped to make room when the buffer was full
+  guint64 events_expired_;  // Too old to replay when Dart listened again
+
+  // Method channel calls by name (kMethodNames in the .cc; the last entry
+  // counts unknown methods)
+  static constexpr size_t kMethodCount = 15;
+  CallStats method_calls_[kMethodCount];
+
+  // Events handed to the event channel and sends that failed
+  guint64 events_sent_;
+  guint64 event_send_failures_;
+
+  // Stages after the core handled a command, from acknowledgeEvent calls
+  guint64 last_event_sequence_;
+  guint64 events_acknowledged_;
+  LatencyHistogram native_to_isolate_;
+  LatencyHistogram handler_latency_;
+
+  // Opt-in batched delivery: events are sent to Dart as one list message
+  bool batch_events_;
+  guint batch_deadline_ms_;  // 0 flushes on the next main loop iteration
+  std::vector<FlValue*> event_batch_;
+  guint batch_flush_id_;
+  guint64 batch_messages_;
+
+  guint64 registration_ns_;
+
+  // Method channel handlers
   void SetMetadata(FlValue* args);
   void SetPlaybackState(FlValue* args);
-  void EnableControls(FlValue* args);
-  void DisableControls(FlValue* args);
+  void SetControlsEnabled(FlValue* args, bool enabled);
   void SetSkipIntervals(FlValue* args);
   void SetQueueInfo(FlValue* args);
-  void Clear();
-
-  // MPRIS-specific helper methods
-  void InitializeMPRIS();
-  void CleanupMPRIS();
-  void UpdateMPRISProperties();
-  void UpdateMetadataProperty();
-  void UpdatePlaybackStatusProperty();
-  void UpdatePositionProperty();
-  void UpdateRateProperty();
-  void UpdateCanControlProperties();
-
-  // D-Bus handler methods
-  static void HandleMethodCallDBus(
-      GDBusConnection* connection,
-      const gchar* sender,
-      const gchar* object_path,
-      const gchar* interface_name,
-      const gchar* method_name,
-      GVariant* parameters,
-      GDBusMethodInvocation* invocation,
-      gpointer user_data);
-
-  static GVariant* HandleGetProperty(
-      GDBusConnection* connection,
-      const gchar* sender,
-      const gchar* object_path,
-      const gchar* interface_name,
-      const gchar* property_name,
-      GError** error,
-      gpointer user_data);
-
-  static gboolean HandleSetProperty(
-      GDBusConnection* connection,
-      const gchar* sender,
-      const gchar* object_path,
-      const gchar* interface_name,
-      const gchar* property_name,
-      GVariant* value,
-      GError** error,
-      gpointer user_data);
+  void SetEventCoalescing(FlValue* args);
+  void SetEventBatching(FlValue* args);
+  void SetOptimisticUpdates(FlValue* args);
+  void AcknowledgeEvent(FlValue* args);
+  void SetStatePersistence(FlValue* args);
 
   // Helper methods
-  std::string GetStringFromFlValue(FlValue* map, const char* key);
-  double GetDoubleFromFlValue(FlValue* map, const char* key);
-  int64_t GetInt64FromFlValue(FlValue* map, const char* key);
-  std::vector<uint8_t> GetBytesFromFlValue(FlValue* map, const char* key);
-  GVariant* SafeVariantNewString(const std::string& str);
-  std::string SaveArtworkToFile(const std::vector<uint8_t>& data);
-  void CreateArtworkDirectory();
-  void CleanupArtworkFile(const std::string& path);
-  void CleanupArtworkDirectory();
-  void EmitPropertiesChanged(const char* interface_name,
-                             GVariantBuilder* changed_properties_builder);
+  static std::string GetStringFromFlValue(FlValue* map, const char* key);
+  static double GetDoubleFromFlValue(FlValue* map, const char* key);
+  static int64_t GetInt64FromFlValue(FlValue* map, const char* key);
+  static bool GetBoolFromFlValue(FlValue* map, const char* key);
+  // Borrows a Uint8List from the message without copying it
+  static const uint8_t* GetBytesFromFlValue(FlValue* map, const char* key, size_t* length);
+
+  // Converts control events from the core into event channel messages
+  void HandleCoreEvent(const OsMediaControlsEvent& event);
+
+  // Pending event buffer helpers
+  void BufferEvent(FlValue* event);
+  static gboolean FlushPendingEvents(gpointer user_data);
+  void ClearPendingEvents();
+
+  // Batched delivery helpers
+  void SendEventToChannel(FlValue* event);
+  void FlushEventBatch();
+  static gboolean HandleEventBatchTimeout(gpointer user_data);
 };
 
 }  // namespace os_media_controls
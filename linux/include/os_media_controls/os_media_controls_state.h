@@ -0,0 +1,82 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_H_
+
+// Memory-mapped player state file.
+//
+// The Linux plugin publishes its current player state into
+// $XDG_RUNTIME_DIR/os_media_controls_state.<pid> so that status bars and
+// monitoring agents can read it without a D-Bus round trip. The file holds
+// one OsMediaControlsStateLayout protected by a seqlock: the writer makes
+// `sequence` odd while it updates the fields and even again afterwards, and
+// readers retry until they copy the fields between two identical even
+// sequence values. Once mapped, reading costs no system calls.
+//
+// Readers in other languages can map the file directly; all fields use the
+// host byte order and strings are NUL-terminated UTF-8.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OS_MEDIA_CONTROLS_STATE_MAGIC 0x53434d4fu  // "OMCS"
+#define OS_MEDIA_CONTROLS_STATE_VERSION 1u
+#define OS_MEDIA_CONTROLS_STATE_FILE_PREFIX "os_media_controls_state."
+
+#define OS_MEDIA_CONTROLS_STATE_TITLE_SIZE 512
+#define OS_MEDIA_CONTROLS_STATE_ARTIST_SIZE 512
+#define OS_MEDIA_CONTROLS_STATE_ART_URL_SIZE 1024
+
+typedef enum {
+  OS_MEDIA_CONTROLS_STATUS_STOPPED = 0,
+  OS_MEDIA_CONTROLS_STATUS_PLAYING = 1,
+  OS_MEDIA_CONTROLS_STATUS_PAUSED = 2,
+} OsMediaControlsStatus;
+
+// Player state fields, copied out of the file by readers
+typedef struct {
+  uint64_t generation;  // Incremented on every published change
+  int32_t pid;  // Process that publishes the file
+  uint32_t status;  // OsMediaControlsStatus
+  int64_t position_us;  // Position at anchor_time_us
+  int64_t anchor_time_us;  // CLOCK_MONOTONIC time in microseconds
+  double rate;
+  char title[OS_MEDIA_CONTROLS_STATE_TITLE_SIZE];
+  char artist[OS_MEDIA_CONTROLS_STATE_ARTIST_SIZE];
+  char art_url[OS_MEDIA_CONTROLS_STATE_ART_URL_SIZE];
+} OsMediaControlsState;
+
+// Layout of the state file
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sequence;  // Seqlock counter, odd while a write is in progress
+  uint32_t reserved;
+  OsMediaControlsState state;
+} OsMediaControlsStateLayout;
+
+typedef struct _OsMediaControlsStateReader OsMediaControlsStateReader;
+
+// Maps the state file at path. Returns NULL if it cannot be opened or is not
+// a state file.
+OsMediaControlsStateReader* os_media_controls_state_reader_open(const char* path);
+
+void os_media_controls_state_reader_close(OsMediaControlsStateReader* reader);
+
+// Copies a consistent snapshot of the state into out. Returns false if the
+// writer kept the state busy for too long or the layout version is unknown.
+bool os_media_controls_state_reader_read(OsMediaControlsStateReader* reader,
+                                         OsMediaControlsState* out);
+
+// Position in microseconds at CLOCK_MONOTONIC time now_us, extrapolated from
+// the anchor while playing.
+int64_t os_media_controls_state_position_at(const OsMediaControlsState* state,
+                                            int64_t now_us);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_H_
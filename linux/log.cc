@@ -0,0 +1,265 @@
+#include "log.h"
+
+#include <cstdarg>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+static const char kLogDomain[] = "os_media_controls";
+
+// Messages a category may write in a burst, and how fast that refills
+static constexpr double kCategoryBurst = 10;
+static constexpr double kCategoryPerMinute = 10;
+
+// Call sites and keys tracked at once; further ones are only rate limited
+// per category
+static constexpr size_t kMaxTrackedSites = 256;
+
+namespace os_media_controls {
+
+namespace {
+
+struct CategoryInfo {
+  const char* name;
+  gint64 repeat_interval_us;  // Per call site and key
+};
+
+// Indexed by LogCategory
+const CategoryInfo kCategories[] = {
+    {"lifecycle", 60 * G_USEC_PER_SEC}, {"dbus", 60 * G_USEC_PER_SEC},
+    {"metadata", 60 * G_USEC_PER_SEC},  {"artwork", 60 * G_USEC_PER_SEC},
+    {"events", 60 * G_USEC_PER_SEC},    {"state", 60 * G_USEC_PER_SEC},
+    {"mainloop", 10 * G_USEC_PER_SEC},  {"api", 60 * G_USEC_PER_SEC},
+};
+constexpr size_t kCategoryCount = G_N_ELEMENTS(kCategories);
+
+// Identifies a call site and key without copying them: file and line are the
+// string literals from OS_MEDIA_CONTROLS_LOG, and keys whose hashes collide
+// share repeat history
+struct SiteKey {
+  const char* file;
+  const char* line;
+  guint key_hash;
+
+  bool operator==(const SiteKey& other) const {
+    return file == other.file && line == other.line && key_hash == other.key_hash;
+  }
+};
+
+struct SiteKeyHash {
+  size_t operator()(const SiteKey& key) const {
+    size_t hash = std::hash<const void*>()(key.file);
+    hash = hash * 31 + std::hash<const void*>()(key.line);
+    return hash * 31 + key.key_hash;
+  }
+};
+
+struct Site {
+  LogCategory category;
+  gint64 last_written;  // Monotonic time in microseconds, 0 if never
+  guint64 suppressed;  // Since the last message written or summary
+};
+
+struct Bucket {
+  double tokens;
+  gint64 last_refill;
+};
+
+struct LogState {
+  GMutex mutex;
+  std::unordered_map<SiteKey, Site, SiteKeyHash> sites;
+  Bucket buckets[kCategoryCount];
+  guint64 emitted;
+  guint64 suppressed[kCategoryCount];
+
+  LogState() : buckets(), emitted(0), suppressed() {
+    g_mutex_init(&mutex);
+    Reset();
+  }
+
+  // Caller holds mutex
+  void Reset() {
+    sites.clear();
+    for (Bucket& bucket : buckets) {
+      bucket.tokens = kCategoryBurst;
+      bucket.last_refill = g_get_monotonic_time();
+    }
+    emitted = 0;
+    for (guint64& count : suppressed) {
+      count = 0;
+    }
+  }
+};
+
+// Never destroyed: messages may be logged from threads during exit
+LogState& State() {
+  static LogState* state = new LogState();
+  return *state;
+}
+
+bool TakeToken(Bucket* bucket, gint64 now) {
+  bucket->tokens += (now - bucket->last_refill) * kCategoryPerMinute / (60 * G_USEC_PER_SEC);
+  if (bucket->tokens > kCategoryBurst) {
+    bucket->tokens = kCategoryBurst;
+  }
+  bucket->last_refill = now;
+  if (bucket->tokens < 1) {
+    return false;
+  }
+  bucket->tokens -= 1;
+  return true;
+}
+
+// journald priority of a GLib level
+const char* Priority(GLogLevelFlags level) {
+  if (level & G_LOG_LEVEL_ERROR) {
+    return "3";
+  }
+  if (level & G_LOG_LEVEL_CRITICAL) {
+    return "4";
+  }
+  if (level & G_LOG_LEVEL_WARNING) {
+    return "4";
+  }
+  if (level & G_LOG_LEVEL_MESSAGE) {
+    return "5";
+  }
+  if (level & G_LOG_LEVEL_INFO) {
+    return "6";
+  }
+  return "7";
+}
+
+void Write(GLogLevelFlags level,
+           const char* category,
+           const char* key,
+           const char* file,
+           const char* line,
+           const char* func,
+           const std::string& message,
+           guint64 suppressed) {
+  std::string suppressed_text = std::to_string(suppressed);
+  const GLogField fields[] = {
+      {"PRIORITY", Priority(level), -1},
+      {"GLIB_DOMAIN", kLogDomain, -1},
+      {"MESSAGE", message.c_str(), -1},
+      {"CODE_FILE", file, -1},
+      {"CODE_LINE", line, -1},
+      {"CODE_FUNC", func, -1},
+      {"OS_MEDIA_CONTROLS_CATEGORY", category, -1},
+      {"OS_MEDIA_CONTROLS_KEY", key ? key : "", -1},
+      {"OS_MEDIA_CONTROLS_SUPPRESSED", suppressed_text.c_str(), -1},
+  };
+  g_log_structured_array(level, fields, G_N_ELEMENTS(fields));
+}
+
+}  // namespace
+
+void Log(GLogLevelFlags level,
+         LogCategory category,
+         const char* key,
+         const char* file,
+         const char* line,
+         const char* func,
+         const char* format,
+         ...) {
+  LogState& state = State();
+  size_t index = static_cast<size_t>(category);
+  gint64 now = g_get_monotonic_time();
+
+  // Suppressed calls return before anything is allocated
+  SiteKey site_key{file, line, key ? g_str_hash(key) : 0};
+
+  g_mutex_lock(&state.mutex);
+  auto it = state.sites.find(site_key);
+  if (it == state.sites.end() && state.sites.size() < kMaxTrackedSites) {
+    it = state.sites.emplace(site_key, Site{category, 0, 0}).first;
+  }
+  Site* site = it != state.sites.end() ? &it->second : nullptr;
+
+  bool repeat = site && site->last_written != 0 &&
+                now - site->last_written < kCategories[index].repeat_interval_us;
+  if (repeat || !TakeToken(&state.buckets[index], now)) {
+    if (site) {
+      site->suppressed++;
+    }
+    state.suppressed[index]++;
+    g_mutex_unlock(&state.mutex);
+    return;
+  }
+
+  guint64 suppressed = 0;
+  if (site) {
+    suppressed = site->suppressed;
+    site->suppressed = 0;
+    site->last_written = now;
+  }
+  state.emitted++;
+  g_mutex_unlock(&state.mutex);
+
+  va_list args;
+  va_start(args, format);
+  g_autofree gchar* formatted = g_strdup_vprintf(format, args);
+  va_end(args);
+
+  std::string message = formatted;
+  if (suppressed > 0) {
+    message += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+  }
+  Write(level, kCategories[index].name, key, file, line, func, message, suppressed);
+}
+
+void LogSuppressedSummary() {
+  LogState& state = State();
+  guint64 by_category[kCategoryCount] = {};
+  guint64 total = 0;
+
+  g_mutex_lock(&state.mutex);
+  for (auto& entry : state.sites) {
+    by_category[static_cast<size_t>(entry.second.category)] += entry.second.suppressed;
+    total += entry.second.suppressed;
+    entry.second.suppressed = 0;
+  }
+  g_mutex_unlock(&state.mutex);
+
+  if (total == 0) {
+    return;
+  }
+
+  std::string message = std::to_string(total) + " log messages suppressed (";
+  bool first = true;
+  for (size_t i = 0; i < kCategoryCount; i++) {
+    if (by_category[i] > 0) {
+      message += std::string(first ? "" : ", ") + kCategories[i].name + ": " +
+                 std::to_string(by_category[i]);
+      first = false;
+    }
+  }
+  message += ")";
+  Write(G_LOG_LEVEL_MESSAGE, "summary", nullptr, __FILE__, G_STRINGIFY(__LINE__), G_STRFUNC,
+        message, total);
+}
+
+void GetLogStats(MediaControlsCore::LogStats* stats) {
+  LogState& state = State();
+  *stats = MediaControlsCore::LogStats{};
+
+  g_mutex_lock(&state.mutex);
+  stats->emitted = state.emitted;
+  for (size_t i = 0; i < kCategoryCount; i++) {
+    stats->suppressed += state.suppressed[i];
+    if (state.suppressed[i] > 0) {
+      stats->suppressed_by_category[kCategories[i].name] = state.suppressed[i];
+    }
+  }
+  g_mutex_unlock(&state.mutex);
+}
+
+void ResetLog() {
+  LogState& state = State();
+  g_mutex_lock(&state.mutex);
+  state.Reset();
+  g_mutex_unlock(&state.mutex);
+}
+
+}  // namespace os_media_controls
@@ -0,0 +1,68 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_LOG_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_LOG_H_
+
+// Structured, rate-limited diagnostics.
+//
+// Messages are written with g_log_structured_array() in the
+// "os_media_controls" domain, with CODE_FILE, CODE_LINE and CODE_FUNC and
+// these fields for journald filtering (journalctl OS_MEDIA_CONTROLS_CATEGORY=dbus):
+//
+//   OS_MEDIA_CONTROLS_CATEGORY    category name
+//   OS_MEDIA_CONTROLS_KEY         what the message is about, if anything
+//   OS_MEDIA_CONTROLS_SUPPRESSED  messages from the same call site and key
+//                                 dropped since the last one written
+//
+// A call site and key is written at most once per repeat interval of its
+// category, and each category has a token bucket shared by all its call
+// sites. Dropped messages are only counted, before they are formatted, and
+// reported with the next message from the same site and key or by
+// LogSuppressedSummary().
+
+#include <glib.h>
+
+#include "os_media_controls/os_media_controls_core.h"
+
+namespace os_media_controls {
+
+enum class LogCategory {
+  kLifecycle,  // D-Bus setup and teardown
+  kDBus,  // Signals and method handling
+  kMetadata,  // Values the app passed in
+  kArtwork,
+  kEvents,  // Delivery to the embedder
+  kState,  // State file, snapshot and trace
+  kMainLoop,  // Stall warnings
+  kApi,  // Malformed method channel arguments
+};
+
+// key may be nullptr; it must not be the formatted message
+#define OS_MEDIA_CONTROLS_LOG(level, category, key, ...)                                    \
+  os_media_controls::Log(level, os_media_controls::LogCategory::category, key, __FILE__, \
+                         G_STRINGIFY(__LINE__), G_STRFUNC, __VA_ARGS__)
+
+#define OS_MEDIA_CONTROLS_WARNING(category, key, ...) \
+  OS_MEDIA_CONTROLS_LOG(G_LOG_LEVEL_WARNING, category, key, __VA_ARGS__)
+
+// file and line identify the call site by address, so they must be string
+// literals; use the macros above
+void Log(GLogLevelFlags level,
+         LogCategory category,
+         const char* key,
+         const char* file,
+         const char* line,
+         const char* func,
+         const char* format,
+         ...) G_GNUC_PRINTF(7, 8);
+
+// Write one message with the number of messages dropped per category since
+// the last summary, if any were
+void LogSuppressedSummary();
+
+void GetLogStats(MediaControlsCore::LogStats* stats);
+
+// Forget repeat history and counters, e.g. between tests
+void ResetLog();
+
+}  // namespace os_media_controls
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_LOG_H_
@@ -0,0 +1,2963 @@
+#include "os_media_controls/os_media_controls_core.h"
+#include "log.h"
+#include "probes.h"
+#include "stall_detector.h"
+#include "state_file.h"
+#include "state_snapshot.h"
+#include "trace.h"
+
+#include <sys/utsname.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <time.h>
+#include <gio/gio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+
+// MPRIS D-Bus introspection XML
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='org.mpris.MediaPlayer2'>"
+  "    <method name='Raise'/>"
+  "    <method name='Quit'/>"
+  "    <property name='CanQuit' type='b' access='read'/>"
+  "    <property name='CanRaise' type='b' access='read'/>"
+  "    <property name='HasTrackList' type='b' access='read'/>"
+  "    <property name='Identity' type='s' access='read'/>"
+  "    <property name='SupportedUriSchemes' type='as' access='read'/>"
+  "    <property name='SupportedMimeTypes' type='as' access='read'/>"
+  "  </interface>"
+  "  <interface name='org.mpris.MediaPlayer2.Player'>"
+  "    <method name='Next'/>"
+  "    <method name='Previous'/>"
+  "    <method name='Pause'/>"
+  "    <method name='PlayPause'/>"
+  "    <method name='Stop'/>"
+  "    <method name='Play'/>"
+  "    <method name='Seek'>"
+  "      <arg direction='in' name='Offset' type='x'/>"
+  "    </method>"
+  "    <method name='SetPosition'>"
+  "      <arg direction='in' name='TrackId' type='o'/>"
+  "      <arg direction='in' name='Position' type='x'/>"
+  "    </method>"
+  "    <method name='OpenUri'>"
+  "      <arg direction='in' name='Uri' type='s'/>"
+  "    </method>"
+  "    <signal name='Seeked'>"
+  "      <arg name='Position' type='x'/>"
+  "    </signal>"
+  "    <property name='PlaybackStatus' type='s' access='read'/>"
+  "    <property name='Rate' type='d' access='readwrite'/>"
+  "    <property name='Metadata' type='a{sv}' access='read'/>"
+  "    <property name='Volume' type='d' access='readwrite'/>"
+  "    <property name='Position' type='x' access='read'/>"
+  "    <property name='MinimumRate' type='d' access='read'/>"
+  "    <property name='MaximumRate' type='d' access='read'/>"
+  "    <property name='CanGoNext' type='b' access='read'/>"
+  "    <property name='CanGoPrevious' type='b' access='read'/>"
+  "    <property name='CanPlay' type='b' access='read'/>"
+  "    <property name='CanPause' type='b' access='read'/>"
+  "    <property name='CanSeek' type='b' access='read'/>"
+  "    <property name='CanControl' type='b' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+// mpris:trackid values. Track ids live below kTrackIdPrefix; NoTrack is the
+// id the MPRIS specification reserves for "no current track".
+static const char kTrackIdPrefix[] = "/org/mpris/MediaPlayer2/Track/";
+static const char kNoTrackId[] = "/org/mpris/MediaPlayer2/TrackList/NoTrack";
+
+// Token bucket parameters for incoming D-Bus calls. Each sender may burst up to
+// kRateLimitBurst calls and is then refilled at kRateLimitPerSecond.
+static constexpr double kRateLimitPerSecond = 20.0;
+static constexpr double kRateLimitBurst = 40.0;
+
+// Artwork memfds are moved into a rotating fd range so that a new cover never
+// reuses a recently published /proc/<pid>/fd/<n> URL that a shell has cached
+static constexpr int kMemfdFdBase = 256;
+static constexpr int kMemfdFdSpan = 512;
+
+// Default coalescing windows for outgoing control events. Value events (seek,
+// speed) are throttled to one per window with the latest value delivered on
+// the trailing edge; identical transport commands within the dedup window
+// (e.g. a media key seen by both the shell and another daemon) are dropped.
+static constexpr guint kDefaultCoalesceWindowMs = 100;
+static constexpr guint kDefaultDedupWindowMs = 50;
+
+// Time the embedder has to confirm an optimistic PlaybackStatus before it is
+// rolled back
+static constexpr guint kDefaultOptimisticTimeoutMs = 1500;
+
+// Number of tracked senders above which idle buckets are pruned
+static constexpr size_t kMaxTrackedSenders = 64;
+
+// Delay before reconnecting after the session bus connection closed, doubled
+// after every failed attempt
+static constexpr guint kReconnectInitialDelayMs = 100;
+static constexpr guint kReconnectMaxDelayMs = 30000;
+
+// Names of the ApiCall and DBusCall counters in GetStats()
+static const char* const kApiCallNames[] = {
+    "setMetadata", "setPlaybackState", "setControlsEnabled", "setSkipIntervals",
+    "setEventCoalescing", "setOptimisticUpdates", "clear",
+};
+static const char* const kDBusCallNames[] = {
+    "Play", "Pause", "PlayPause", "Stop", "Next", "Previous", "Seek",
+    "SetPosition", "Raise", "Quit", "other", "Get", "Set",
+};
+
+// Optional debug interface with runtime statistics
+static const char kDebugObjectPath[] = "/org/mpris/MediaPlayer2/OsMediaControls";
+static const gchar debug_introspection_xml[] =
+  "<node>"
+  "  <interface name='org.mpris.MediaPlayer2.OsMediaControls.Debug'>"
+  "    <method name='GetStats'>"
+  "      <arg direction='out' name='Stats' type='a{sv}'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+namespace os_media_controls {
+
+// Arrival time (CLOCK_MONOTONIC ns) of an incoming GDBusMessage
+static GQuark ArrivalQuark() {
+  static GQuark quark = g_quark_from_static_string("os-media-controls-arrival");
+  return quark;
+}
+
+static_assert(G_N_ELEMENTS(kApiCallNames) == 7, "kApiCallNames must match ApiCall");
+static_assert(G_N_ELEMENTS(kDBusCallNames) == 13, "kDBusCallNames must match DBusCall");
+
+void LatencyHistogram::Record(guint64 ns) {
+  size_t bucket = ns > 0 ? 63 - __builtin_clzll(ns) : 0;
+  buckets[std::min(bucket, kBuckets - 1)]++;
+  count++;
+  total_ns += ns;
+  max_ns = std::max(max_ns, ns);
+}
+
+guint64 LatencyHistogram::Quantile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  guint64 rank = static_cast<guint64>(std::ceil(q * count));
+  guint64 seen = 0;
+  for (size_t i = 0; i < kBuckets; i++) {
+    seen += buckets[i];
+    if (seen >= rank && seen > 0) {
+      return std::min(max_ns, (G_GUINT64_CONSTANT(2) << i) - 1);
+    }
+  }
+  return max_ns;
+}
+
+guint64 ScopedCallTimer::NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<guint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Helper to safely create GVariant string with UTF-8 validation
+// GLib's g_variant_new_string() aborts the program if the input is not valid UTF-8.
+// This wrapper validates the string first and returns an empty string on failure.
+GVariant* MediaControlsCore::SafeVariantNewString(const std::string& str) {
+  if (str.empty()) {
+    return g_variant_new_string("");
+  }
+
+  // Validate UTF-8
+  if (!g_utf8_validate(str.c_str(), -1, nullptr)) {
+    OS_MEDIA_CONTROLS_WARNING(kMetadata, nullptr,
+                              "Invalid UTF-8 string detected, using empty string instead");
+    return g_variant_new_string("");
+  }
+
+  return g_variant_new_string(str.c_str());
+}
+
+// Assign the current track's mpris:trackid. Shells key their metadata and
+// artwork caches by it, so it is stable for the same track (repeat plays hit
+// the cache) and differs between tracks. App-supplied ids are used as the
+// last path element when they are valid there, otherwise they are hashed;
+// without one, the id is derived from the track's metadata.
+void MediaControlsCore::UpdateTrackId(const std::string& app_track_id) {
+  if (!app_track_id.empty()) {
+    bool valid_element = app_track_id.size() <= 128;
+    for (char c : app_track_id) {
+      if (!g_ascii_isalnum(c) && c != '_') {
+        valid_element = false;
+        break;
+      }
+    }
+
+    if (valid_element) {
+      track_id_ = std::string(kTrackIdPrefix) + "app_" + app_track_id;
+    } else {
+      g_autofree gchar* checksum =
+          g_compute_checksum_for_string(G_CHECKSUM_SHA1, app_track_id.c_str(), -1);
+      track_id_ = std::string(kTrackIdPrefix) + "app_" + std::string(checksum, 16);
+    }
+    return;
+  }
+
+  if (metadata_.empty()) {
+    track_id_ = kNoTrackId;
+    return;
+  }
+
+  // Field separator that cannot occur in the values themselves
+  std::string key;
+  for (const char* field : {"title", "artist", "album", "albumArtist", "duration"}) {
+    auto it = metadata_.find(field);
+    if (it != metadata_.end()) {
+      key += it->second;
+    }
+    key += '\x1f';
+  }
+
+  g_autofree gchar* checksum =
+      g_compute_checksum_for_string(G_CHECKSUM_SHA1, key.c_str(), key.size());
+  track_id_ = std::string(kTrackIdPrefix) + std::string(checksum, 16);
+}
+
+// Write the whole buffer to fd, retrying on short writes and EINTR
+static bool WriteAll(int fd, const uint8_t* data, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    ssize_t result = write(fd, data + written, size - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += result;
+  }
+  return true;
+}
+
+// Remove a directory and the files in it
+static void RemoveDirectory(const std::string& path) {
+  GDir* dir = g_dir_open(path.c_str(), 0, nullptr);
+  if (!dir) {
+    return;
+  }
+
+  const char* filename;
+  while ((filename = g_dir_read_name(dir)) != nullptr) {
+    std::stringstream ss;
+    ss << path << "/" << filename;
+    std::remove(ss.str().c_str());
+  }
+
+  g_dir_close(dir);
+  rmdir(path.c_str());
+}
+
+// Remove per-instance artwork directories whose process no longer exists,
+// so crashed runs do not keep RAM-backed files around until logout
+static void CollectStaleArtworkDirectories(const std::string& base_dir) {
+  GDir* dir = g_dir_open(base_dir.c_str(), 0, nullptr);
+  if (!dir) {
+    return;
+  }
+
+  const char* name;
+  while ((name = g_dir_read_name(dir)) != nullptr) {
+    char* end = nullptr;
+    long pid = strtol(name, &end, 10);
+    if (end == name || *end != '\0' || pid <= 0 || pid == getpid()) {
+      continue;
+    }
+
+    if (kill(static_cast<pid_t>(pid), 0) < 0 && errno == ESRCH) {
+      RemoveDirectory(base_dir + "/" + name);
+    }
+  }
+
+  g_dir_close(dir);
+}
+
+// Create artwork directory
+void MediaControlsCore::CreateArtworkDirectory() {
+  // Use XDG_RUNTIME_DIR for RAM-based temporary storage (auto-cleanup on logout)
+  const char* runtime_dir = g_get_user_runtime_dir();
+  if (!runtime_dir) {
+    // Fallback to /tmp if XDG_RUNTIME_DIR is not available
+    runtime_dir = g_get_tmp_dir();
+  }
+
+  std::stringstream ss;
+  ss << runtime_dir << "/os_media_controls_artwork";
+  std::string base_dir = ss.str();
+
+  CollectStaleArtworkDirectories(base_dir);
+
+  // Each instance owns a subdirectory named after its PID, so cleanup never
+  // touches artwork published by another running instance
+  ss << "/" << getpid();
+  artwork_dir_ = ss.str();
+
+  // Create directory if it doesn't exist
+  g_mkdir_with_parents(artwork_dir_.c_str(), 0700);
+}
+
+// Remove state files left behind by processes that no longer exist
+static void CollectStaleStateFiles(const char* runtime_dir) {
+  GDir* dir = g_dir_open(runtime_dir, 0, nullptr);
+  if (!dir) {
+    return;
+  }
+
+  const size_t prefix_length = strlen(OS_MEDIA_CONTROLS_STATE_FILE_PREFIX);
+  const char* name;
+  while ((name = g_dir_read_name(dir)) != nullptr) {
+    if (!g_str_has_prefix(name, OS_MEDIA_CONTROLS_STATE_FILE_PREFIX)) {
+      continue;
+    }
+
+    // Also matches "<pid>.tmp" files from a writer that died mid-creation
+    char* end = nullptr;
+    long pid = strtol(name + prefix_length, &end, 10);
+    if (end == name + prefix_length || pid <= 0 || pid == getpid() ||
+        (*end != '\0' && strcmp(end, ".tmp") != 0)) {
+      continue;
+    }
+
+    if (kill(static_cast<pid_t>(pid), 0) < 0 && errno == ESRCH) {
+      std::string path = std::string(runtime_dir) + "/" + name;
+      unlink(path.c_str());
+    }
+  }
+
+  g_dir_close(dir);
+}
+
+// Create the memory-mapped state file in XDG_RUNTIME_DIR. There is no /tmp
+// fallback: readers only look in the runtime directory.
+void MediaControlsCore::OpenStateFile() {
+  const char* runtime_dir = g_getenv("XDG_RUNTIME_DIR");
+  if (!runtime_dir || !g_file_test(runtime_dir, G_FILE_TEST_IS_DIR)) {
+    return;
+  }
+
+  CollectStaleStateFiles(runtime_dir);
+
+  std::stringstream ss;
+  ss << runtime_dir << "/" << OS_MEDIA_CONTROLS_STATE_FILE_PREFIX << getpid();
+
+  auto state_file = std::make_unique<StateFileWriter>();
+  if (!state_file->Open(ss.str())) {
+    OS_MEDIA_CONTROLS_WARNING(kState, nullptr, "Failed to create state file %s: %s",
+                              ss.str().c_str(), g_strerror(errno));
+    return;
+  }
+
+  state_file_ = std::move(state_file);
+  PublishStateFile();
+}
+
+// Mirror the current player state into the state file (and the snapshot,
+// once the change settles)
+void MediaControlsCore::PublishStateFile() {
+  if (state_snapshot_) {
+    state_snapshot_->MarkDirty();
+  }
+
+  if (!state_file_) {
+    return;
+  }
+
+  OsMediaControlsStatus status = OS_MEDIA_CONTROLS_STATUS_STOPPED;
+  if (playback_status_ == "Playing") {
+    status = OS_MEDIA_CONTROLS_STATUS_PLAYING;
+  } else if (playback_status_ == "Paused") {
+    status = OS_MEDIA_CONTROLS_STATUS_PAUSED;
+  }
+
+  auto title_it = metadata_.find("title");
+  auto artist_it = metadata_.find("artist");
+  static const std::string empty;
+
+  // Pending artwork is only written once a D-Bus client asks for it
+  state_file_->Publish(status,
+                       static_cast<int64_t>(position_),
+                       position_anchor_time_,
+                       rate_,
+                       title_it != metadata_.end() ? title_it->second : empty,
+                       artist_it != metadata_.end() ? artist_it->second : empty,
+                       artwork_pending_ ? empty : artwork_path_);
+}
+
+// Decide whether shells will be able to open /proc/<pid>/fd/<n> artwork URLs.
+// Other processes of the same user can only do so while we are dumpable, and
+// sandboxed apps run in their own PID namespace, so their /proc paths are
+// meaningless to the host shell.
+bool MediaControlsCore::MemfdArtworkSupported() {
+  if (prctl(PR_GET_DUMPABLE) != 1) {
+    return false;
+  }
+
+  if (g_file_test("/.flatpak-info", G_FILE_TEST_EXISTS) || g_getenv("SNAP")) {
+    return false;
+  }
+
+  if (!g_file_test("/proc/self/fd", G_FILE_TEST_IS_DIR)) {
+    return false;
+  }
+
+  memfd_url_prefix_ = "file:///proc/" + std::to_string(getpid()) + "/fd/";
+  return true;
+}
+
+// Save artwork into a sealed memfd and return its /proc file:// URI. The kernel
+// reclaims the memory when the fd is closed or the process exits, so nothing
+// is left behind in the runtime directory after a crash.
+std::string MediaControlsCore::SaveArtworkToMemfd(const std::vector<uint8_t>& data) {
+  int fd = memfd_create("os_media_controls_artwork", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr, "SaveArtworkToMemfd: memfd_create failed: %s",
+                              g_strerror(errno));
+    return "";
+  }
+
+  if (!WriteAll(fd, data.data(), data.size())) {
+    OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr, "SaveArtworkToMemfd: write failed: %s",
+                              g_strerror(errno));
+    close(fd);
+    return "";
+  }
+
+  // Readers get an immutable image even though they share the same file
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+    OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr, "SaveArtworkToMemfd: failed to seal memfd: %s",
+                              g_strerror(errno));
+  }
+
+  // Move to the next slot of the rotating range, staying below RLIMIT_NOFILE
+  struct rlimit limit;
+  int span = kMemfdFdSpan;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+    span = std::min<int>(span, static_cast<int>(limit.rlim_cur) - kMemfdFdBase - 1);
+  }
+  if (span > 0) {
+    int target = kMemfdFdBase + static_cast<int>(memfd_generation_++ % span);
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, target);
+    if (moved >= 0) {
+      close(fd);
+      fd = moved;
+    }
+  }
+
+  artwork_memfds_.push_back(fd);
+  artwork_writes_++;
+  artwork_bytes_written_ += data.size();
+  return memfd_url_prefix_ + std::to_string(fd);
+}
+
+// Deterministic file:// URL for artwork in the artwork directory. It is derived
+// from the content, so it is known before the file is written and repeat plays
+// of the same cover map to the same URL.
+std::string MediaControlsCore::ArtworkFileUrl(const std::vector<uint8_t>& data) {
+  if (artwork_backend_ != ArtworkBackend::kDirectory || artwork_dir_.empty() ||
+      data.empty()) {
+    return "";
+  }
+
+  g_autofree gchar* checksum =
+      g_compute_checksum_for_data(G_CHECKSUM_SHA1, data.data(), data.size());
+  return "file://" + artwork_dir_ + "/artwork_" + checksum + ".jpg";
+}
+
+// Drop artwork that was never written, counting the write it saved
+void MediaControlsCore::DiscardPendingArtwork() {
+  if (artwork_pending_) {
+    artwork_pending_ = false;
+    artwork_writes_avoided_++;
+  }
+}
+
+// Write pending artwork once a client is about to see its URL
+void MediaControlsCore::MaterializeArtwork() {
+  if (!artwork_pending_) {
+    return;
+  }
+
+  artwork_pending_ = false;
+  artwork_path_ = SaveArtworkToFile(artwork_data_);
+  PublishStateFile();
+}
+
+// Save artwork to file with content-derived name and return file:// URI
+std::string MediaControlsCore::SaveArtworkToFile(const std::vector<uint8_t>& data) {
+  if (data.empty()) {
+    return "";
+  }
+
+  OS_MEDIA_CONTROLS_PROBE_SCOPE(save_artwork, "artwork", data.size());
+
+  if (artwork_backend_ == ArtworkBackend::kMemfd && data.data()) {
+    // Whether other processes can open the URL is decided once, by
+    // MemfdArtworkSupported(); opening it from here would always succeed
+    std::string url = SaveArtworkToMemfd(data);
+    if (!url.empty()) {
+      return url;
+    }
+    artwork_backend_ = ArtworkBackend::kDirectory;
+  }
+
+  if (artwork_dir_.empty()) {
+    return "";
+  }
+
+  // Verify data pointer is valid
+  if (!data.data()) {
+    OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr, "SaveArtworkToFile: data pointer is null");
+    return "";
+  }
+
+  // The name changes with the content, so shells never show a cached cover
+  // for a different image, and identical covers are written only once
+  std::string url = ArtworkFileUrl(data);
+  std::string path = url.substr(7);
+  if (g_file_test(path.c_str(), G_FILE_TEST_EXISTS)) {
+    artwork_dedup_hits_++;
+    return url;
+  }
+
+  // Write to an unnamed file and only link it into place once complete, so a
+  // shell reading mpris:artUrl never sees a partially written image. Fall back
+  // to a temporary name plus rename() where O_TMPFILE is unsupported.
+  std::string temp_path;
+  int fd = open(artwork_dir_.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    temp_path = path + ".XXXXXX";
+    fd = mkostemp(&temp_path[0], O_CLOEXEC);
+    if (fd < 0) {
+      OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr, "SaveArtworkToFile: failed to open file '%s'",
+                                path.c_str());
+      return "";
+    }
+  }
+
+  if (!WriteAll(fd, data.data(), data.size())) {
+    OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr, "SaveArtworkToFile: failed to write to file '%s'",
+                              path.c_str());
+    close(fd);
+    // Try to remove the partial file
+    if (!temp_path.empty()) {
+      std::remove(temp_path.c_str());
+    }
+    return "";
+  }
+
+  bool published;
+  if (temp_path.empty()) {
+    std::string fd_path = "/proc/self/fd/" + std::to_string(fd);
+    published = linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, path.c_str(),
+                       AT_SYMLINK_FOLLOW) == 0 || errno == EEXIST;
+  } else {
+    published = rename(temp_path.c_str(), path.c_str()) == 0;
+    if (!published) {
+      std::remove(temp_path.c_str());
+    }
+  }
+  int publish_error = errno;
+  close(fd);
+
+  if (!published) {
+    OS_MEDIA_CONTROLS_WARNING(kArtwork, nullptr,
+                              "SaveArtworkToFile: failed to publish file '%s': %s", path.c_str(),
+                              g_strerror(publish_error));
+    return "";
+  }
+
+  artwork_writes_++;
+  artwork_bytes_written_ += data.size();
+  return url;
+}
+
+// Clean up a single artwork file
+void MediaControlsCore::CleanupArtworkFile(const std::string& path) {
+  if (path.empty()) {
+    return;
+  }
+
+  // Close memfds we published
+  if (!memfd_url_prefix_.empty() && path.find(memfd_url_prefix_) == 0) {
+    int fd = atoi(path.c_str() + memfd_url_prefix_.size());
+    auto it = std::find(artwork_memfds_.begin(), artwork_memfds_.end(), fd);
+    if (it != artwork_memfds_.end()) {
+      close(fd);
+      artwork_memfds_.erase(it);
+    }
+    return;
+  }
+
+  // Only delete files we created (in our artwork directory)
+  if (!artwork_dir_.empty() && path.find("file://") == 0) {
+    std::string file_path = path.substr(7);
+    if (file_path.find(artwork_dir_) == 0) {
+      std::remove(file_path.c_str());
+    }
+  }
+}
+
+// Clean up entire artwork directory
+void MediaControlsCore::CleanupArtworkDirectory() {
+  if (artwork_dir_.empty()) {
+    return;
+  }
+
+  // Only this instance's subdirectory; other instances keep their artwork
+  RemoveDirectory(artwork_dir_);
+}
+
+// Remove every artwork file and memfd except the one currently published
+void MediaControlsCore::EvictStaleArtworkFiles() {
+  for (auto it = artwork_memfds_.begin(); it != artwork_memfds_.end();) {
+    if (memfd_url_prefix_ + std::to_string(*it) != artwork_path_) {
+      close(*it);
+      it = artwork_memfds_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  if (artwork_dir_.empty()) {
+    return;
+  }
+
+  GDir* dir = g_dir_open(artwork_dir_.c_str(), 0, nullptr);
+  if (!dir) {
+    return;
+  }
+
+  const char* filename;
+  while ((filename = g_dir_read_name(dir)) != nullptr) {
+    std::string path = artwork_dir_ + "/" + filename;
+    if ("file://" + path != artwork_path_) {
+      std::remove(path.c_str());
+    }
+  }
+
+  g_dir_close(dir);
+}
+
+// Sum the size of the files in the artwork directory
+guint64 MediaControlsCore::GetArtworkFileBytes(guint* file_count) {
+  guint64 total = 0;
+  guint count = 0;
+
+  GDir* dir = artwork_dir_.empty() ? nullptr : g_dir_open(artwork_dir_.c_str(), 0, nullptr);
+  if (dir) {
+    const char* filename;
+    while ((filename = g_dir_read_name(dir)) != nullptr) {
+      std::string path = artwork_dir_ + "/" + filename;
+      struct stat st;
+      if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        total += st.st_size;
+        count++;
+      }
+    }
+    g_dir_close(dir);
+  }
+
+  for (int fd : artwork_memfds_) {
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      total += st.st_size;
+      count++;
+    }
+  }
+
+  if (file_count) {
+    *file_count = count;
+  }
+  return total;
+}
+
+// Constructor
+MediaControlsCore::MediaControlsCore()
+    : connection_(nullptr),
+      bus_id_(0),
+      media_player_registration_id_(0),
+      root_interface_registration_id_(0),
+      introspection_data_(nullptr),
+      mpris_initialized_(false),
+      activated_(false),
+      bus_cancellable_(nullptr),
+      activate_time_ns_(0),
+      construct_ns_(0),
+      bus_ready_ns_(0),
+      closed_handler_id_(0),
+      reconnecting_(false),
+      reconnect_attempts_(0),
+      reconnect_id_(0),
+      disconnect_time_ns_(0),
+      bus_disconnects_(0),
+      bus_reconnects_(0),
+      bus_failed_attempts_(0),
+      bus_recovery_(),
+      playback_status_("Stopped"),
+      position_(0),
+      position_anchor_time_(g_get_monotonic_time()),
+      rate_(1.0),
+      track_id_(kNoTrackId),
+      stale_set_position_(0),
+      artwork_backend_(ArtworkBackend::kDirectory),
+      memfd_generation_(0),
+      artwork_pending_(false),
+      metadata_observed_(false),
+      artwork_writes_(0),
+      artwork_writes_avoided_(0),
+      artwork_dedup_hits_(0),
+      artwork_bytes_written_(0),
+      api_calls_(),
+      dbus_calls_(),
+      signals_emitted_(0),
+      signal_bytes_(0),
+      last_event_sequence_(0),
+      arrival_filter_id_(0),
+      bus_to_native_(),
+      debug_interface_enabled_(false),
+      debug_introspection_data_(nullptr),
+      debug_registration_id_(0),
+      snapshot_artwork_changed_(false),
+      state_restored_(false),
+      restored_unconfirmed_(false),
+      trace_has_artwork_(false),
+      clock_(nullptr),
+      clock_data_(nullptr),
+      can_play_(true),
+      can_pause_(true),
+      can_stop_(false),
+      can_go_next_(false),
+      can_go_previous_(false),
+      can_seek_(false),
+      can_quit_(false),
+      can_raise_(false),
+      has_track_list_(false),
+      identity_(g_get_application_name() ? g_get_application_name() : "OS Media Controls"),
+      supported_uri_schemes_({"file", "http", "https"}),
+      supported_mime_types_({"audio/mpeg", "audio/flac", "audio/wav"}),
+      skip_forward_interval_(0),
+      skip_backward_interval_(0),
+      evicted_dropped_(0),
+      evicted_merged_(0),
+      has_pending_seek_(false),
+      pending_seek_position_(0),
+      has_pending_rate_(false),
+      pending_rate_(1.0),
+      rate_limit_flush_id_(0),
+      memory_monitor_(nullptr),
+      low_memory_handler_id_(0),
+      low_memory_warnings_(0),
+      coalesce_window_ms_(kDefaultCoalesceWindowMs),
+      dedup_window_ms_(kDefaultDedupWindowMs),
+      has_last_transport_(false),
+      last_transport_type_(OS_MEDIA_CONTROLS_EVENT_PLAY),
+      last_transport_time_(0),
+      optimistic_updates_(false),
+      optimistic_timeout_ms_(kDefaultOptimisticTimeoutMs),
+      optimistic_timeout_id_(0),
+      rollback_position_(0),
+      rollback_anchor_time_(0),
+      optimistic_applied_(0),
+      optimistic_confirmed_(0),
+      optimistic_rolled_back_(0) {
+  guint64 construct_start = ScopedCallTimer::NowNs();
+
+  // Every event type has counters up front so counting never inserts
+  for (int type = OS_MEDIA_CONTROLS_EVENT_PLAY; type <= OS_MEDIA_CONTROLS_EVENT_SET_SPEED;
+       type++) {
+    event_counters_[static_cast<OsMediaControlsEventType>(type)] = EventCounters{};
+  }
+
+  InitializeProbes();
+
+  // Restored state is in place before the bus name is requested, so the
+  // first shell to see the player already sees it
+  RestoreStateSnapshot();
+  if (state_restored_) {
+    Activate();
+  }
+
+  if (g_strcmp0(g_getenv("OS_MEDIA_CONTROLS_DEBUG_DBUS"), "1") == 0) {
+    SetDebugInterfaceEnabled(true);
+  }
+
+  const char* stall_threshold = g_getenv("OS_MEDIA_CONTROLS_STALL_THRESHOLD_MS");
+  if (stall_threshold && *stall_threshold) {
+    SetStallDetection(static_cast<guint>(g_ascii_strtoull(stall_threshold, nullptr, 10)));
+  }
+
+  const char* trace_path = g_getenv("OS_MEDIA_CONTROLS_TRACE");
+  if (trace_path && *trace_path && !StartTrace(trace_path)) {
+    OS_MEDIA_CONTROLS_WARNING(kState, nullptr, "Failed to start trace at %s: %s", trace_path,
+                              g_strerror(errno));
+  }
+
+  g_autoptr(GMemoryMonitor) memory_monitor = g_memory_monitor_dup_default();
+  SetMemoryMonitor(memory_monitor);
+
+  construct_ns_ = ScopedCallTimer::NowNs() - construct_start;
+}
+
+// Destructor
+MediaControlsCore::~MediaControlsCore() {
+  if (state_snapshot_) {
+    state_snapshot_->Flush();
+    state_snapshot_.reset();
+  }
+  stall_detector_.reset();
+  LogSuppressedSummary();
+  SetMemoryMonitor(nullptr);
+  ResetCoalescing(false);
+  if (optimistic_timeout_id_ > 0) {
+    g_source_remove(optimistic_timeout_id_);
+    optimistic_timeout_id_ = 0;
+  }
+  if (rate_limit_flush_id_ > 0) {
+    g_source_remove(rate_limit_flush_id_);
+    rate_limit_flush_id_ = 0;
+  }
+  if (reconnect_id_ > 0) {
+    g_source_remove(reconnect_id_);
+    reconnect_id_ = 0;
+  }
+  if (bus_cancellable_) {
+    g_cancellable_cancel(bus_cancellable_);
+    g_clear_object(&bus_cancellable_);
+  }
+  CleanupMPRIS();
+  CleanupArtworkDirectory();
+  state_file_.reset();
+  StopTrace();
+}
+
+// Start publishing the player; the session bus is connected asynchronously
+void MediaControlsCore::Activate() {
+  if (activated_) {
+    return;
+  }
+  activated_ = true;
+  activate_time_ns_ = ScopedCallTimer::NowNs();
+
+  CreateArtworkDirectory();
+  if (MemfdArtworkSupported()) {
+    artwork_backend_ = ArtworkBackend::kMemfd;
+  }
+  OpenStateFile();
+  Connect();
+}
+
+// Open a session bus connection of our own in the background. The shared
+// g_bus_get() connection raises SIGTERM when it closes unless the application
+// turned exit-on-close off, so it could not be reconnected. Finding the
+// address may autolaunch a bus, so it is looked up on a worker thread too.
+void MediaControlsCore::Connect() {
+  bus_cancellable_ = g_cancellable_new();
+  GTask* task = g_task_new(nullptr, bus_cancellable_, HandleBusAddressResolved, this);
+  g_task_run_in_thread(task, ResolveBusAddress);
+  g_object_unref(task);
+}
+
+// Runs on a GTask worker thread; touches nothing but the task
+void MediaControlsCore::ResolveBusAddress(GTask* task,
+                                          gpointer source_object,
+                                          gpointer task_data,
+                                          GCancellable* cancellable) {
+  GError* error = nullptr;
+  gchar* address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, cancellable, &error);
+  if (address) {
+    g_task_return_pointer(task, address, g_free);
+  } else {
+    g_task_return_error(task, error);
+  }
+}
+
+void MediaControlsCore::HandleBusAddressResolved(GObject* source,
+                                                 GAsyncResult* result,
+                                                 gpointer user_data) {
+  GError* error = nullptr;
+  g_autofree gchar* address =
+      static_cast<gchar*>(g_task_propagate_pointer(G_TASK(result), &error));
+
+  // The core was destroyed while resolving
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_error_free(error);
+    return;
+  }
+
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  if (!address) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Failed to find session bus: %s",
+                              error->message);
+    g_error_free(error);
+    g_clear_object(&self->bus_cancellable_);
+    self->bus_failed_attempts_++;
+    self->ScheduleReconnect();
+    return;
+  }
+
+  g_dbus_connection_new_for_address(
+      address,
+      static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                        G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+      nullptr, self->bus_cancellable_, HandleBusAcquired, self);
+}
+
+// Export the objects on the new connection. Nothing was emitted while
+// connecting, so the exported properties are the current state.
+void MediaControlsCore::HandleBusAcquired(GObject* source,
+                                          GAsyncResult* result,
+                                          gpointer user_data) {
+  GError* error = nullptr;
+  GDBusConnection* connection = g_dbus_connection_new_for_address_finish(result, &error);
+
+  // The core was destroyed while connecting
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_error_free(error);
+    return;
+  }
+
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  g_clear_object(&self->bus_cancellable_);
+
+  if (error) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Failed to connect to session bus: %s",
+                              error->message);
+    g_error_free(error);
+    self->bus_failed_attempts_++;
+    self->ScheduleReconnect();
+    return;
+  }
+
+  self->connection_ = connection;
+  self->closed_handler_id_ =
+      g_signal_connect(connection, "closed", G_CALLBACK(HandleConnectionClosed), self);
+  self->InitializeMPRIS();
+  if (!self->mpris_initialized_) {
+    self->ReleaseConnection();
+    self->bus_failed_attempts_++;
+    self->ScheduleReconnect();
+    return;
+  }
+  if (self->bus_ready_ns_ == 0) {
+    self->bus_ready_ns_ = ScopedCallTimer::NowNs() - self->activate_time_ns_;
+  }
+
+  // A watchdog started before this connection existed cannot see its calls
+  if (self->stall_detector_) {
+    self->stall_detector_->SetConnection(self->connection_);
+  }
+}
+
+// The bus daemon went away or dropped us. Player state is kept; everything
+// tied to the connection is released and a new one is opened after a backoff.
+void MediaControlsCore::HandleConnectionClosed(GDBusConnection* connection,
+                                               gboolean remote_peer_vanished,
+                                               GError* error,
+                                               gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Session bus connection closed: %s",
+                            error ? error->message : "closed by peer");
+
+  self->bus_disconnects_++;
+  if (!self->reconnecting_) {
+    self->disconnect_time_ns_ = ScopedCallTimer::NowNs();
+    self->reconnecting_ = true;
+  }
+  self->ReleaseConnection();
+  self->ScheduleReconnect();
+}
+
+// After a reconnect, shells saw the player vanish and will read it again, but
+// anything that only listens for changes is brought up to date in one signal
+void MediaControlsCore::HandleNameAcquired(GDBusConnection* connection,
+                                           const gchar* name,
+                                           gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  self->reconnect_attempts_ = 0;
+  if (!self->reconnecting_) {
+    return;
+  }
+
+  guint64 recovery_ns = ScopedCallTimer::NowNs() - self->disconnect_time_ns_;
+  self->reconnecting_ = false;
+  self->bus_reconnects_++;
+  self->bus_recovery_.Record(recovery_ns);
+  self->EmitFullState();
+  OS_MEDIA_CONTROLS_LOG(G_LOG_LEVEL_MESSAGE, kLifecycle, nullptr,
+                        "Reconnected to the session bus after %" G_GUINT64_FORMAT " ms",
+                        recovery_ns / 1000000);
+}
+
+// Try again after kReconnectInitialDelayMs, doubling per failed attempt up to
+// kReconnectMaxDelayMs. The first connection is retried the same way, so a
+// session bus that comes up after the player still gets it.
+void MediaControlsCore::ScheduleReconnect() {
+  guint shift = std::min(reconnect_attempts_, 16u);
+  guint delay_ms = std::min(kReconnectInitialDelayMs << shift, kReconnectMaxDelayMs);
+  reconnect_attempts_++;
+  reconnect_id_ = g_timeout_add(delay_ms, HandleReconnectTimeout, this);
+}
+
+gboolean MediaControlsCore::HandleReconnectTimeout(gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  self->reconnect_id_ = 0;
+  self->Connect();
+  return G_SOURCE_REMOVE;
+}
+
+GDBusNodeInfo* MediaControlsCore::MprisNodeInfo() {
+  static GDBusNodeInfo* info = g_dbus_node_info_new_for_xml(introspection_xml, nullptr);
+  return info;
+}
+
+// Initialize MPRIS D-Bus interface on connection_
+void MediaControlsCore::InitializeMPRIS() {
+  GError* error = nullptr;
+
+  // Parse introspection XML
+  introspection_data_ = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+  if (error) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Failed to parse introspection XML: %s",
+                              error->message);
+    g_error_free(error);
+    mpris_initialized_ = false;
+    return;
+  }
+
+  if (!introspection_data_) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr,
+                              "Failed to parse introspection XML: data is null");
+    mpris_initialized_ = false;
+    return;
+  }
+
+  // Verify we have at least 2 interfaces (MediaPlayer2 and MediaPlayer2.Player)
+  if (!introspection_data_->interfaces ||
+      !introspection_data_->interfaces[0] ||
+      !introspection_data_->interfaces[1]) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr,
+                              "Introspection data does not contain expected interfaces");
+    if (introspection_data_) {
+      g_dbus_node_info_unref(introspection_data_);
+      introspection_data_ = nullptr;
+    }
+    mpris_initialized_ = false;
+    return;
+  }
+
+  // Define vtable for handling D-Bus method calls
+  static const GDBusInterfaceVTable vtable = {
+    HandleMethodCallDBus,
+    HandleGetProperty,
+    HandleSetProperty
+  };
+
+  // Register base MediaPlayer2 interface
+  root_interface_registration_id_ = g_dbus_connection_register_object(
+      connection_,
+      "/org/mpris/MediaPlayer2",
+      introspection_data_->interfaces[0],  // MediaPlayer2 interface
+      &vtable,
+      this,
+      nullptr,
+      &error);
+
+  if (error) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Failed to register MediaPlayer2 interface: %s",
+                              error->message);
+    g_error_free(error);
+    mpris_initialized_ = false;
+    return;
+  }
+
+  if (root_interface_registration_id_ == 0) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr,
+                              "Failed to register MediaPlayer2 interface: registration ID is 0");
+    mpris_initialized_ = false;
+    return;
+  }
+
+  // Register MediaPlayer2.Player interface
+  media_player_registration_id_ = g_dbus_connection_register_object(
+      connection_,
+      "/org/mpris/MediaPlayer2",
+      introspection_data_->interfaces[1],  // Player interface
+      &vtable,
+      this,
+      nullptr,
+      &error);
+
+  if (error) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr,
+                              "Failed to register MediaPlayer2.Player interface: %s",
+                              error->message);
+    g_error_free(error);
+    mpris_initialized_ = false;
+    return;
+  }
+
+  if (media_player_registration_id_ == 0) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr,
+                              "Failed to register MediaPlayer2.Player interface: "
+                              "registration ID is 0");
+    mpris_initialized_ = false;
+    return;
+  }
+
+  // Time stamp incoming calls on the worker thread, so the handler can tell
+  // how long they waited for the main loop
+  arrival_filter_id_ =
+      g_dbus_connection_add_filter(connection_, StampMessageArrival, nullptr, nullptr);
+
+  // Request bus name
+  bus_id_ = g_bus_own_name_on_connection(
+      connection_,
+      "org.mpris.MediaPlayer2.OsMediaControls",
+      G_BUS_NAME_OWNER_FLAGS_NONE,
+      HandleNameAcquired,
+      nullptr,
+      this,
+      nullptr);
+
+  if (debug_interface_enabled_) {
+    RegisterDebugInterface();
+  }
+
+  // Mark as successfully initialized
+  mpris_initialized_ = true;
+  OS_MEDIA_CONTROLS_LOG(G_LOG_LEVEL_MESSAGE, kLifecycle, nullptr,
+                        "MPRIS interface initialized successfully");
+}
+
+// Drop the name, objects and connection, keeping the player state
+void MediaControlsCore::ReleaseConnection() {
+  mpris_initialized_ = false;
+
+  if (bus_id_ > 0) {
+    g_bus_unown_name(bus_id_);
+    bus_id_ = 0;
+  }
+
+  if (media_player_registration_id_ > 0) {
+    g_dbus_connection_unregister_object(connection_, media_player_registration_id_);
+    media_player_registration_id_ = 0;
+  }
+
+  if (root_interface_registration_id_ > 0) {
+    g_dbus_connection_unregister_object(connection_, root_interface_registration_id_);
+    root_interface_registration_id_ = 0;
+  }
+
+  UnregisterDebugInterface();
+
+  if (arrival_filter_id_ > 0) {
+    g_dbus_connection_remove_filter(connection_, arrival_filter_id_);
+    arrival_filter_id_ = 0;
+  }
+
+  if (introspection_data_) {
+    g_dbus_node_info_unref(introspection_data_);
+    introspection_data_ = nullptr;
+  }
+
+  // The watchdog keeps running and its counters; only the filter goes
+  if (stall_detector_) {
+    stall_detector_->SetConnection(nullptr);
+  }
+
+  if (connection_) {
+    if (closed_handler_id_ > 0) {
+      g_signal_handler_disconnect(connection_, closed_handler_id_);
+      closed_handler_id_ = 0;
+    }
+    // Private connections stay open until closed explicitly
+    if (!g_dbus_connection_is_closed(connection_)) {
+      g_dbus_connection_close(connection_, nullptr, nullptr, nullptr);
+    }
+    g_object_unref(connection_);
+    connection_ = nullptr;
+  }
+}
+
+// Cleanup MPRIS
+void MediaControlsCore::CleanupMPRIS() {
+  ReleaseConnection();
+
+  // Clean up current artwork file
+  CleanupArtworkFile(artwork_path_);
+}
+
+// Take one token from the sender's bucket, refilling it for the elapsed time.
+// Returns false if the sender is over its limit.
+bool MediaControlsCore::AdmitDBusCall(const gchar* sender) {
+  // Peer-to-peer connections have no sender; nothing to key the bucket on
+  if (!sender) {
+    return true;
+  }
+
+  gint64 now = Now();
+
+  auto it = sender_buckets_.find(sender);
+  if (it == sender_buckets_.end()) {
+    if (sender_buckets_.size() >= kMaxTrackedSenders) {
+      PruneSenderBuckets(now);
+    }
+    it = sender_buckets_.emplace(sender, SenderBucket{kRateLimitBurst, now, 0, 0}).first;
+  }
+
+  SenderBucket& bucket = it->second;
+  double elapsed = (now - bucket.last_refill_time) / 1000000.0;
+  bucket.tokens = std::min(kRateLimitBurst, bucket.tokens + elapsed * kRateLimitPerSecond);
+  bucket.last_refill_time = now;
+
+  if (bucket.tokens < 1.0) {
+    return false;
+  }
+
+  bucket.tokens -= 1.0;
+  return true;
+}
+
+// Count a call that was over the limit against its sender
+void MediaControlsCore::RecordRateLimited(const gchar* sender, bool merged) {
+  if (!sender) {
+    return;
+  }
+
+  auto it = sender_buckets_.find(sender);
+  if (it == sender_buckets_.end()) {
+    return;
+  }
+
+  if (merged) {
+    it->second.merged++;
+  } else {
+    it->second.dropped++;
+  }
+}
+
+// Drop buckets of senders that have been idle long enough to refill completely.
+// Their counters are folded into the evicted totals so getStats stays accurate.
+void MediaControlsCore::PruneSenderBuckets(gint64 now) {
+  for (auto it = sender_buckets_.begin(); it != sender_buckets_.end();) {
+    const SenderBucket& bucket = it->second;
+    double elapsed = (now - bucket.last_refill_time) / 1000000.0;
+    if (bucket.tokens + elapsed * kRateLimitPerSecond >= kRateLimitBurst) {
+      evicted_dropped_ += bucket.dropped;
+      evicted_merged_ += bucket.merged;
+      it = sender_buckets_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Keep only the latest seek target from over-limit senders
+void MediaControlsCore::MergeRateLimitedSeek(double position) {
+  pending_seek_position_ = position;
+  pending_seek_track_id_ = track_id_;
+  has_pending_seek_ = true;
+  ScheduleRateLimitFlush();
+}
+
+// Keep only the latest rate from over-limit senders
+void MediaControlsCore::MergeRateLimitedRate(double rate) {
+  pending_rate_ = rate;
+  has_pending_rate_ = true;
+  ScheduleRateLimitFlush();
+}
+
+// Deliver merged values once a token would have been refilled
+void MediaControlsCore::ScheduleRateLimitFlush() {
+  if (rate_limit_flush_id_ > 0) {
+    return;
+  }
+
+  guint interval_ms = static_cast<guint>(std::ceil(1000.0 / kRateLimitPerSecond));
+  rate_limit_flush_id_ = g_timeout_add(interval_ms, FlushRateLimitedEvents, this);
+}
+
+gboolean MediaControlsCore::FlushRateLimitedEvents(gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  self->rate_limit_flush_id_ = 0;
+
+  // A merged seek targets the track it was requested for, which may have
+  // changed while it waited
+  if (self->has_pending_seek_) {
+    self->has_pending_seek_ = false;
+    if (self->pending_seek_track_id_ == self->track_id_) {
+      self->SendEvent({OS_MEDIA_CONTROLS_EVENT_SEEK, self->pending_seek_position_});
+    } else {
+      self->stale_set_position_++;
+    }
+  }
+
+  if (self->has_pending_rate_) {
+    self->has_pending_rate_ = false;
+    self->SendEvent({OS_MEDIA_CONTROLS_EVENT_SET_SPEED, self->pending_rate_});
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+// D-Bus method call handler
+void MediaControlsCore::HandleMethodCallDBus(
+    GDBusConnection* connection,
+    const gchar* sender,
+    const gchar* object_path,
+    const gchar* interface_name,
+    const gchar* method_name,
+    GVariant* parameters,
+    GDBusMethodInvocation* invocation,
+    gpointer user_data) {
+
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  if (!self) {
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_FAILED,
+                                          "Internal error: null user data");
+    return;
+  }
+
+  OS_MEDIA_CONTROLS_PROBE_SCOPE(dbus_method, method_name, sender,
+                                parameters ? g_variant_get_size(parameters) : 0);
+
+  guint64 arrival = GPOINTER_TO_SIZE(g_object_get_qdata(
+      G_OBJECT(g_dbus_method_invocation_get_message(invocation)), ArrivalQuark()));
+  if (arrival > 0) {
+    guint64 now = ScopedCallTimer::NowNs();
+    self->bus_to_native_.Record(now > arrival ? now - arrival : 0);
+  }
+
+  GError* error = nullptr;
+  if (self->DispatchMethodCall(sender, interface_name, method_name, parameters, &error)) {
+    g_dbus_method_invocation_return_value(invocation, nullptr);
+  } else {
+    g_dbus_method_invocation_take_error(invocation, error);
+  }
+}
+
+bool MediaControlsCore::DispatchMethodCall(const gchar* sender,
+                                           const gchar* interface_name,
+                                           const gchar* method_name,
+                                           GVariant* parameters,
+                                           GError** error) {
+  ScopedCallTimer timer(&dbus_calls_[DBusCallForMethod(method_name)]);
+
+  if (!interface_name || !method_name) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                "Invalid arguments");
+    return false;
+  }
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kDBusMethodCall,
+              g_variant_new("(sssv)", sender ? sender : "", interface_name, method_name,
+                            parameters ? parameters : g_variant_new("()")));
+  }
+
+  bool is_player_interface =
+      g_strcmp0(interface_name, "org.mpris.MediaPlayer2.Player") == 0;
+  bool is_root_interface =
+      g_strcmp0(interface_name, "org.mpris.MediaPlayer2") == 0;
+
+  if (!is_player_interface && !is_root_interface) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_INTERFACE,
+                "Unknown interface");
+    return false;
+  }
+
+  if (is_root_interface) {
+    if (g_strcmp0(method_name, "Raise") == 0 ||
+        g_strcmp0(method_name, "Quit") == 0) {
+      return true;
+    }
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                "Unknown method");
+    return false;
+  }
+
+  OsMediaControlsEvent event = {OS_MEDIA_CONTROLS_EVENT_PLAY, 0};
+
+  if (g_strcmp0(method_name, "Play") == 0) {
+    event.type = OS_MEDIA_CONTROLS_EVENT_PLAY;
+  } else if (g_strcmp0(method_name, "Pause") == 0) {
+    event.type = OS_MEDIA_CONTROLS_EVENT_PAUSE;
+  } else if (g_strcmp0(method_name, "PlayPause") == 0) {
+    event.type = (playback_status_ == "Playing")
+                     ? OS_MEDIA_CONTROLS_EVENT_PAUSE
+                     : OS_MEDIA_CONTROLS_EVENT_PLAY;
+  } else if (g_strcmp0(method_name, "Stop") == 0) {
+    event.type = OS_MEDIA_CONTROLS_EVENT_STOP;
+  } else if (g_strcmp0(method_name, "Next") == 0) {
+    event.type = OS_MEDIA_CONTROLS_EVENT_NEXT;
+  } else if (g_strcmp0(method_name, "Previous") == 0) {
+    event.type = OS_MEDIA_CONTROLS_EVENT_PREVIOUS;
+  } else if (g_strcmp0(method_name, "Seek") == 0) {
+    gint64 offset_microseconds;
+    g_variant_get(parameters, "(x)", &offset_microseconds);
+
+    // Calculate new position
+    double new_position = CurrentPosition() / 1000000.0 + offset_microseconds / 1000000.0;
+    event = {OS_MEDIA_CONTROLS_EVENT_SEEK, new_position};
+  } else if (g_strcmp0(method_name, "SetPosition") == 0) {
+    const gchar* track_id;
+    gint64 position_microseconds;
+    g_variant_get(parameters, "(&ox)", &track_id, &position_microseconds);
+
+    // Per the MPRIS specification, a seek aimed at another track is stale
+    // (e.g. sent just before a track change) and must be ignored
+    if (g_strcmp0(track_id, track_id_.c_str()) != 0) {
+      stale_set_position_++;
+      return true;
+    }
+
+    event = {OS_MEDIA_CONTROLS_EVENT_SEEK, position_microseconds / 1000000.0};
+  } else {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                "Unknown method");
+    return false;
+  }
+
+  // Over-limit senders have their seeks merged into the latest target and
+  // their transport commands rejected, so one client cannot flood the embedder.
+  // Only recognised methods are charged against the sender's tokens
+  if (!AdmitDBusCall(sender)) {
+    bool merged = event.type == OS_MEDIA_CONTROLS_EVENT_SEEK;
+    RecordRateLimited(sender, merged);
+    if (merged) {
+      MergeRateLimitedSeek(event.value);
+      return true;
+    }
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+                "Too many requests from %s", sender);
+    return false;
+  }
+
+  // An admitted seek is newer than any merged one still waiting to be flushed
+  if (event.type == OS_MEDIA_CONTROLS_EVENT_SEEK) {
+    has_pending_seek_ = false;
+  }
+
+  // Reflect play/pause in PlaybackStatus right away instead of waiting for
+  // the embedder; SetPlaybackState confirms it, otherwise it is rolled back
+  if (optimistic_updates_) {
+    if (event.type == OS_MEDIA_CONTROLS_EVENT_PLAY) {
+      ApplyOptimisticStatus("Playing");
+    } else if (event.type == OS_MEDIA_CONTROLS_EVENT_PAUSE) {
+      ApplyOptimisticStatus("Paused");
+    }
+  }
+
+  StampEvent(&event, timer.start_ns());
+  SendEvent(event);
+  return true;
+}
+
+// D-Bus property get handler
+GVariant* MediaControlsCore::HandleGetProperty(
+    GDBusConnection* connection,
+    const gchar* sender,
+    const gchar* object_path,
+    const gchar* interface_name,
+    const gchar* property_name,
+    GError** error,
+    gpointer user_data) {
+
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  if (!self) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                "Internal error: null user data");
+    return nullptr;
+  }
+
+  if (!interface_name || !property_name) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                "Invalid arguments");
+    return nullptr;
+  }
+
+  ScopedCallTimer timer(&self->dbus_calls_[kDBusGet]);
+  OS_MEDIA_CONTROLS_PROBE_SCOPE(get_property, property_name, sender);
+
+  // GetAll reaches this once per property and is recorded that way
+  if (self->IsTracing()) {
+    self->TraceCall(TraceRecordType::kDBusGetProperty,
+                    g_variant_new("(sss)", sender ? sender : "", interface_name, property_name));
+  }
+
+  if (g_strcmp0(interface_name, "org.mpris.MediaPlayer2") == 0) {
+    if (g_strcmp0(property_name, "CanQuit") == 0) {
+      return g_variant_new_boolean(self->can_quit_);
+    } else if (g_strcmp0(property_name, "CanRaise") == 0) {
+      return g_variant_new_boolean(self->can_raise_);
+    } else if (g_strcmp0(property_name, "HasTrackList") == 0) {
+      return g_variant_new_boolean(self->has_track_list_);
+    } else if (g_strcmp0(property_name, "Identity") == 0) {
+      return self->SafeVariantNewString(self->identity_);
+    } else if (g_strcmp0(property_name, "SupportedUriSchemes") == 0) {
+      GVariantBuilder builder;
+      g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
+      for (const auto& scheme : self->supported_uri_schemes_) {
+        // Validate UTF-8 before adding
+        if (!scheme.empty() && g_utf8_validate(scheme.c_str(), -1, nullptr)) {
+          g_variant_builder_add(&builder, "s", scheme.c_str());
+        }
+      }
+      return g_variant_builder_end(&builder);
+    } else if (g_strcmp0(property_name, "SupportedMimeTypes") == 0) {
+      GVariantBuilder builder;
+      g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
+      for (const auto& mime : self->supported_mime_types_) {
+        // Validate UTF-8 before adding
+        if (!mime.empty() && g_utf8_validate(mime.c_str(), -1, nullptr)) {
+          g_variant_builder_add(&builder, "s", mime.c_str());
+        }
+      }
+      return g_variant_builder_end(&builder);
+    }
+  } else if (g_strcmp0(interface_name, "org.mpris.MediaPlayer2.Player") == 0) {
+    if (g_strcmp0(property_name, "PlaybackStatus") == 0) {
+      return self->SafeVariantNewString(self->playback_status_);
+    } else if (g_strcmp0(property_name, "Rate") == 0) {
+      return g_variant_new_double(self->rate_);
+    } else if (g_strcmp0(property_name, "Position") == 0) {
+      return g_variant_new_int64(static_cast<gint64>(self->CurrentPosition()));
+    } else if (g_strcmp0(property_name, "MinimumRate") == 0) {
+      return g_variant_new_double(0.1);
+    } else if (g_strcmp0(property_name, "MaximumRate") == 0) {
+      return g_variant_new_double(10.0);
+    } else if (g_strcmp0(property_name, "CanGoNext") == 0) {
+      return g_variant_new_boolean(self->can_go_next_);
+    } else if (g_strcmp0(property_name, "CanGoPrevious") == 0) {
+      return g_variant_new_boolean(self->can_go_previous_);
+    } else if (g_strcmp0(property_name, "CanPlay") == 0) {
+      return g_variant_new_boolean(self->can_play_);
+    } else if (g_strcmp0(property_name, "CanPause") == 0) {
+      return g_variant_new_boolean(self->can_pause_);
+    } else if (g_strcmp0(property_name, "CanSeek") == 0) {
+      return g_variant_new_boolean(self->can_seek_);
+    } else if (g_strcmp0(property_name, "CanControl") == 0) {
+      return g_variant_new_boolean(TRUE);
+    } else if (g_strcmp0(property_name, "Metadata") == 0) {
+      GVariantBuilder builder;
+      g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+      // Binary artwork is only written out once a D-Bus client reads Metadata.
+      // After that, every PropertiesChanged carries a materialized URL too.
+      if (sender) {
+        self->metadata_observed_ = true;
+      }
+      if (self->metadata_observed_) {
+        self->MaterializeArtwork();
+      }
+
+      // Thread safety note: This function (HandleGetProperty) and SetMetadata must run
+      // on the same thread. Currently both run on the GLib main loop thread, preventing
+      // concurrent access to metadata_ map.
+
+      auto title_it = self->metadata_.find("title");
+      if (title_it != self->metadata_.end() && !title_it->second.empty()) {
+        g_variant_builder_add(&builder, "{sv}", "xesam:title",
+                             self->SafeVariantNewString(title_it->second));
+      }
+
+      auto artist_it = self->metadata_.find("artist");
+      if (artist_it != self->metadata_.end() && !artist_it->second.empty()) {
+        // Validate UTF-8 before adding to array
+        if (g_utf8_validate(artist_it->second.c_str(), -1, nullptr)) {
+          GVariantBuilder artist_builder;
+          g_variant_builder_init(&artist_builder, G_VARIANT_TYPE("as"));
+          g_variant_builder_add(&artist_builder, "s", artist_it->second.c_str());
+          g_variant_builder_add(&builder, "{sv}", "xesam:artist",
+                               g_variant_builder_end(&artist_builder));
+        }
+      }
+
+      auto album_it = self->metadata_.find("album");
+      if (album_it != self->metadata_.end() && !album_it->second.empty()) {
+        g_variant_builder_add(&builder, "{sv}", "xesam:album",
+                             self->SafeVariantNewString(album_it->second));
+      }
+
+      auto album_artist_it = self->metadata_.find("albumArtist");
+      if (album_artist_it != self->metadata_.end() && !album_artist_it->second.empty()) {
+        // Validate UTF-8 before adding to array
+        if (g_utf8_validate(album_artist_it->second.c_str(), -1, nullptr)) {
+          GVariantBuilder album_artist_builder;
+          g_variant_builder_init(&album_artist_builder, G_VARIANT_TYPE("as"));
+          g_variant_builder_add(&album_artist_builder, "s", album_artist_it->second.c_str());
+          g_variant_builder_add(&builder, "{sv}", "xesam:albumArtist",
+                               g_variant_builder_end(&album_artist_builder));
+        }
+      }
+
+      auto duration_it = self->metadata_.find("duration");
+      if (duration_it != self->metadata_.end() && !duration_it->second.empty()) {
+        try {
+          double duration = std::stod(duration_it->second);
+          if (duration > 0 && std::isfinite(duration)) {
+            g_variant_builder_add(&builder, "{sv}", "mpris:length",
+                                 g_variant_new_int64(static_cast<gint64>(duration * 1000000)));
+          }
+        } catch (const std::invalid_argument& e) {
+          OS_MEDIA_CONTROLS_WARNING(kMetadata, "duration",
+                                    "Failed to parse duration '%s': invalid argument",
+                                    duration_it->second.c_str());
+        } catch (const std::out_of_range& e) {
+          OS_MEDIA_CONTROLS_WARNING(kMetadata, "duration",
+                                    "Failed to parse duration '%s': out of range",
+                                    duration_it->second.c_str());
+        }
+      }
+
+      if (!self->artwork_path_.empty() && !self->artwork_pending_) {
+        g_variant_builder_add(&builder, "{sv}", "mpris:artUrl",
+                             self->SafeVariantNewString(self->artwork_path_));
+      }
+
+      g_variant_builder_add(&builder, "{sv}", "mpris:trackid",
+                           g_variant_new_object_path(self->track_id_.c_str()));
+
+      return g_variant_builder_end(&builder);
+    } else if (g_strcmp0(property_name, "Volume") == 0) {
+      return g_variant_new_double(1.0);
+    }
+  }
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "Unknown property: %s", property_name);
+  return nullptr;
+}
+
+// D-Bus property set handler
+gboolean MediaControlsCore::HandleSetProperty(
+    GDBusConnection* connection,
+    const gchar* sender,
+    const gchar* object_path,
+    const gchar* interface_name,
+    const gchar* property_name,
+    GVariant* value,
+    GError** error,
+    gpointer user_data) {
+
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  if (!self) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                "Internal error: null user data");
+    return FALSE;
+  }
+
+  if (!property_name || !value) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                "Invalid arguments");
+    return FALSE;
+  }
+
+  ScopedCallTimer timer(&self->dbus_calls_[kDBusSet]);
+
+  if (self->IsTracing()) {
+    self->TraceCall(TraceRecordType::kDBusSetProperty,
+                    g_variant_new("(sssv)", sender ? sender : "",
+                                  interface_name ? interface_name : "", property_name, value));
+  }
+
+  if (g_strcmp0(property_name, "Rate") == 0) {
+    double rate = g_variant_get_double(value);
+    self->rate_ = rate;
+
+    if (!self->AdmitDBusCall(sender)) {
+      self->RecordRateLimited(sender, true);
+      self->MergeRateLimitedRate(rate);
+      return TRUE;
+    }
+
+    // An admitted rate is newer than any merged one still waiting to be flushed
+    self->has_pending_rate_ = false;
+    OsMediaControlsEvent event = {OS_MEDIA_CONTROLS_EVENT_SET_SPEED, rate};
+    self->StampEvent(&event, timer.start_ns());
+    self->SendEvent(event);
+
+    return TRUE;
+  }
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "Property not writable: %s", property_name);
+  return FALSE;
+}
+
+// Emit PropertiesChanged signal
+void MediaControlsCore::EmitPropertiesChanged(
+    const char* interface_name,
+    GVariantBuilder* changed_properties_builder) {
+
+  if (!mpris_initialized_ || !connection_ || !changed_properties_builder) {
+    if (changed_properties_builder) {
+      // Clean up the builder if MPRIS is not initialized
+      g_variant_builder_clear(changed_properties_builder);
+    }
+    return;
+  }
+
+  g_autoptr(GVariant) changed_properties =
+      g_variant_ref_sink(g_variant_builder_end(changed_properties_builder));
+
+  GVariantBuilder invalidated_builder;
+  g_variant_builder_init(&invalidated_builder, G_VARIANT_TYPE("as"));
+  g_autoptr(GVariant) invalidated =
+      g_variant_ref_sink(g_variant_builder_end(&invalidated_builder));
+
+  g_autoptr(GVariant) signal_params = g_variant_ref_sink(
+      g_variant_new("(s@a{sv}@as)",
+                    interface_name,
+                    changed_properties,
+                    invalidated));
+  gsize signal_size = g_variant_get_size(signal_params);
+
+  OS_MEDIA_CONTROLS_PROBE_SCOPE(emit_properties_changed, interface_name,
+                                g_variant_n_children(changed_properties), signal_size);
+
+  GError* error = nullptr;
+  g_dbus_connection_emit_signal(
+      connection_,
+      nullptr,
+      "/org/mpris/MediaPlayer2",
+      "org.freedesktop.DBus.Properties",
+      "PropertiesChanged",
+      signal_params,
+      &error);
+
+  if (error) {
+    OS_MEDIA_CONTROLS_WARNING(kDBus, interface_name, "Failed to emit PropertiesChanged: %s",
+                              error->message);
+    g_error_free(error);
+    return;
+  }
+
+  signals_emitted_++;
+  signal_bytes_ += signal_size;
+}
+
+// Add playback status, rate and capabilities to an a{sv} builder
+void MediaControlsCore::AddPlayerProperties(GVariantBuilder* builder) {
+  g_variant_builder_add(builder, "{sv}", "PlaybackStatus",
+                       SafeVariantNewString(playback_status_));
+  g_variant_builder_add(builder, "{sv}", "Rate",
+                       g_variant_new_double(rate_));
+  g_variant_builder_add(builder, "{sv}", "CanGoNext",
+                       g_variant_new_boolean(can_go_next_));
+  g_variant_builder_add(builder, "{sv}", "CanGoPrevious",
+                       g_variant_new_boolean(can_go_previous_));
+  g_variant_builder_add(builder, "{sv}", "CanPlay",
+                       g_variant_new_boolean(can_play_));
+  g_variant_builder_add(builder, "{sv}", "CanPause",
+                       g_variant_new_boolean(can_pause_));
+  g_variant_builder_add(builder, "{sv}", "CanSeek",
+                       g_variant_new_boolean(can_seek_));
+}
+
+// Update MPRIS properties
+void MediaControlsCore::UpdateMPRISProperties() {
+  PublishStateFile();
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  AddPlayerProperties(&builder);
+
+  EmitPropertiesChanged("org.mpris.MediaPlayer2.Player", &builder);
+}
+
+// Publish every changing Player property, metadata included, in one signal
+void MediaControlsCore::EmitFullState() {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  AddPlayerProperties(&builder);
+
+  GVariant* metadata = HandleGetProperty(connection_, nullptr, nullptr,
+                                          "org.mpris.MediaPlayer2.Player",
+                                          "Metadata", nullptr, this);
+  if (metadata) {
+    g_variant_builder_add(&builder, "{sv}", "Metadata", metadata);
+  }
+
+  EmitPropertiesChanged("org.mpris.MediaPlayer2.Player", &builder);
+}
+
+// Update PlaybackStatus property only
+void MediaControlsCore::UpdatePlaybackStatusProperty() {
+  PublishStateFile();
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+  g_variant_builder_add(&builder, "{sv}", "PlaybackStatus",
+                       SafeVariantNewString(playback_status_));
+
+  EmitPropertiesChanged("org.mpris.MediaPlayer2.Player", &builder);
+}
+
+// Update metadata property
+void MediaControlsCore::UpdateMetadataProperty() {
+  PublishStateFile();
+
+  if (!mpris_initialized_ || !connection_) {
+    return;
+  }
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+  GVariant* metadata = HandleGetProperty(connection_, nullptr, nullptr,
+                                          "org.mpris.MediaPlayer2.Player",
+                                          "Metadata", nullptr, this);
+  if (metadata) {
+    g_variant_builder_add(&builder, "{sv}", "Metadata", metadata);
+    EmitPropertiesChanged("org.mpris.MediaPlayer2.Player", &builder);
+  } else {
+    g_variant_builder_clear(&builder);
+  }
+}
+
+// Set the function control events are delivered to
+void MediaControlsCore::SetEventCallback(EventCallback callback) {
+  event_callback_ = std::move(callback);
+}
+
+// Set metadata
+// Thread safety note: This function modifies the metadata_ map and must run on the same
+// thread as HandleGetProperty (which reads from metadata_). Both functions execute on
+// the GLib main loop thread, ensuring single-threaded access and preventing race conditions.
+void MediaControlsCore::SetMetadata(const OsMediaControlsMetadata& metadata) {
+  ScopedCallTimer timer(&api_calls_[kApiSetMetadata]);
+
+  if (IsTracing()) {
+    TraceSetMetadata(metadata);
+  }
+
+  // Before the artwork URL is derived from the artwork directory
+  Activate();
+
+  // Restored metadata belongs to whatever played before the restart
+  if (restored_unconfirmed_) {
+    restored_unconfirmed_ = false;
+    metadata_.clear();
+    artwork_path_.clear();
+    snapshot_artwork_changed_ = true;
+  }
+
+  // Update metadata map
+  if (metadata.title && *metadata.title) metadata_["title"] = metadata.title;
+  if (metadata.artist && *metadata.artist) metadata_["artist"] = metadata.artist;
+  if (metadata.album && *metadata.album) metadata_["album"] = metadata.album;
+  if (metadata.album_artist && *metadata.album_artist) {
+    metadata_["albumArtist"] = metadata.album_artist;
+  }
+  if (metadata.duration > 0 && std::isfinite(metadata.duration)) {
+    metadata_["duration"] = std::to_string(metadata.duration);
+  }
+
+  UpdateTrackId(metadata.track_id ? metadata.track_id : "");
+
+  // Handle artwork - clean up old file first
+  std::string old_artwork_path = artwork_path_;
+
+  // Check for artwork URL first (preferred if provided)
+  std::string artwork_url = metadata.artwork_url ? metadata.artwork_url : "";
+  if (!artwork_url.empty()) {
+    // Pass through URLs directly (file://, http://, https://)
+    // Note: GNOME Shell only supports file:// reliably, but we'll pass through anyway
+    if (artwork_url.find("file://") == 0 ||
+        artwork_url.find("http://") == 0 ||
+        artwork_url.find("https://") == 0) {
+      artwork_path_ = artwork_url;
+      DiscardPendingArtwork();
+      artwork_data_.clear();  // Clear binary data if using URL
+      artwork_hash_.clear();
+    } else {
+      // If it's not a proper URL, try to make it a file:// URL
+      if (artwork_url[0] == '/') {
+        artwork_path_ = "file://" + artwork_url;
+        DiscardPendingArtwork();
+        artwork_data_.clear();
+        artwork_hash_.clear();
+      }
+    }
+  } else if (metadata.artwork && metadata.artwork_length > 0) {
+    // Fall back to binary artwork data. Covers are compared by hash since the
+    // retained bytes may have been shed under memory pressure
+    const uint8_t* artwork_end = metadata.artwork + metadata.artwork_length;
+    g_autofree gchar* hash =
+        g_compute_checksum_for_data(G_CHECKSUM_SHA1, metadata.artwork, metadata.artwork_length);
+    bool changed = artwork_hash_ != hash;
+    if (changed || (artwork_path_.empty() && !artwork_pending_)) {
+      // Defer writing until a client reads Metadata; the directory backend's
+      // URL is content-derived and therefore already known
+      DiscardPendingArtwork();
+      artwork_data_.assign(metadata.artwork, artwork_end);
+      artwork_hash_ = hash;
+      artwork_path_ = ArtworkFileUrl(artwork_data_);
+      artwork_pending_ = true;
+      snapshot_artwork_changed_ = true;
+    }
+  }
+
+  // Clean up old artwork file if it's different and in our artwork directory
+  if (old_artwork_path != artwork_path_) {
+    if (artwork_data_.empty()) {
+      snapshot_artwork_changed_ = true;
+    }
+    CleanupArtworkFile(old_artwork_path);
+  }
+
+  UpdateMetadataProperty();
+}
+
+// Set playback state (position in seconds)
+void MediaControlsCore::SetPlaybackState(OsMediaControlsPlaybackState state,
+                                         double position,
+                                         double speed) {
+  ScopedCallTimer timer(&api_calls_[kApiSetPlaybackState]);
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kSetPlaybackState,
+              g_variant_new("(idd)", static_cast<gint32>(state), position, speed));
+  }
+
+  Activate();
+
+  // Map playback states to MPRIS PlaybackStatus
+  std::string status = playback_status_;
+  switch (state) {
+    case OS_MEDIA_CONTROLS_PLAYBACK_PLAYING:
+      status = "Playing";
+      break;
+    case OS_MEDIA_CONTROLS_PLAYBACK_PAUSED:
+      status = "Paused";
+      break;
+    case OS_MEDIA_CONTROLS_PLAYBACK_STOPPED:
+    case OS_MEDIA_CONTROLS_PLAYBACK_NONE:
+      status = "Stopped";
+      break;
+    case OS_MEDIA_CONTROLS_PLAYBACK_BUFFERING:
+      break;
+  }
+
+  if (!std::isfinite(position)) {
+    position = 0;
+  }
+
+  // Update rate
+  if (speed > 0 && std::isfinite(speed)) {
+    rate_ = speed;
+  }
+
+  // While an optimistic status is pending, only a matching state confirms it.
+  // A contradicting one was sent before the embedder handled the command (e.g.
+  // a periodic position update) and becomes the state to roll back to instead.
+  // Its position and rate are not in question and are published right away.
+  if (optimistic_timeout_id_ > 0) {
+    if (status != playback_status_) {
+      rollback_status_ = status;
+      rollback_position_ = position * 1000000;
+      rollback_anchor_time_ = Now();
+      status = playback_status_;
+    } else {
+      g_source_remove(optimistic_timeout_id_);
+      optimistic_timeout_id_ = 0;
+      optimistic_confirmed_++;
+    }
+  }
+
+  playback_status_ = status;
+
+  // Update position (convert seconds to microseconds)
+  SetPositionAnchor(position * 1000000);
+
+  UpdateMPRISProperties();
+}
+
+// Enable or disable the controls in the OsMediaControlsControl mask
+void MediaControlsCore::SetControlsEnabled(uint32_t controls, bool enabled) {
+  ScopedCallTimer timer(&api_calls_[kApiSetControlsEnabled]);
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kSetControlsEnabled, g_variant_new("(ub)", controls, enabled));
+  }
+
+  Activate();
+
+  if (controls & OS_MEDIA_CONTROLS_CONTROL_PLAY) {
+    can_play_ = enabled;
+  }
+  if (controls & OS_MEDIA_CONTROLS_CONTROL_PAUSE) {
+    can_pause_ = enabled;
+  }
+  if (controls & OS_MEDIA_CONTROLS_CONTROL_STOP) {
+    can_stop_ = enabled;
+  }
+  if (controls & OS_MEDIA_CONTROLS_CONTROL_NEXT) {
+    can_go_next_ = enabled;
+  }
+  if (controls & OS_MEDIA_CONTROLS_CONTROL_PREVIOUS) {
+    can_go_previous_ = enabled;
+  }
+  if (controls & OS_MEDIA_CONTROLS_CONTROL_SEEK) {
+    can_seek_ = enabled;
+  }
+
+  UpdateMPRISProperties();
+}
+
+// Set skip intervals
+void MediaControlsCore::SetSkipIntervals(int forward, int backward) {
+  ScopedCallTimer timer(&api_calls_[kApiSetSkipIntervals]);
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kSetSkipIntervals, g_variant_new("(ii)", forward, backward));
+  }
+
+  skip_forward_interval_ = forward;
+  skip_backward_interval_ = backward;
+
+  // Note: MPRIS doesn't have standard skip interval support
+  // This could be added as a custom extension if needed
+}
+
+// Configure event coalescing windows (milliseconds, 0 disables, negative keeps)
+void MediaControlsCore::SetEventCoalescing(int64_t window_ms, int64_t dedup_window_ms) {
+  ScopedCallTimer timer(&api_calls_[kApiSetEventCoalescing]);
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kSetEventCoalescing,
+              g_variant_new("(xx)", static_cast<gint64>(window_ms),
+                            static_cast<gint64>(dedup_window_ms)));
+  }
+
+  if (window_ms >= 0) {
+    coalesce_window_ms_ = static_cast<guint>(window_ms);
+  }
+  if (dedup_window_ms >= 0) {
+    dedup_window_ms_ = static_cast<guint>(dedup_window_ms);
+  }
+
+  // Deliver anything held under the old window before applying the new one
+  ResetCoalescing(true);
+}
+
+// Enable or disable optimistic PlaybackStatus updates
+void MediaControlsCore::SetOptimisticUpdates(bool enabled, guint timeout_ms) {
+  ScopedCallTimer timer(&api_calls_[kApiSetOptimisticUpdates]);
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kSetOptimisticUpdates, g_variant_new("(bu)", enabled, timeout_ms));
+  }
+
+  optimistic_updates_ = enabled;
+  if (timeout_ms > 0) {
+    optimistic_timeout_ms_ = timeout_ms;
+  }
+}
+
+// Replace the clock behind all time comparisons (nullptr for the real one)
+void MediaControlsCore::SetMonotonicClock(MonotonicClock clock, gpointer user_data) {
+  double position = CurrentPosition();
+  clock_ = clock;
+  clock_data_ = user_data;
+
+  // Re-express everything stamped with the old clock in the new one
+  SetPositionAnchor(position);
+  gint64 now = Now();
+  for (auto& entry : sender_buckets_) {
+    entry.second.last_refill_time = now;
+  }
+  has_last_transport_ = false;
+}
+
+gint64 MediaControlsCore::Now() {
+  return clock_ ? clock_(clock_data_) : g_get_monotonic_time();
+}
+
+// Position in microseconds, extrapolated from the anchor while playing
+double MediaControlsCore::CurrentPosition() {
+  if (playback_status_ != "Playing") {
+    return position_;
+  }
+  gint64 elapsed = Now() - position_anchor_time_;
+  return position_ + elapsed * rate_;
+}
+
+// Anchor the position (microseconds) at the current time
+void MediaControlsCore::SetPositionAnchor(double position) {
+  position_ = position;
+  position_anchor_time_ = Now();
+}
+
+// Switch PlaybackStatus ahead of the embedder, remembering the confirmed state
+void MediaControlsCore::ApplyOptimisticStatus(const char* status) {
+  if (playback_status_ == status) {
+    return;
+  }
+
+  // Only the state the embedder last confirmed is restored, however many
+  // optimistic toggles happen before the timeout
+  if (optimistic_timeout_id_ == 0) {
+    rollback_status_ = playback_status_;
+    rollback_position_ = position_;
+    rollback_anchor_time_ = position_anchor_time_;
+  } else {
+    g_source_remove(optimistic_timeout_id_);
+  }
+
+  SetPositionAnchor(CurrentPosition());
+  playback_status_ = status;
+  optimistic_applied_++;
+  optimistic_timeout_id_ = g_timeout_add(optimistic_timeout_ms_, HandleOptimisticTimeout, this);
+
+  UpdatePlaybackStatusProperty();
+}
+
+// The embedder did not confirm in time; restore the last confirmed state
+gboolean MediaControlsCore::HandleOptimisticTimeout(gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  self->optimistic_timeout_id_ = 0;
+  self->optimistic_rolled_back_++;
+
+  self->playback_status_ = self->rollback_status_;
+  self->position_ = self->rollback_position_;
+  self->position_anchor_time_ = self->rollback_anchor_time_;
+  self->UpdatePlaybackStatusProperty();
+
+  return G_SOURCE_REMOVE;
+}
+
+// Clear all media info
+void MediaControlsCore::Clear() {
+  ScopedCallTimer timer(&api_calls_[kApiClear]);
+
+  if (IsTracing()) {
+    TraceCall(TraceRecordType::kClear, g_variant_new("()"));
+  }
+
+  metadata_.clear();
+  track_id_ = kNoTrackId;
+  DiscardPendingArtwork();
+  artwork_data_.clear();
+  artwork_hash_.clear();
+  snapshot_artwork_changed_ = true;
+  restored_unconfirmed_ = false;
+
+  // Clean up artwork file using helper function
+  CleanupArtworkFile(artwork_path_);
+  artwork_path_.clear();
+
+  if (optimistic_timeout_id_ > 0) {
+    g_source_remove(optimistic_timeout_id_);
+    optimistic_timeout_id_ = 0;
+  }
+
+  playback_status_ = "Stopped";
+  SetPositionAnchor(0);
+  rate_ = 1.0;
+
+  UpdateMPRISProperties();
+  UpdateMetadataProperty();
+}
+
+// Assign the next sequence number and the time the call was handled
+void MediaControlsCore::StampEvent(OsMediaControlsEvent* event, guint64 received_ns) {
+  event->sequence = ++last_event_sequence_;
+  event->received_ns = static_cast<int64_t>(received_ns);
+}
+
+// Send an event to the embedder, coalescing bursts of value events and
+// dropping duplicate transport commands
+void MediaControlsCore::SendEvent(const OsMediaControlsEvent& stamped_event) {
+  // Events released later (rate-limited seeks and rates) are stamped now
+  OsMediaControlsEvent event = stamped_event;
+  if (event.sequence == 0) {
+    StampEvent(&event, ScopedCallTimer::NowNs());
+  }
+
+  if (event.type == OS_MEDIA_CONTROLS_EVENT_SEEK ||
+      event.type == OS_MEDIA_CONTROLS_EVENT_SET_SPEED) {
+    if (coalesce_window_ms_ == 0) {
+      DeliverEvent(event);
+      return;
+    }
+
+    auto it = coalesce_slots_.find(event.type);
+    if (it == coalesce_slots_.end()) {
+      it = coalesce_slots_.emplace(event.type, CoalesceSlot{this, event, false, 0}).first;
+    }
+    CoalesceSlot& slot = it->second;
+
+    // Leading edge: deliver right away and open a window for followers
+    if (slot.source_id == 0) {
+      DeliverEvent(event);
+      slot.source_id = g_timeout_add(coalesce_window_ms_, FlushCoalescedEvent, &slot);
+      return;
+    }
+
+    // Inside the window only the latest value survives
+    if (slot.has_pending) {
+      event_counters_[event.type].merged++;
+    }
+    slot.pending = event;
+    slot.has_pending = true;
+    return;
+  }
+
+  gint64 now = Now();
+  if (dedup_window_ms_ > 0 && has_last_transport_ && last_transport_type_ == event.type &&
+      now - last_transport_time_ < static_cast<gint64>(dedup_window_ms_) * 1000) {
+    event_counters_[event.type].dropped++;
+    return;
+  }
+
+  has_last_transport_ = true;
+  last_transport_type_ = event.type;
+  last_transport_time_ = now;
+
+  DeliverEvent(event);
+}
+
+// Trailing edge of a coalescing window
+gboolean MediaControlsCore::FlushCoalescedEvent(gpointer user_data) {
+  auto* slot = static_cast<CoalesceSlot*>(user_data);
+
+  if (!slot->has_pending) {
+    slot->source_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  // Keep the window open while the burst continues
+  slot->has_pending = false;
+  slot->owner->DeliverEvent(slot->pending);
+  return G_SOURCE_CONTINUE;
+}
+
+// Close all coalescing windows, delivering or discarding held events
+void MediaControlsCore::ResetCoalescing(bool deliver_pending) {
+  for (auto& entry : coalesce_slots_) {
+    CoalesceSlot& slot = entry.second;
+    if (slot.source_id > 0) {
+      g_source_remove(slot.source_id);
+      slot.source_id = 0;
+    }
+    if (slot.has_pending) {
+      slot.has_pending = false;
+      if (deliver_pending) {
+        DeliverEvent(slot.pending);
+      }
+    }
+  }
+}
+
+// Hand an event to the embedder's callback
+void MediaControlsCore::DeliverEvent(const OsMediaControlsEvent& event) {
+  event_counters_[event.type].delivered++;
+  if (event_callback_) {
+    event_callback_(event);
+  }
+}
+
+// Subscribe to low-memory warnings from the given monitor
+void MediaControlsCore::SetMemoryMonitor(GMemoryMonitor* monitor) {
+  if (memory_monitor_) {
+    if (low_memory_handler_id_ > 0) {
+      g_signal_handler_disconnect(memory_monitor_, low_memory_handler_id_);
+      low_memory_handler_id_ = 0;
+    }
+    g_object_unref(memory_monitor_);
+    memory_monitor_ = nullptr;
+  }
+
+  if (!monitor) {
+    return;
+  }
+
+  memory_monitor_ = G_MEMORY_MONITOR(g_object_ref(monitor));
+  low_memory_handler_id_ = g_signal_connect(
+      memory_monitor_, "low-memory-warning",
+      G_CALLBACK(HandleLowMemoryWarning), this);
+}
+
+void MediaControlsCore::HandleLowMemoryWarning(
+    GMemoryMonitor* monitor,
+    GMemoryMonitorWarningLevel level,
+    gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  self->ShedMemory(level);
+}
+
+// Release memory in tiers: each warning level also applies the tiers below it
+void MediaControlsCore::ShedMemory(GMemoryMonitorWarningLevel level) {
+  low_memory_warnings_++;
+
+  // Tier 1: the retained artwork bytes are never read back once written out
+  // and, with persistence on, stored in the snapshot
+  bool snapshot_needs_artwork = state_snapshot_ && snapshot_artwork_changed_;
+  if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_LOW && !artwork_pending_ &&
+      !snapshot_needs_artwork) {
+    std::vector<uint8_t>().swap(artwork_data_);
+  }
+
+  // Tier 2: artwork files live in XDG_RUNTIME_DIR, which is usually tmpfs,
+  // and memfds are backed by shared memory
+  if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM) {
+    EvictStaleArtworkFiles();
+  }
+
+  // Tier 3: forget idle D-Bus senders and hand freed heap back to the kernel
+  if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL) {
+    PruneSenderBuckets(Now());
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+  }
+}
+
+// Start recording a trace (see trace.h)
+bool MediaControlsCore::StartTrace(const std::string& path) {
+  auto trace = std::make_unique<TraceWriter>();
+  if (!trace->Open(path)) {
+    return false;
+  }
+  trace_ = std::move(trace);
+  trace_has_artwork_ = false;
+  return true;
+}
+
+void MediaControlsCore::StopTrace() {
+  trace_.reset();
+}
+
+void MediaControlsCore::TraceCall(TraceRecordType type, GVariant* payload) {
+  trace_->Write(type, Now(), payload);
+  if (!trace_->IsOpen()) {
+    trace_.reset();
+  }
+}
+
+// Strings are recorded as bytestrings since they are not validated yet.
+// Artwork is usually resent unchanged with every metadata update; only a
+// flag is recorded then. artwork_data_ holds the last recorded bytes once
+// any were recorded, since only SetMetadata fills it.
+void MediaControlsCore::TraceSetMetadata(const OsMediaControlsMetadata& metadata) {
+  static const uint8_t kNoArtwork = 0;
+
+  bool has_artwork = metadata.artwork && metadata.artwork_length > 0;
+  bool artwork_unchanged =
+      has_artwork && trace_has_artwork_ && artwork_data_.size() == metadata.artwork_length &&
+      std::equal(metadata.artwork, metadata.artwork + metadata.artwork_length,
+                 artwork_data_.begin());
+  bool record_artwork = has_artwork && !artwork_unchanged;
+  GVariant* artwork = g_variant_new_fixed_array(
+      G_VARIANT_TYPE_BYTE, record_artwork ? metadata.artwork : &kNoArtwork,
+      record_artwork ? metadata.artwork_length : 0, sizeof(uint8_t));
+  if (has_artwork) {
+    trace_has_artwork_ = true;
+  }
+
+  TraceCall(TraceRecordType::kSetMetadata,
+            g_variant_new("(^ay^ay^ay^ayd^ay^ay@ayb)", metadata.title ? metadata.title : "",
+                          metadata.artist ? metadata.artist : "",
+                          metadata.album ? metadata.album : "",
+                          metadata.album_artist ? metadata.album_artist : "",
+                          metadata.duration, metadata.track_id ? metadata.track_id : "",
+                          metadata.artwork_url ? metadata.artwork_url : "", artwork,
+                          artwork_unchanged));
+}
+
+// Collect runtime statistics
+MediaControlsCore::Stats MediaControlsCore::GetStats() {
+  Stats stats = {};
+
+  stats.rate_limit_dropped = evicted_dropped_;
+  stats.rate_limit_merged = evicted_merged_;
+  for (const auto& entry : sender_buckets_) {
+    const SenderBucket& bucket = entry.second;
+    stats.rate_limit_dropped += bucket.dropped;
+    stats.rate_limit_merged += bucket.merged;
+    stats.sender_bucket_bytes += sizeof(entry) + entry.first.capacity();
+    if (bucket.dropped > 0 || bucket.merged > 0) {
+      stats.senders[entry.first] = SenderStats{bucket.dropped, bucket.merged};
+    }
+  }
+
+  stats.artwork_data_bytes = artwork_data_.capacity();
+  stats.artwork_file_bytes = GetArtworkFileBytes(&stats.artwork_files);
+  stats.low_memory_warnings = low_memory_warnings_;
+  stats.events = event_counters_;
+  stats.track_id = track_id_;
+  stats.stale_set_position = stale_set_position_;
+  stats.optimistic_applied = optimistic_applied_;
+  stats.optimistic_confirmed = optimistic_confirmed_;
+  stats.optimistic_rolled_back = optimistic_rolled_back_;
+  stats.artwork_writes = artwork_writes_;
+  stats.artwork_writes_avoided = artwork_writes_avoided_;
+  stats.artwork_dedup_hits = artwork_dedup_hits_;
+  stats.artwork_bytes_written = artwork_bytes_written_;
+  stats.artwork_pending = artwork_pending_;
+
+  // Approximate: string and vector capacities plus map node payloads
+  stats.resident_bytes = stats.artwork_data_bytes + stats.sender_bucket_bytes +
+                         artwork_path_.capacity() + track_id_.capacity() +
+                         playback_status_.capacity() + artwork_dir_.capacity() +
+                         artwork_memfds_.capacity() * sizeof(int);
+  for (const auto& entry : metadata_) {
+    stats.resident_bytes += sizeof(entry) + entry.first.capacity() + entry.second.capacity();
+  }
+
+  stats.signals_emitted = signals_emitted_;
+  stats.signal_bytes = signal_bytes_;
+  for (size_t i = 0; i < kApiCallCount; i++) {
+    if (api_calls_[i].calls > 0) {
+      stats.api_calls[kApiCallNames[i]] = api_calls_[i];
+    }
+  }
+  for (size_t i = 0; i < kDBusCallCount; i++) {
+    if (dbus_calls_[i].calls > 0) {
+      stats.dbus_calls[kDBusCallNames[i]] = dbus_calls_[i];
+    }
+  }
+
+  if (stall_detector_) {
+    stall_detector_->GetStats(&stats.stalls);
+  }
+  stats.bus_to_native = bus_to_native_;
+
+  stats.snapshot.enabled = state_snapshot_ != nullptr;
+  stats.snapshot.restored = state_restored_;
+  stats.snapshot.unconfirmed = restored_unconfirmed_;
+  if (state_snapshot_) {
+    StateSnapshot::Stats snapshot = state_snapshot_->GetStats();
+    stats.snapshot.writes = snapshot.writes;
+    stats.snapshot.write_failures = snapshot.write_failures;
+    stats.snapshot.bytes_written = snapshot.bytes_written;
+  }
+  GetLogStats(&stats.log);
+
+  stats.startup.construct_ns = construct_ns_;
+  stats.startup.activated = activated_;
+  stats.startup.ready = mpris_initialized_;
+  stats.startup.bus_ready_ns = bus_ready_ns_;
+
+  stats.bus.disconnects = bus_disconnects_;
+  stats.bus.reconnects = bus_reconnects_;
+  stats.bus.failed_attempts = bus_failed_attempts_;
+  stats.bus.recovery = bus_recovery_;
+
+  return stats;
+}
+
+// Runs on the GDBus worker thread for every message
+GDBusMessage* MediaControlsCore::StampMessageArrival(GDBusConnection* connection,
+                                                     GDBusMessage* message,
+                                                     gboolean incoming,
+                                                     gpointer user_data) {
+  if (incoming && g_dbus_message_get_message_type(message) == G_DBUS_MESSAGE_TYPE_METHOD_CALL) {
+    g_object_set_qdata(G_OBJECT(message), ArrivalQuark(),
+                       GSIZE_TO_POINTER(ScopedCallTimer::NowNs()));
+  }
+  return message;
+}
+
+MediaControlsCore::DBusCall MediaControlsCore::DBusCallForMethod(const gchar* method_name) {
+  for (int i = kDBusPlay; i < kDBusOtherMethod; i++) {
+    if (g_strcmp0(method_name, kDBusCallNames[i]) == 0) {
+      return static_cast<DBusCall>(i);
+    }
+  }
+  return kDBusOtherMethod;
+}
+
+// {calls, totalNs, maxNs, p50Ns, p99Ns, histogram}; the histogram is trimmed
+// after the last non-empty bucket
+static GVariant* CallStatsToVariant(const CallStats& call) {
+  const LatencyHistogram& latency = call.latency;
+  size_t used = LatencyHistogram::kBuckets;
+  while (used > 0 && latency.buckets[used - 1] == 0) {
+    used--;
+  }
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&builder, "{sv}", "calls", g_variant_new_uint64(call.calls));
+  g_variant_builder_add(&builder, "{sv}", "totalNs", g_variant_new_uint64(latency.total_ns));
+  g_variant_builder_add(&builder, "{sv}", "maxNs", g_variant_new_uint64(latency.max_ns));
+  g_variant_builder_add(&builder, "{sv}", "p50Ns",
+                        g_variant_new_uint64(latency.Quantile(0.50)));
+  g_variant_builder_add(&builder, "{sv}", "p99Ns",
+                        g_variant_new_uint64(latency.Quantile(0.99)));
+  g_variant_builder_add(&builder, "{sv}", "histogram",
+                        g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, latency.buckets, used,
+                                                  sizeof(guint64)));
+  return g_variant_builder_end(&builder);
+}
+
+static GVariant* CallStatsMapToVariant(const std::map<std::string, CallStats>& calls) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  for (const auto& entry : calls) {
+    g_variant_builder_add(&builder, "{sv}", entry.first.c_str(),
+                          CallStatsToVariant(entry.second));
+  }
+  return g_variant_builder_end(&builder);
+}
+
+// GetStats() as a{sv} for the debug interface, mirroring the getStats keys
+static GVariant* StatsToVariant(const MediaControlsCore::Stats& stats) {
+  GVariantBuilder events;
+  g_variant_builder_init(&events, G_VARIANT_TYPE("a{sv}"));
+  for (const auto& entry : stats.events) {
+    g_variant_builder_add(
+        &events, "{sv}", os_media_controls_event_type_name(entry.first),
+        g_variant_new_parsed("{'delivered': <%t>, 'merged': <%t>, 'dropped': <%t>}",
+                             entry.second.delivered, entry.second.merged,
+                             entry.second.dropped));
+  }
+
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&builder, "{sv}", "apiCalls", CallStatsMapToVariant(stats.api_calls));
+  g_variant_builder_add(&builder, "{sv}", "dbusCalls",
+                        CallStatsMapToVariant(stats.dbus_calls));
+  g_variant_builder_add(&builder, "{sv}", "busToNative",
+                        CallStatsToVariant(CallStats{stats.bus_to_native.count,
+                                                     stats.bus_to_native}));
+  g_variant_builder_add(&builder, "{sv}", "signals",
+                        g_variant_new_parsed("{'emitted': <%t>, 'bytes': <%t>}",
+                                             stats.signals_emitted, stats.signal_bytes));
+  g_variant_builder_add(&builder, "{sv}", "events", g_variant_builder_end(&events));
+  std::vector<const char*> waiting;
+  for (const std::string& member : stats.stalls.last_waiting) {
+    waiting.push_back(member.c_str());
+  }
+  waiting.push_back(nullptr);
+  g_variant_builder_add(
+      &builder, "{sv}", "stalls",
+      g_variant_new_parsed("{'thresholdMs': <%u>, 'count': <%t>, 'duration': <%v>, "
+                           "'callsWaiting': <%t>, 'maxCallsWaiting': <%t>, "
+                           "'maxCallWaitNs': <%t>, 'lastWaiting': <%^as>}",
+                           stats.stalls.threshold_ms, stats.stalls.stalls,
+                           CallStatsToVariant(CallStats{stats.stalls.stalls,
+                                                        stats.stalls.duration}),
+                           stats.stalls.calls_waiting, stats.stalls.max_calls_waiting,
+                           stats.stalls.max_call_wait_ns,
+                           waiting.data()));
+  g_variant_builder_add(&builder, "{sv}", "rateLimit",
+                        g_variant_new_parsed("{'dropped': <%t>, 'merged': <%t>}",
+                                             stats.rate_limit_dropped, stats.rate_limit_merged));
+  g_variant_builder_add(
+      &builder, "{sv}", "memory",
+      g_variant_new_parsed("{'residentBytes': <%t>, 'artworkDataBytes': <%t>, "
+                           "'artworkFileBytes': <%t>, 'artworkFiles': <%u>, "
+                           "'senderBucketBytes': <%t>, 'lowMemoryWarnings': <%t>}",
+                           stats.resident_bytes, stats.artwork_data_bytes,
+                           stats.artwork_file_bytes, stats.artwork_files,
+                           stats.sender_bucket_bytes, stats.low_memory_warnings));
+  g_variant_builder_add(
+      &builder, "{sv}", "artwork",
+      g_variant_new_parsed("{'writes': <%t>, 'writesAvoided': <%t>, 'dedupHits': <%t>, "
+                           "'bytesWritten': <%t>, 'pending': <%b>}",
+                           stats.artwork_writes, stats.artwork_writes_avoided,
+                           stats.artwork_dedup_hits, stats.artwork_bytes_written,
+                           stats.artwork_pending));
+  g_variant_builder_add(&builder, "{sv}", "track",
+                        g_variant_new_parsed("{'id': <%s>, 'staleSetPosition': <%t>}",
+                                             stats.track_id.c_str(), stats.stale_set_position));
+  g_variant_builder_add(
+      &builder, "{sv}", "optimistic",
+      g_variant_new_parsed("{'applied': <%t>, 'confirmed': <%t>, 'rolledBack': <%t>}",
+                           stats.optimistic_applied, stats.optimistic_confirmed,
+                           stats.optimistic_rolled_back));
+  g_variant_builder_add(
+      &builder, "{sv}", "snapshot",
+      g_variant_new_parsed("{'enabled': <%b>, 'restored': <%b>, 'unconfirmed': <%b>, "
+                           "'writes': <%t>, 'writeFailures': <%t>, 'bytesWritten': <%t>}",
+                           stats.snapshot.enabled, stats.snapshot.restored,
+                           stats.snapshot.unconfirmed, stats.snapshot.writes,
+                           stats.snapshot.write_failures, stats.snapshot.bytes_written));
+  GVariantBuilder log_categories;
+  g_variant_builder_init(&log_categories, G_VARIANT_TYPE("a{st}"));
+  for (const auto& entry : stats.log.suppressed_by_category) {
+    g_variant_builder_add(&log_categories, "{st}", entry.first.c_str(), entry.second);
+  }
+  g_variant_builder_add(
+      &builder, "{sv}", "log",
+      g_variant_new_parsed("{'emitted': <%t>, 'suppressed': <%t>, 'suppressedByCategory': <%v>}",
+                           stats.log.emitted, stats.log.suppressed,
+                           g_variant_builder_end(&log_categories)));
+  g_variant_builder_add(
+      &builder, "{sv}", "startup",
+      g_variant_new_parsed("{'constructNs': <%t>, 'activated': <%b>, 'ready': <%b>, "
+                           "'busReadyNs': <%t>}",
+                           stats.startup.construct_ns, stats.startup.activated,
+                           stats.startup.ready, stats.startup.bus_ready_ns));
+  g_variant_builder_add(
+      &builder, "{sv}", "bus",
+      g_variant_new_parsed("{'disconnects': <%t>, 'reconnects': <%t>, 'failedAttempts': <%t>, "
+                           "'recovery': <%v>}",
+                           stats.bus.disconnects, stats.bus.reconnects,
+                           stats.bus.failed_attempts,
+                           CallStatsToVariant(CallStats{stats.bus.reconnects,
+                                                        stats.bus.recovery})));
+  return g_variant_builder_end(&builder);
+}
+
+// Start, restart or stop the main loop watchdog
+void MediaControlsCore::SetStallDetection(guint threshold_ms) {
+  stall_detector_.reset();
+  if (threshold_ms > 0) {
+    stall_detector_ = std::make_unique<StallDetector>(connection_, threshold_ms);
+  }
+}
+
+// Enable or disable the persisted state snapshot
+void MediaControlsCore::SetStatePersistence(bool enabled) {
+  if (enabled == (state_snapshot_ != nullptr)) {
+    return;
+  }
+
+  std::string directory = StateSnapshot::DefaultDirectory();
+  if (!enabled) {
+    state_snapshot_.reset();
+    StateSnapshot::Remove(directory);
+    return;
+  }
+
+  // Store whatever is published right now, including current artwork
+  snapshot_artwork_changed_ = true;
+  state_snapshot_ = std::make_unique<StateSnapshot>(
+      directory, "", [this](PlayerSnapshot* snapshot) { CaptureStateSnapshot(snapshot); });
+  state_snapshot_->MarkDirty();
+}
+
+void MediaControlsCore::ConfirmRestoredState() {
+  restored_unconfirmed_ = false;
+}
+
+// Publish the snapshot left by the previous run, if persistence was enabled
+void MediaControlsCore::RestoreStateSnapshot() {
+  std::string directory = StateSnapshot::DefaultDirectory();
+  if (!StateSnapshot::Exists(directory)) {
+    return;
+  }
+
+  PlayerSnapshot snapshot = {};
+  if (StateSnapshot::Load(directory, &snapshot) && !snapshot.metadata.empty()) {
+    ApplyStateSnapshot(snapshot);
+  }
+
+  state_snapshot_ = std::make_unique<StateSnapshot>(
+      directory, snapshot.artwork_key,
+      [this](PlayerSnapshot* captured) { CaptureStateSnapshot(captured); });
+}
+
+// Apply a loaded snapshot as the current state; nothing is emitted since the
+// objects are not exported yet
+void MediaControlsCore::ApplyStateSnapshot(const PlayerSnapshot& snapshot) {
+  metadata_ = snapshot.metadata;
+  track_id_ = g_variant_is_object_path(snapshot.track_id.c_str()) ? snapshot.track_id
+                                                                   : kNoTrackId;
+  artwork_path_ = snapshot.art_url;
+
+  // Nothing is playing until the app says so
+  playback_status_ = snapshot.playback_status == "Stopped" ? "Stopped" : "Paused";
+  if (snapshot.rate > 0 && std::isfinite(snapshot.rate)) {
+    rate_ = snapshot.rate;
+  }
+  SetPositionAnchor(snapshot.position > 0 && std::isfinite(snapshot.position)
+                        ? snapshot.position
+                        : 0);
+
+  can_play_ = snapshot.controls & OS_MEDIA_CONTROLS_CONTROL_PLAY;
+  can_pause_ = snapshot.controls & OS_MEDIA_CONTROLS_CONTROL_PAUSE;
+  can_stop_ = snapshot.controls & OS_MEDIA_CONTROLS_CONTROL_STOP;
+  can_go_next_ = snapshot.controls & OS_MEDIA_CONTROLS_CONTROL_NEXT;
+  can_go_previous_ = snapshot.controls & OS_MEDIA_CONTROLS_CONTROL_PREVIOUS;
+  can_seek_ = snapshot.controls & OS_MEDIA_CONTROLS_CONTROL_SEEK;
+
+  state_restored_ = true;
+  restored_unconfirmed_ = true;
+  PublishStateFile();
+}
+
+// Copy the published state for the snapshot writer
+void MediaControlsCore::CaptureStateSnapshot(PlayerSnapshot* snapshot) {
+  snapshot->playback_status = playback_status_;
+  snapshot->position = CurrentPosition();
+  snapshot->rate = rate_;
+  snapshot->metadata = metadata_;
+  snapshot->track_id = track_id_;
+
+  // Binary artwork is stored by content; its URL here is process-specific.
+  // artwork_hash_ rather than artwork_data_ tells, as the bytes may be shed.
+  snapshot->art_url = artwork_hash_.empty() ? artwork_path_ : "";
+  snapshot->artwork_changed = snapshot_artwork_changed_;
+  if (snapshot_artwork_changed_) {
+    snapshot->artwork = artwork_data_;
+    snapshot_artwork_changed_ = false;
+  }
+
+  snapshot->controls = (can_play_ ? OS_MEDIA_CONTROLS_CONTROL_PLAY : 0) |
+                       (can_pause_ ? OS_MEDIA_CONTROLS_CONTROL_PAUSE : 0) |
+                       (can_stop_ ? OS_MEDIA_CONTROLS_CONTROL_STOP : 0) |
+                       (can_go_next_ ? OS_MEDIA_CONTROLS_CONTROL_NEXT : 0) |
+                       (can_go_previous_ ? OS_MEDIA_CONTROLS_CONTROL_PREVIOUS : 0) |
+                       (can_seek_ ? OS_MEDIA_CONTROLS_CONTROL_SEEK : 0);
+}
+
+// Enable or disable the debug statistics interface
+void MediaControlsCore::SetDebugInterfaceEnabled(bool enabled) {
+  debug_interface_enabled_ = enabled;
+  if (!enabled) {
+    UnregisterDebugInterface();
+  } else if (mpris_initialized_) {
+    RegisterDebugInterface();
+  }
+}
+
+void MediaControlsCore::RegisterDebugInterface() {
+  if (debug_registration_id_ > 0 || !connection_) {
+    return;
+  }
+
+  GError* error = nullptr;
+  if (!debug_introspection_data_) {
+    debug_introspection_data_ = g_dbus_node_info_new_for_xml(debug_introspection_xml, &error);
+    if (error) {
+      OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Failed to parse debug introspection XML: %s",
+                                error->message);
+      g_error_free(error);
+      return;
+    }
+  }
+
+  static const GDBusInterfaceVTable debug_vtable = {
+    HandleDebugMethodCall,
+    nullptr,
+    nullptr
+  };
+  debug_registration_id_ = g_dbus_connection_register_object(
+      connection_, kDebugObjectPath, debug_introspection_data_->interfaces[0], &debug_vtable,
+      this, nullptr, &error);
+  if (error) {
+    OS_MEDIA_CONTROLS_WARNING(kLifecycle, nullptr, "Failed to register debug interface: %s",
+                              error->message);
+    g_error_free(error);
+    debug_registration_id_ = 0;
+  }
+}
+
+void MediaControlsCore::UnregisterDebugInterface() {
+  if (debug_registration_id_ > 0 && connection_) {
+    g_dbus_connection_unregister_object(connection_, debug_registration_id_);
+  }
+  debug_registration_id_ = 0;
+  if (debug_introspection_data_) {
+    g_dbus_node_info_unref(debug_introspection_data_);
+    debug_introspection_data_ = nullptr;
+  }
+}
+
+void MediaControlsCore::HandleDebugMethodCall(
+    GDBusConnection* connection,
+    const gchar* sender,
+    const gchar* object_path,
+    const gchar* interface_name,
+    const gchar* method_name,
+    GVariant* parameters,
+    GDBusMethodInvocation* invocation,
+    gpointer user_data) {
+  auto* self = static_cast<MediaControlsCore*>(user_data);
+  if (g_strcmp0(method_name, "GetStats") != 0) {
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_UNKNOWN_METHOD,
+                                          "Unknown method");
+    return;
+  }
+
+  g_dbus_method_invocation_return_value(
+      invocation, g_variant_new("(@a{sv})", StatsToVariant(self->GetStats())));
+}
+
+}  // namespace os_media_controls
+
+struct _OsMediaControlsCore {
+  os_media_controls::MediaControlsCore core;
+};
+
+OsMediaControlsCore* os_media_controls_core_new(void) {
+  return new OsMediaControlsCore();
+}
+
+void os_media_controls_core_free(OsMediaControlsCore* core) {
+  delete core;
+}
+
+void os_media_controls_core_activate(OsMediaControlsCore* core) {
+  g_return_if_fail(core != nullptr);
+  core->core.Activate();
+}
+
+void os_media_controls_core_set_event_callback(OsMediaControlsCore* core,
+                                               OsMediaControlsEventCallback callback,
+                                               void* user_data) {
+  g_return_if_fail(core != nullptr);
+
+  if (!callback) {
+    core->core.SetEventCallback(nullptr);
+    return;
+  }
+  core->core.SetEventCallback([callback, user_data](const OsMediaControlsEvent& event) {
+    callback(&event, user_data);
+  });
+}
+
+void os_media_controls_core_set_metadata(OsMediaControlsCore* core,
+                                         const OsMediaControlsMetadata* metadata) {
+  g_return_if_fail(core != nullptr && metadata != nullptr);
+  core->core.SetMetadata(*metadata);
+}
+
+void os_media_controls_core_set_playback_state(OsMediaControlsCore* core,
+                                               OsMediaControlsPlaybackState state,
+                                               double position,
+                                               double speed) {
+  g_return_if_fail(core != nullptr);
+  core->core.SetPlaybackState(state, position, speed);
+}
+
+void os_media_controls_core_set_controls_enabled(OsMediaControlsCore* core,
+                                                 uint32_t controls,
+                                                 bool enabled) {
+  g_return_if_fail(core != nullptr);
+  core->core.SetControlsEnabled(controls, enabled);
+}
+
+void os_media_controls_core_clear(OsMediaControlsCore* core) {
+  g_return_if_fail(core != nullptr);
+  core->core.Clear();
+}
+
+void os_media_controls_core_set_event_coalescing(OsMediaControlsCore* core,
+                                                 int64_t window_ms,
+                                                 int64_t dedup_window_ms) {
+  g_return_if_fail(core != nullptr);
+  core->core.SetEventCoalescing(window_ms, dedup_window_ms);
+}
+
+void os_media_controls_core_set_optimistic_updates(OsMediaControlsCore* core,
+                                                   bool enabled,
+                                                   uint32_t timeout_ms) {
+  g_return_if_fail(core != nullptr);
+  core->core.SetOptimisticUpdates(enabled, timeout_ms);
+}
+
+void os_media_controls_core_get_stats(OsMediaControlsCore* core,
+                                      OsMediaControlsCoreStats* stats) {
+  g_return_if_fail(core != nullptr && stats != nullptr);
+
+  os_media_controls::MediaControlsCore::Stats full = core->core.GetStats();
+  *stats = OsMediaControlsCoreStats{};
+  stats->rate_limit_dropped = full.rate_limit_dropped;
+  stats->rate_limit_merged = full.rate_limit_merged;
+  for (const auto& entry : full.events) {
+    stats->events_delivered += entry.second.delivered;
+    stats->events_merged += entry.second.merged;
+    stats->events_dropped += entry.second.dropped;
+  }
+  stats->stale_set_position = full.stale_set_position;
+  stats->optimistic_applied = full.optimistic_applied;
+  stats->optimistic_confirmed = full.optimistic_confirmed;
+  stats->optimistic_rolled_back = full.optimistic_rolled_back;
+  stats->artwork_writes = full.artwork_writes;
+  stats->artwork_writes_avoided = full.artwork_writes_avoided;
+  stats->artwork_dedup_hits = full.artwork_dedup_hits;
+  stats->low_memory_warnings = full.low_memory_warnings;
+  stats->artwork_bytes_written = full.artwork_bytes_written;
+  stats->resident_bytes = full.resident_bytes;
+  stats->signals_emitted = full.signals_emitted;
+  stats->signal_bytes = full.signal_bytes;
+  stats->stalls = full.stalls.stalls;
+  stats->stall_max_ns = full.stalls.duration.max_ns;
+  stats->stall_calls_waiting = full.stalls.calls_waiting;
+  stats->snapshot_writes = full.snapshot.writes;
+  stats->restored_unconfirmed = full.snapshot.unconfirmed ? 1 : 0;
+  stats->log_suppressed = full.log.suppressed;
+  stats->construct_ns = full.startup.construct_ns;
+  stats->bus_ready_ns = full.startup.bus_ready_ns;
+  stats->bus_disconnects = full.bus.disconnects;
+  stats->bus_reconnects = full.bus.reconnects;
+  stats->bus_recovery_max_ns = full.bus.recovery.max_ns;
+}
+
+void os_media_controls_core_set_stall_detection(OsMediaControlsCore* core,
+                                                uint32_t threshold_ms) {
+  g_return_if_fail(core != nullptr);
+  core->core.SetStallDetection(threshold_ms);
+}
+
+void os_media_controls_core_set_state_persistence(OsMediaControlsCore* core, bool enabled) {
+  g_return_if_fail(core != nullptr);
+  core->core.SetStatePersistence(enabled);
+}
+
+void os_media_controls_core_confirm_restored_state(OsMediaControlsCore* core) {
+  g_return_if_fail(core != nullptr);
+  core->core.ConfirmRestoredState();
+}
+
+bool os_media_controls_core_start_trace(OsMediaControlsCore* core, const char* path) {
+  g_return_val_if_fail(core != nullptr && path != nullptr, false);
+  return core->core.StartTrace(path);
+}
+
+void os_media_controls_core_stop_trace(OsMediaControlsCore* core) {
+  g_return_if_fail(core != nullptr);
+  core->core.StopTrace();
+}
+
+const char* os_media_controls_event_type_name(OsMediaControlsEventType type) {
+  switch (type) {
+    case OS_MEDIA_CONTROLS_EVENT_PLAY:
+      return "play";
+    case OS_MEDIA_CONTROLS_EVENT_PAUSE:
+      return "pause";
+    case OS_MEDIA_CONTROLS_EVENT_STOP:
+      return "stop";
+    case OS_MEDIA_CONTROLS_EVENT_NEXT:
+      return "next";
+    case OS_MEDIA_CONTROLS_EVENT_PREVIOUS:
+      return "previous";
+    case OS_MEDIA_CONTROLS_EVENT_SEEK:
+      return "seek";
+    case OS_MEDIA_CONTROLS_EVENT_SET_SPEED:
+      return "setSpeed";
+  }
+  return "unknown";
+}
@@ -1,17 +1,13 @@
 #include "os_media_controls/os_media_controls_plugin.h"
+#include "log.h"
+#include "probes.h"
 
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
-#include <sys/utsname.h>
-#include <gio/gio.h>
 
-#include <cstring>
+#include <algorithm>
 #include <cmath>
-#include <memory>
-#include <sstream>
-#include <fstream>
-#include <iomanip>
-#include <chrono>
+#include <cstring>
 
 #define OS_MEDIA_CONTROLS_PLUGIN(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST((obj), os_media_controls_plugin_get_type(), \
@@ -27,57 +23,50 @@ struct _OsMediaControlsPlugin {
 
 G_DEFINE_TYPE(OsMediaControlsPlugin, os_media_controls_plugin, g_object_get_type())
 
-// MPRIS D-Bus introspection XML
-static const gchar introspection_xml[] =
-  "<node>"
-  "  <interface name='org.mpris.MediaPlayer2'>"
-  "    <method name='Raise'/>"
-  "    <method name='Quit'/>"
-  "    <property name='CanQuit' type='b' access='read'/>"
-  "    <property name='CanRaise' type='b' access='read'/>"
-  "    <property name='HasTrackList' type='b' access='read'/>"
-  "    <property name='Identity' type='s' access='read'/>"
-  "    <property name='SupportedUriSchemes' type='as' access='read'/>"
-  "    <property name='SupportedMimeTypes' type='as' access='read'/>"
-  "  </interface>"
-  "  <interface name='org.mpris.MediaPlayer2.Player'>"
-  "    <method name='Next'/>"
-  "    <method name='Previous'/>"
-  "    <method name='Pause'/>"
-  "    <method name='PlayPause'/>"
-  "    <method name='Stop'/>"
-  "    <method name='Play'/>"
-  "    <method name='Seek'>"
-  "      <arg direction='in' name='Offset' type='x'/>"
-  "    </method>"
-  "    <method name='SetPosition'>"
-  "      <arg direction='in' name='TrackId' type='o'/>"
-  "      <arg direction='in' name='Position' type='x'/>"
-  "    </method>"
-  "    <method name='OpenUri'>"
-  "      <arg direction='in' name='Uri' type='s'/>"
-  "    </method>"
-  "    <signal name='Seeked'>"
-  "      <arg name='Position' type='x'/>"
-  "    </signal>"
-  "    <property name='PlaybackStatus' type='s' access='read'/>"
-  "    <property name='Rate' type='d' access='readwrite'/>"
-  "    <property name='Metadata' type='a{sv}' access='read'/>"
-  "    <property name='Volume' type='d' access='readwrite'/>"
-  "    <property name='Position' type='x' access='read'/>"
-  "    <property name='MinimumRate' type='d' access='read'/>"
-  "    <property name='MaximumRate' type='d' access='read'/>"
-  "    <property name='CanGoNext' type='b' access='read'/>"
-  "    <property name='CanGoPrevious' type='b' access='read'/>"
-  "    <property name='CanPlay' type='b' access='read'/>"
-  "    <property name='CanPause' type='b' access='read'/>"
-  "    <property name='CanSeek' type='b' access='read'/>"
-  "    <property name='CanControl' type='b' access='read'/>"
-  "  </interface>"
-  "</node>";
+// Events that arrive while Dart is not listening are buffered and replayed
+// when it starts listening, unless they are older than kPendingEventMaxAgeMs
+static constexpr size_t kPendingEventCapacity = 32;
+static constexpr gint64 kPendingEventMaxAgeMs = 10000;
+
+// Upper bound on events held in one batch before it is flushed early
+static constexpr size_t kMaxEventBatchSize = 64;
+
+// Method channel calls counted in getStats, followed by the bucket for
+// unknown methods
+static const char* const kMethodNames[] = {
+    "setMetadata", "setPlaybackState", "enableControls", "disableControls",
+    "setSkipIntervals", "setQueueInfo", "clear", "setEventCoalescing",
+    "setEventBatching", "setOptimisticUpdates", "acknowledgeEvent", "setStatePersistence",
+    "confirmRestoredState", "getStats", "other",
+};
 
 namespace os_media_controls {
 
+// Type string of an event map, or nullptr
+static const char* GetEventType(FlValue* event) {
+  FlValue* type = fl_value_lookup_string(event, "type");
+  if (type && fl_value_get_type(type) == FL_VALUE_TYPE_STRING) {
+    return fl_value_get_string(type);
+  }
+  return nullptr;
+}
+
+// Events of the same retention group supersede each other while buffered, so
+// only the latest seek, speed or play/pause state is replayed. Returns
+// nullptr for events that are all kept (next, previous, stop).
+static const char* GetEventRetentionGroup(const char* type) {
+  if (!type) {
+    return nullptr;
+  }
+  if (strcmp(type, "seek") == 0 || strcmp(type, "setSpeed") == 0) {
+    return type;
+  }
+  if (strcmp(type, "play") == 0 || strcmp(type, "pause") == 0) {
+    return "playback";
+  }
+  return nullptr;
+}
+
 // Helper to convert FlValue to string
 std::string OsMediaControlsPluginImpl::GetStringFromFlValue(FlValue* map, const char* key) {
   if (!map || !key || fl_value_get_type(map) != FL_VALUE_TYPE_MAP) {
@@ -120,719 +109,81 @@ int64_t OsMediaControlsPluginImpl::GetInt64FromFlValue(FlValue* map, const char*
   return 0;
 }
 
-// Helper to get bytes from FlValue
-std::vector<uint8_t> OsMediaControlsPluginImpl::GetBytesFromFlValue(FlValue* map, const char* key) {
+// Helper to convert FlValue to bool
+bool OsMediaControlsPluginImpl::GetBoolFromFlValue(FlValue* map, const char* key) {
   if (!map || !key || fl_value_get_type(map) != FL_VALUE_TYPE_MAP) {
-    return {};
+    return false;
   }
   FlValue* value = fl_value_lookup_string(map, key);
-  if (value && fl_value_get_type(value) == FL_VALUE_TYPE_UINT8_LIST) {
-    const uint8_t* data = fl_value_get_uint8_list(value);
-    size_t length = fl_value_get_length(value);
-    if (data && length > 0) {
-      return std::vector<uint8_t>(data, data + length);
-    }
-  }
-  return {};
-}
-
-// Helper to safely create GVariant string with UTF-8 validation
-// GLib's g_variant_new_string() aborts the program if the input is not valid UTF-8.
-// This wrapper validates the string first and returns an empty string on failure.
-GVariant* OsMediaControlsPluginImpl::SafeVariantNewString(const std::string& str) {
-  if (str.empty()) {
-    return g_variant_new_string("");
-  }
-
-  // Validate UTF-8
-  if (!g_utf8_validate(str.c_str(), -1, nullptr)) {
-    g_warning("Invalid UTF-8 string detected, using empty string instead");
-    return g_variant_new_string("");
-  }
-
-  return g_variant_new_string(str.c_str());
-}
-
-// Create artwork directory
-void OsMediaControlsPluginImpl::CreateArtworkDirectory() {
-  // Use XDG_RUNTIME_DIR for RAM-based temporary storage (auto-cleanup on logout)
-  const char* runtime_dir = g_get_user_runtime_dir();
-  if (!runtime_dir) {
-    // Fallback to /tmp if XDG_RUNTIME_DIR is not available
-    runtime_dir = g_get_tmp_dir();
-  }
-
-  std::stringstream ss;
-  ss << runtime_dir << "/os_media_controls_artwork";
-  artwork_dir_ = ss.str();
-
-  // Create directory if it doesn't exist
-  g_mkdir_with_parents(artwork_dir_.c_str(), 0700);
-}
-
-// Save artwork to file with unique timestamp-based name and return file:// URI
-std::string OsMediaControlsPluginImpl::SaveArtworkToFile(const std::vector<uint8_t>& data) {
-  if (data.empty() || artwork_dir_.empty()) {
-    return "";
-  }
-
-  // Verify data pointer is valid
-  if (!data.data()) {
-    g_warning("SaveArtworkToFile: data pointer is null");
-    return "";
-  }
-
-  // Generate unique filename with timestamp to prevent caching issues
-  auto now = std::chrono::system_clock::now();
-  auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-      now.time_since_epoch()).count();
-
-  std::stringstream ss;
-  ss << artwork_dir_ << "/artwork_" << timestamp << ".jpg";
-  std::string path = ss.str();
-
-  // Write data to file
-  std::ofstream file(path, std::ios::binary);
-  if (!file.is_open()) {
-    g_warning("SaveArtworkToFile: failed to open file '%s'", path.c_str());
-    return "";
-  }
-
-  file.write(reinterpret_cast<const char*>(data.data()), data.size());
-
-  // Check if write succeeded
-  if (!file.good()) {
-    g_warning("SaveArtworkToFile: failed to write to file '%s'", path.c_str());
-    file.close();
-    // Try to remove the partial file
-    std::remove(path.c_str());
-    return "";
-  }
-
-  file.close();
-
-  // Verify close succeeded
-  if (file.fail()) {
-    g_warning("SaveArtworkToFile: failed to close file '%s'", path.c_str());
-    // File might still be usable even if close reports an error
+  if (value && fl_value_get_type(value) == FL_VALUE_TYPE_BOOL) {
+    return fl_value_get_bool(value);
   }
-
-  return "file://" + path;
+  return false;
 }
 
-// Clean up a single artwork file
-void OsMediaControlsPluginImpl::CleanupArtworkFile(const std::string& path) {
-  if (path.empty()) {
-    return;
-  }
-
-  // Only delete files we created (in our artwork directory)
-  if (path.find("file://") == 0) {
-    std::string file_path = path.substr(7);
-    if (file_path.find(artwork_dir_) == 0) {
-      std::remove(file_path.c_str());
-    }
-  }
-}
-
-// Clean up entire artwork directory
-void OsMediaControlsPluginImpl::CleanupArtworkDirectory() {
-  if (artwork_dir_.empty()) {
-    return;
-  }
-
-  // Open directory
-  GDir* dir = g_dir_open(artwork_dir_.c_str(), 0, nullptr);
-  if (!dir) {
-    return;
+// Helper to borrow the bytes of a Uint8List; they live as long as the map
+const uint8_t* OsMediaControlsPluginImpl::GetBytesFromFlValue(FlValue* map, const char* key,
+                                                              size_t* length) {
+  *length = 0;
+  if (!map || !key || fl_value_get_type(map) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
   }
-
-  // Remove all files in the directory
-  const char* filename;
-  while ((filename = g_dir_read_name(dir)) != nullptr) {
-    std::stringstream ss;
-    ss << artwork_dir_ << "/" << filename;
-    std::remove(ss.str().c_str());
+  FlValue* value = fl_value_lookup_string(map, key);
+  if (value && fl_value_get_type(value) == FL_VALUE_TYPE_UINT8_LIST) {
+    *length = fl_value_get_length(value);
+    return fl_value_get_uint8_list(value);
   }
-
-  g_dir_close(dir);
-
-  // Remove the directory itself
-  rmdir(artwork_dir_.c_str());
+  return nullptr;
 }
 
 // Constructor
 OsMediaControlsPluginImpl::OsMediaControlsPluginImpl(FlPluginRegistrar* registrar,
                                                      FlEventChannel* event_channel)
-    : connection_(nullptr),
-      bus_id_(0),
-      media_player_registration_id_(0),
-      root_interface_registration_id_(0),
-      introspection_data_(nullptr),
-      mpris_initialized_(false),
-      event_channel_(event_channel ? FL_EVENT_CHANNEL(g_object_ref(event_channel))
+    : event_channel_(event_channel ? FL_EVENT_CHANNEL(g_object_ref(event_channel))
                                    : nullptr),
       is_listening_(false),
-      playback_status_("Stopped"),
-      position_(0),
-      rate_(1.0),
-      can_play_(true),
-      can_pause_(true),
-      can_stop_(false),
-      can_go_next_(false),
-      can_go_previous_(false),
-      can_seek_(false),
-      can_quit_(false),
-      can_raise_(false),
-      has_track_list_(false),
-      identity_(g_get_application_name() ? g_get_application_name() : "OS Media Controls"),
-      supported_uri_schemes_({"file", "http", "https"}),
-      supported_mime_types_({"audio/mpeg", "audio/flac", "audio/wav"}),
-      skip_forward_interval_(0),
-      skip_backward_interval_(0) {
-  CreateArtworkDirectory();
-  InitializeMPRIS();
+      pending_events_(kPendingEventCapacity, PendingEvent{nullptr, 0}),
+      pending_head_(0),
+      pending_count_(0),
+      pending_flush_id_(0),
+      events_buffered_(0),
+      events_superseded_(0),
+      events_evicted_(0),
+      events_expired_(0),
+      method_calls_(),
+      events_sent_(0),
+      event_send_failures_(0),
+      last_event_sequence_(0),
+      events_acknowledged_(0),
+      native_to_isolate_(),
+      handler_latency_(),
+      batch_events_(false),
+      batch_deadline_ms_(0),
+      batch_flush_id_(0),
+      batch_messages_(0),
+      registration_ns_(0) {
+  event_batch_.reserve(kMaxEventBatchSize);
+  core_.SetEventCallback([this](const OsMediaControlsEvent& event) {
+    HandleCoreEvent(event);
+  });
 }
 
 // Destructor
 OsMediaControlsPluginImpl::~OsMediaControlsPluginImpl() {
+  core_.SetEventCallback(nullptr);
+  ClearPendingEvents();
+  if (batch_flush_id_ > 0) {
+    g_source_remove(batch_flush_id_);
+    batch_flush_id_ = 0;
+  }
+  for (FlValue* event : event_batch_) {
+    fl_value_unref(event);
+  }
+  event_batch_.clear();
   if (event_channel_) {
     g_object_unref(event_channel_);
     event_channel_ = nullptr;
   }
-  CleanupMPRIS();
-  CleanupArtworkDirectory();
-}
-
-// Initialize MPRIS D-Bus interface
-void OsMediaControlsPluginImpl::InitializeMPRIS() {
-  GError* error = nullptr;
-
-  // Get session bus
-  connection_ = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &error);
-  if (error) {
-    g_warning("Failed to connect to session bus: %s", error->message);
-    g_error_free(error);
-    mpris_initialized_ = false;
-    return;
-  }
-
-  if (!connection_) {
-    g_warning("Failed to connect to session bus: connection is null");
-    mpris_initialized_ = false;
-    return;
-  }
-
-  // Parse introspection XML
-  introspection_data_ = g_dbus_node_info_new_for_xml(introspection_xml, &error);
-  if (error) {
-    g_warning("Failed to parse introspection XML: %s", error->message);
-    g_error_free(error);
-    mpris_initialized_ = false;
-    return;
-  }
-
-  if (!introspection_data_) {
-    g_warning("Failed to parse introspection XML: data is null");
-    mpris_initialized_ = false;
-    return;
-  }
-
-  // Verify we have at least 2 interfaces (MediaPlayer2 and MediaPlayer2.Player)
-  if (!introspection_data_->interfaces ||
-      !introspection_data_->interfaces[0] ||
-      !introspection_data_->interfaces[1]) {
-    g_warning("Introspection data does not contain expected interfaces");
-    if (introspection_data_) {
-      g_dbus_node_info_unref(introspection_data_);
-      introspection_data_ = nullptr;
-    }
-    mpris_initialized_ = false;
-    return;
-  }
-
-  // Define vtable for handling D-Bus method calls
-  static const GDBusInterfaceVTable vtable = {
-    HandleMethodCallDBus,
-    HandleGetProperty,
-    HandleSetProperty
-  };
-
-  // Register base MediaPlayer2 interface
-  root_interface_registration_id_ = g_dbus_connection_register_object(
-      connection_,
-      "/org/mpris/MediaPlayer2",
-      introspection_data_->interfaces[0],  // MediaPlayer2 interface
-      &vtable,
-      this,
-      nullptr,
-      &error);
-
-  if (error) {
-    g_warning("Failed to register MediaPlayer2 interface: %s", error->message);
-    g_error_free(error);
-    mpris_initialized_ = false;
-    return;
-  }
-
-  if (root_interface_registration_id_ == 0) {
-    g_warning("Failed to register MediaPlayer2 interface: registration ID is 0");
-    mpris_initialized_ = false;
-    return;
-  }
-
-  // Register MediaPlayer2.Player interface
-  media_player_registration_id_ = g_dbus_connection_register_object(
-      connection_,
-      "/org/mpris/MediaPlayer2",
-      introspection_data_->interfaces[1],  // Player interface
-      &vtable,
-      this,
-      nullptr,
-      &error);
-
-  if (error) {
-    g_warning("Failed to register MediaPlayer2.Player interface: %s", error->message);
-    g_error_free(error);
-    mpris_initialized_ = false;
-    return;
-  }
-
-  if (media_player_registration_id_ == 0) {
-    g_warning("Failed to register MediaPlayer2.Player interface: registration ID is 0");
-    mpris_initialized_ = false;
-    return;
-  }
-
-  // Request bus name
-  bus_id_ = g_bus_own_name_on_connection(
-      connection_,
-      "org.mpris.MediaPlayer2.OsMediaControls",
-      G_BUS_NAME_OWNER_FLAGS_NONE,
-      nullptr,
-      nullptr,
-      nullptr,
-      nullptr);
-
-  // Mark as successfully initialized
-  mpris_initialized_ = true;
-  g_message("MPRIS interface initialized successfully");
-}
-
-// Cleanup MPRIS
-void OsMediaControlsPluginImpl::CleanupMPRIS() {
-  if (bus_id_ > 0) {
-    g_bus_unown_name(bus_id_);
-    bus_id_ = 0;
-  }
-
-  if (media_player_registration_id_ > 0) {
-    g_dbus_connection_unregister_object(connection_, media_player_registration_id_);
-    media_player_registration_id_ = 0;
-  }
-
-  if (root_interface_registration_id_ > 0) {
-    g_dbus_connection_unregister_object(connection_, root_interface_registration_id_);
-    root_interface_registration_id_ = 0;
-  }
-
-  if (introspection_data_) {
-    g_dbus_node_info_unref(introspection_data_);
-    introspection_data_ = nullptr;
-  }
-
-  if (connection_) {
-    g_object_unref(connection_);
-    connection_ = nullptr;
-  }
-
-  // Clean up current artwork file
-  CleanupArtworkFile(artwork_path_);
-}
-
-// D-Bus method call handler
-void OsMediaControlsPluginImpl::HandleMethodCallDBus(
-    GDBusConnection* connection,
-    const gchar* sender,
-    const gchar* object_path,
-    const gchar* interface_name,
-    const gchar* method_name,
-    GVariant* parameters,
-    GDBusMethodInvocation* invocation,
-    gpointer user_data) {
-
-  auto* self = static_cast<OsMediaControlsPluginImpl*>(user_data);
-  if (!self) {
-    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
-                                          G_DBUS_ERROR_FAILED,
-                                          "Internal error: null user data");
-    return;
-  }
-
-  if (!interface_name || !method_name) {
-    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
-                                          G_DBUS_ERROR_INVALID_ARGS,
-                                          "Invalid arguments");
-    return;
-  }
-
-  bool is_player_interface =
-      g_strcmp0(interface_name, "org.mpris.MediaPlayer2.Player") == 0;
-  bool is_root_interface =
-      g_strcmp0(interface_name, "org.mpris.MediaPlayer2") == 0;
-
-  if (!is_player_interface && !is_root_interface) {
-    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
-                                          G_DBUS_ERROR_UNKNOWN_INTERFACE,
-                                          "Unknown interface");
-    return;
-  }
-
-  if (is_root_interface) {
-    if (g_strcmp0(method_name, "Raise") == 0 ||
-        g_strcmp0(method_name, "Quit") == 0) {
-      g_dbus_method_invocation_return_value(invocation, nullptr);
-      return;
-    }
-
-    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
-                                          G_DBUS_ERROR_UNKNOWN_METHOD,
-                                          "Unknown method");
-    return;
-  }
-
-  // Create event map to send to Flutter
-  g_autoptr(FlValue) event = fl_value_new_map();
-
-  if (g_strcmp0(method_name, "Play") == 0) {
-    fl_value_set_string_take(event, "type", fl_value_new_string("play"));
-  } else if (g_strcmp0(method_name, "Pause") == 0) {
-    fl_value_set_string_take(event, "type", fl_value_new_string("pause"));
-  } else if (g_strcmp0(method_name, "PlayPause") == 0) {
-    const char* type = (self->playback_status_ == "Playing")
-                           ? "pause"
-                           : "play";
-    fl_value_set_string_take(event, "type", fl_value_new_string(type));
-  } else if (g_strcmp0(method_name, "Stop") == 0) {
-    fl_value_set_string_take(event, "type", fl_value_new_string("stop"));
-  } else if (g_strcmp0(method_name, "Next") == 0) {
-    fl_value_set_string_take(event, "type", fl_value_new_string("next"));
-  } else if (g_strcmp0(method_name, "Previous") == 0) {
-    fl_value_set_string_take(event, "type", fl_value_new_string("previous"));
-  } else if (g_strcmp0(method_name, "Seek") == 0) {
-    gint64 offset_microseconds;
-    g_variant_get(parameters, "(x)", &offset_microseconds);
-
-    // Calculate new position
-    double new_position = self->position_ / 1000000.0 + offset_microseconds / 1000000.0;
-
-    fl_value_set_string_take(event, "type", fl_value_new_string("seek"));
-    fl_value_set_string_take(event, "position", fl_value_new_float(new_position));
-  } else if (g_strcmp0(method_name, "SetPosition") == 0) {
-    const gchar* track_id;
-    gint64 position_microseconds;
-    g_variant_get(parameters, "(&ox)", &track_id, &position_microseconds);
-
-    double position_seconds = position_microseconds / 1000000.0;
-
-    fl_value_set_string_take(event, "type", fl_value_new_string("seek"));
-    fl_value_set_string_take(event, "position", fl_value_new_float(position_seconds));
-  } else {
-    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
-                                          G_DBUS_ERROR_UNKNOWN_METHOD,
-                                          "Unknown method");
-    return;
-  }
-
-  // Send event to Flutter
-  self->SendEvent(g_steal_pointer(&event));
-
-  g_dbus_method_invocation_return_value(invocation, nullptr);
-}
-
-// D-Bus property get handler
-GVariant* OsMediaControlsPluginImpl::HandleGetProperty(
-    GDBusConnection* connection,
-    const gchar* sender,
-    const gchar* object_path,
-    const gchar* interface_name,
-    const gchar* property_name,
-    GError** error,
-    gpointer user_data) {
-
-  auto* self = static_cast<OsMediaControlsPluginImpl*>(user_data);
-  if (!self) {
-    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                "Internal error: null user data");
-    return nullptr;
-  }
-
-  if (!interface_name || !property_name) {
-    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                "Invalid arguments");
-    return nullptr;
-  }
-
-  if (g_strcmp0(interface_name, "org.mpris.MediaPlayer2") == 0) {
-    if (g_strcmp0(property_name, "CanQuit") == 0) {
-      return g_variant_new_boolean(self->can_quit_);
-    } else if (g_strcmp0(property_name, "CanRaise") == 0) {
-      return g_variant_new_boolean(self->can_raise_);
-    } else if (g_strcmp0(property_name, "HasTrackList") == 0) {
-      return g_variant_new_boolean(self->has_track_list_);
-    } else if (g_strcmp0(property_name, "Identity") == 0) {
-      return self->SafeVariantNewString(self->identity_);
-    } else if (g_strcmp0(property_name, "SupportedUriSchemes") == 0) {
-      GVariantBuilder builder;
-      g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
-      for (const auto& scheme : self->supported_uri_schemes_) {
-        // Validate UTF-8 before adding
-        if (!scheme.empty() && g_utf8_validate(scheme.c_str(), -1, nullptr)) {
-          g_variant_builder_add(&builder, "s", scheme.c_str());
-        }
-      }
-      return g_variant_builder_end(&builder);
-    } else if (g_strcmp0(property_name, "SupportedMimeTypes") == 0) {
-      GVariantBuilder builder;
-      g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
-      for (const auto& mime : self->supported_mime_types_) {
-        // Validate UTF-8 before adding
-        if (!mime.empty() && g_utf8_validate(mime.c_str(), -1, nullptr)) {
-          g_variant_builder_add(&builder, "s", mime.c_str());
-        }
-      }
-      return g_variant_builder_end(&builder);
-    }
-  } else if (g_strcmp0(interface_name, "org.mpris.MediaPlayer2.Player") == 0) {
-    if (g_strcmp0(property_name, "PlaybackStatus") == 0) {
-      return self->SafeVariantNewString(self->playback_status_);
-    } else if (g_strcmp0(property_name, "Rate") == 0) {
-      return g_variant_new_double(self->rate_);
-    } else if (g_strcmp0(property_name, "Position") == 0) {
-      return g_variant_new_int64(static_cast<gint64>(self->position_));
-    } else if (g_strcmp0(property_name, "MinimumRate") == 0) {
-      return g_variant_new_double(0.1);
-    } else if (g_strcmp0(property_name, "MaximumRate") == 0) {
-      return g_variant_new_double(10.0);
-    } else if (g_strcmp0(property_name, "CanGoNext") == 0) {
-      return g_variant_new_boolean(self->can_go_next_);
-    } else if (g_strcmp0(property_name, "CanGoPrevious") == 0) {
-      return g_variant_new_boolean(self->can_go_previous_);
-    } else if (g_strcmp0(property_name, "CanPlay") == 0) {
-      return g_variant_new_boolean(self->can_play_);
-    } else if (g_strcmp0(property_name, "CanPause") == 0) {
-      return g_variant_new_boolean(self->can_pause_);
-    } else if (g_strcmp0(property_name, "CanSeek") == 0) {
-      return g_variant_new_boolean(self->can_seek_);
-    } else if (g_strcmp0(property_name, "CanControl") == 0) {
-      return g_variant_new_boolean(TRUE);
-    } else if (g_strcmp0(property_name, "Metadata") == 0) {
-      GVariantBuilder builder;
-      g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-
-      // Thread safety note: This function (HandleGetProperty) and SetMetadata must run
-      // on the same thread. Currently both run on the GLib main loop thread, preventing
-      // concurrent access to metadata_ map.
-
-      auto title_it = self->metadata_.find("title");
-      if (title_it != self->metadata_.end() && !title_it->second.empty()) {
-        g_variant_builder_add(&builder, "{sv}", "xesam:title",
-                             self->SafeVariantNewString(title_it->second));
-      }
-
-      auto artist_it = self->metadata_.find("artist");
-      if (artist_it != self->metadata_.end() && !artist_it->second.empty()) {
-        // Validate UTF-8 before adding to array
-        if (g_utf8_validate(artist_it->second.c_str(), -1, nullptr)) {
-          GVariantBuilder artist_builder;
-          g_variant_builder_init(&artist_builder, G_VARIANT_TYPE("as"));
-          g_variant_builder_add(&artist_builder, "s", artist_it->second.c_str());
-          g_variant_builder_add(&builder, "{sv}", "xesam:artist",
-                               g_variant_builder_end(&artist_builder));
-        }
-      }
-
-      auto album_it = self->metadata_.find("album");
-      if (album_it != self->metadata_.end() && !album_it->second.empty()) {
-        g_variant_builder_add(&builder, "{sv}", "xesam:album",
-                             self->SafeVariantNewString(album_it->second));
-      }
-
-      auto album_artist_it = self->metadata_.find("albumArtist");
-      if (album_artist_it != self->metadata_.end() && !album_artist_it->second.empty()) {
-        // Validate UTF-8 before adding to array
-        if (g_utf8_validate(album_artist_it->second.c_str(), -1, nullptr)) {
-          GVariantBuilder album_artist_builder;
-          g_variant_builder_init(&album_artist_builder, G_VARIANT_TYPE("as"));
-          g_variant_builder_add(&album_artist_builder, "s", album_artist_it->second.c_str());
-          g_variant_builder_add(&builder, "{sv}", "xesam:albumArtist",
-                               g_variant_builder_end(&album_artist_builder));
-        }
-      }
-
-      auto duration_it = self->metadata_.find("duration");
-      if (duration_it != self->metadata_.end() && !duration_it->second.empty()) {
-        try {
-          double duration = std::stod(duration_it->second);
-          if (duration > 0 && std::isfinite(duration)) {
-            g_variant_builder_add(&builder, "{sv}", "mpris:length",
-                                 g_variant_new_int64(static_cast<gint64>(duration * 1000000)));
-          }
-        } catch (const std::invalid_argument& e) {
-          g_warning("Failed to parse duration '%s': invalid argument",
-                   duration_it->second.c_str());
-        } catch (const std::out_of_range& e) {
-          g_warning("Failed to parse duration '%s': out of range",
-                   duration_it->second.c_str());
-        }
-      }
-
-      if (!self->artwork_path_.empty()) {
-        g_variant_builder_add(&builder, "{sv}", "mpris:artUrl",
-                             self->SafeVariantNewString(self->artwork_path_));
-      }
-
-      g_variant_builder_add(&builder, "{sv}", "mpris:trackid",
-                           g_variant_new_object_path("/org/mpris/MediaPlayer2/Track/current"));
-
-      return g_variant_builder_end(&builder);
-    } else if (g_strcmp0(property_name, "Volume") == 0) {
-      return g_variant_new_double(1.0);
-    }
-  }
-
-  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
-              "Unknown property: %s", property_name);
-  return nullptr;
-}
-
-// D-Bus property set handler
-gboolean OsMediaControlsPluginImpl::HandleSetProperty(
-    GDBusConnection* connection,
-    const gchar* sender,
-    const gchar* object_path,
-    const gchar* interface_name,
-    const gchar* property_name,
-    GVariant* value,
-    GError** error,
-    gpointer user_data) {
-
-  auto* self = static_cast<OsMediaControlsPluginImpl*>(user_data);
-  if (!self) {
-    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                "Internal error: null user data");
-    return FALSE;
-  }
-
-  if (!property_name || !value) {
-    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                "Invalid arguments");
-    return FALSE;
-  }
-
-  if (g_strcmp0(property_name, "Rate") == 0) {
-    double rate = g_variant_get_double(value);
-    self->rate_ = rate;
-
-    // Send setSpeed event to Flutter
-    g_autoptr(FlValue) event = fl_value_new_map();
-    fl_value_set_string_take(event, "type", fl_value_new_string("setSpeed"));
-    fl_value_set_string_take(event, "speed", fl_value_new_float(rate));
-
-    self->SendEvent(g_steal_pointer(&event));
-
-    return TRUE;
-  }
-
-  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
-              "Property not writable: %s", property_name);
-  return FALSE;
-}
-
-// Emit PropertiesChanged signal
-void OsMediaControlsPluginImpl::EmitPropertiesChanged(
-    const char* interface_name,
-    GVariantBuilder* changed_properties_builder) {
-
-  if (!mpris_initialized_ || !connection_ || !changed_properties_builder) {
-    if (changed_properties_builder) {
-      // Clean up the builder if MPRIS is not initialized
-      g_variant_builder_clear(changed_properties_builder);
-    }
-    return;
-  }
-
-  g_autoptr(GVariant) changed_properties =
-      g_variant_ref_sink(g_variant_builder_end(changed_properties_builder));
-
-  GVariantBuilder invalidated_builder;
-  g_variant_builder_init(&invalidated_builder, G_VARIANT_TYPE("as"));
-  g_autoptr(GVariant) invalidated =
-      g_variant_ref_sink(g_variant_builder_end(&invalidated_builder));
-
-  g_autoptr(GVariant) signal_params = g_variant_ref_sink(
-      g_variant_new("(s@a{sv}@as)",
-                    interface_name,
-                    changed_properties,
-                    invalidated));
-
-  GError* error = nullptr;
-  g_dbus_connection_emit_signal(
-      connection_,
-      nullptr,
-      "/org/mpris/MediaPlayer2",
-      "org.freedesktop.DBus.Properties",
-      "PropertiesChanged",
-      signal_params,
-      &error);
-
-  if (error) {
-    g_warning("Failed to emit PropertiesChanged: %s", error->message);
-    g_error_free(error);
-  }
-}
-
-// Update MPRIS properties
-void OsMediaControlsPluginImpl::UpdateMPRISProperties() {
-  GVariantBuilder builder;
-  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-
-  g_variant_builder_add(&builder, "{sv}", "PlaybackStatus",
-                       SafeVariantNewString(playback_status_));
-  g_variant_builder_add(&builder, "{sv}", "Rate",
-                       g_variant_new_double(rate_));
-  g_variant_builder_add(&builder, "{sv}", "CanGoNext",
-                       g_variant_new_boolean(can_go_next_));
-  g_variant_builder_add(&builder, "{sv}", "CanGoPrevious",
-                       g_variant_new_boolean(can_go_previous_));
-  g_variant_builder_add(&builder, "{sv}", "CanPlay",
-                       g_variant_new_boolean(can_play_));
-  g_variant_builder_add(&builder, "{sv}", "CanPause",
-                       g_variant_new_boolean(can_pause_));
-  g_variant_builder_add(&builder, "{sv}", "CanSeek",
-                       g_variant_new_boolean(can_seek_));
-
-  EmitPropertiesChanged("org.mpris.MediaPlayer2.Player", &builder);
-}
-
-// Update metadata property
-void OsMediaControlsPluginImpl::UpdateMetadataProperty() {
-  if (!mpris_initialized_ || !connection_) {
-    return;
-  }
-
-  GVariantBuilder builder;
-  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-
-  GVariant* metadata = HandleGetProperty(connection_, nullptr, nullptr,
-                                          "org.mpris.MediaPlayer2.Player",
-                                          "Metadata", nullptr, this);
-  if (metadata) {
-    g_variant_builder_add(&builder, "{sv}", "Metadata", metadata);
-    EmitPropertiesChanged("org.mpris.MediaPlayer2.Player", &builder);
-  } else {
-    g_variant_builder_clear(&builder);
-  }
 }
 
 // Handle method calls from Flutter
@@ -840,6 +191,13 @@ void OsMediaControlsPluginImpl::HandleMethodCall(FlMethodCall* method_call) {
   const gchar* method = fl_method_call_get_name(method_call);
   FlValue* args = fl_method_call_get_args(method_call);
 
+  size_t method_index = 0;
+  while (method_index < kMethodCount - 1 && g_strcmp0(method, kMethodNames[method_index]) != 0) {
+    method_index++;
+  }
+  ScopedCallTimer timer(&method_calls_[method_index]);
+  OS_MEDIA_CONTROLS_PROBE_SCOPE(method_call, method);
+
   g_autoptr(FlMethodResponse) response = nullptr;
 
   if (strcmp(method, "setMetadata") == 0) {
@@ -849,10 +207,10 @@ void OsMediaControlsPluginImpl::HandleMethodCall(FlMethodCall* method_call) {
     SetPlaybackState(args);
     response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
   } else if (strcmp(method, "enableControls") == 0) {
-    EnableControls(args);
+    SetControlsEnabled(args, true);
     response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
   } else if (strcmp(method, "disableControls") == 0) {
-    DisableControls(args);
+    SetControlsEnabled(args, false);
     response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
   } else if (strcmp(method, "setSkipIntervals") == 0) {
     SetSkipIntervals(args);
@@ -861,8 +219,28 @@ void OsMediaControlsPluginImpl::HandleMethodCall(FlMethodCall* method_call) {
     SetQueueInfo(args);
     response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
   } else if (strcmp(method, "clear") == 0) {
-    Clear();
+    core_.Clear();
     response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "setEventCoalescing") == 0) {
+    SetEventCoalescing(args);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "setEventBatching") == 0) {
+    SetEventBatching(args);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "setOptimisticUpdates") == 0) {
+    SetOptimisticUpdates(args);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "acknowledgeEvent") == 0) {
+    AcknowledgeEvent(args);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "setStatePersistence") == 0) {
+    SetStatePersistence(args);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "confirmRestoredState") == 0) {
+    core_.ConfirmRestoredState();
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_null()));
+  } else if (strcmp(method, "getStats") == 0) {
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(GetStats()));
   } else {
     response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
   }
@@ -871,64 +249,31 @@ void OsMediaControlsPluginImpl::HandleMethodCall(FlMethodCall* method_call) {
 }
 
 // Set metadata
-// Thread safety note: This function modifies the metadata_ map and must run on the same
-// thread as HandleGetProperty (which reads from metadata_). Both functions execute on
-// the GLib main loop thread, ensuring single-threaded access and preventing race conditions.
 void OsMediaControlsPluginImpl::SetMetadata(FlValue* args) {
   if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
     return;
   }
 
-  // Extract metadata fields
   std::string title = GetStringFromFlValue(args, "title");
   std::string artist = GetStringFromFlValue(args, "artist");
   std::string album = GetStringFromFlValue(args, "album");
   std::string album_artist = GetStringFromFlValue(args, "albumArtist");
-  double duration = GetDoubleFromFlValue(args, "duration");
-
-  // Update metadata map
-  if (!title.empty()) metadata_["title"] = title;
-  if (!artist.empty()) metadata_["artist"] = artist;
-  if (!album.empty()) metadata_["album"] = album;
-  if (!album_artist.empty()) metadata_["albumArtist"] = album_artist;
-  if (duration > 0) metadata_["duration"] = std::to_string(duration);
-
-  // Handle artwork - clean up old file first
-  std::string old_artwork_path = artwork_path_;
-
-  // Check for artwork URL first (preferred if provided)
+  std::string track_id = GetStringFromFlValue(args, "trackId");
   std::string artwork_url = GetStringFromFlValue(args, "artworkUrl");
-  if (!artwork_url.empty()) {
-    // Pass through URLs directly (file://, http://, https://)
-    // Note: GNOME Shell only supports file:// reliably, but we'll pass through anyway
-    if (artwork_url.find("file://") == 0 ||
-        artwork_url.find("http://") == 0 ||
-        artwork_url.find("https://") == 0) {
-      artwork_path_ = artwork_url;
-      artwork_data_.clear();  // Clear binary data if using URL
-    } else {
-      // If it's not a proper URL, try to make it a file:// URL
-      if (artwork_url[0] == '/') {
-        artwork_path_ = "file://" + artwork_url;
-        artwork_data_.clear();
-      }
-    }
-  } else {
-    // Fall back to binary artwork data
-    auto artwork = GetBytesFromFlValue(args, "artwork");
-    if (!artwork.empty()) {
-      // Save binary data to file with unique timestamp
-      artwork_data_ = artwork;
-      artwork_path_ = SaveArtworkToFile(artwork);
-    }
-  }
 
-  // Clean up old artwork file if it's different and in our artwork directory
-  if (old_artwork_path != artwork_path_) {
-    CleanupArtworkFile(old_artwork_path);
-  }
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = title.c_str();
+  metadata.artist = artist.c_str();
+  metadata.album = album.c_str();
+  metadata.album_artist = album_artist.c_str();
+  metadata.duration = GetDoubleFromFlValue(args, "duration");
+  metadata.track_id = track_id.c_str();
+  metadata.artwork_url = artwork_url.c_str();
+
+  // Artwork bytes are passed straight from the message without copying
+  metadata.artwork = GetBytesFromFlValue(args, "artwork", &metadata.artwork_length);
 
-  UpdateMetadataProperty();
+  core_.SetMetadata(metadata);
 }
 
 // Set playback state
@@ -938,148 +283,167 @@ void OsMediaControlsPluginImpl::SetPlaybackState(FlValue* args) {
   }
 
   std::string state = GetStringFromFlValue(args, "state");
-  double position = GetDoubleFromFlValue(args, "position");
-  double speed = GetDoubleFromFlValue(args, "speed");
-
-  // Map Flutter states to MPRIS PlaybackStatus
+  OsMediaControlsPlaybackState playback_state = OS_MEDIA_CONTROLS_PLAYBACK_BUFFERING;
   if (state == "playing") {
-    playback_status_ = "Playing";
+    playback_state = OS_MEDIA_CONTROLS_PLAYBACK_PLAYING;
   } else if (state == "paused") {
-    playback_status_ = "Paused";
-  } else if (state == "stopped" || state == "none") {
-    playback_status_ = "Stopped";
+    playback_state = OS_MEDIA_CONTROLS_PLAYBACK_PAUSED;
+  } else if (state == "stopped") {
+    playback_state = OS_MEDIA_CONTROLS_PLAYBACK_STOPPED;
+  } else if (state == "none") {
+    playback_state = OS_MEDIA_CONTROLS_PLAYBACK_NONE;
   }
 
-  // Update position (convert seconds to microseconds)
-  position_ = position * 1000000;
-
-  // Update rate
-  if (speed > 0) {
-    rate_ = speed;
-  }
-
-  UpdateMPRISProperties();
+  core_.SetPlaybackState(playback_state,
+                         GetDoubleFromFlValue(args, "position"),
+                         GetDoubleFromFlValue(args, "speed"));
 }
 
-// Enable controls
-void OsMediaControlsPluginImpl::EnableControls(FlValue* args) {
+// Enable or disable the controls named in a list
+void OsMediaControlsPluginImpl::SetControlsEnabled(FlValue* args, bool enabled) {
   if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_LIST) {
     return;
   }
 
+  uint32_t controls = 0;
   size_t length = fl_value_get_length(args);
   for (size_t i = 0; i < length; i++) {
     FlValue* item = fl_value_get_list_value(args, i);
     if (!item) {
-      g_warning("EnableControls: null item at index %zu", i);
+      OS_MEDIA_CONTROLS_WARNING(kApi, nullptr, "SetControlsEnabled: null item at index %zu", i);
       continue;
     }
 
     if (fl_value_get_type(item) == FL_VALUE_TYPE_STRING) {
       const char* control = fl_value_get_string(item);
       if (!control) {
-        g_warning("EnableControls: null control string at index %zu", i);
+        OS_MEDIA_CONTROLS_WARNING(kApi, nullptr,
+                                  "SetControlsEnabled: null control string at index %zu", i);
         continue;
       }
 
       if (strcmp(control, "play") == 0) {
-        can_play_ = true;
+        controls |= OS_MEDIA_CONTROLS_CONTROL_PLAY;
       } else if (strcmp(control, "pause") == 0) {
-        can_pause_ = true;
+        controls |= OS_MEDIA_CONTROLS_CONTROL_PAUSE;
       } else if (strcmp(control, "stop") == 0) {
-        can_stop_ = true;
+        controls |= OS_MEDIA_CONTROLS_CONTROL_STOP;
       } else if (strcmp(control, "next") == 0) {
-        can_go_next_ = true;
+        controls |= OS_MEDIA_CONTROLS_CONTROL_NEXT;
       } else if (strcmp(control, "previous") == 0) {
-        can_go_previous_ = true;
+        controls |= OS_MEDIA_CONTROLS_CONTROL_PREVIOUS;
       } else if (strcmp(control, "seek") == 0) {
-        can_seek_ = true;
+        controls |= OS_MEDIA_CONTROLS_CONTROL_SEEK;
       }
     }
   }
 
-  UpdateMPRISProperties();
+  core_.SetControlsEnabled(controls, enabled);
 }
 
-// Disable controls
-void OsMediaControlsPluginImpl::DisableControls(FlValue* args) {
-  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_LIST) {
+// Set skip intervals
+void OsMediaControlsPluginImpl::SetSkipIntervals(FlValue* args) {
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
     return;
   }
 
-  size_t length = fl_value_get_length(args);
-  for (size_t i = 0; i < length; i++) {
-    FlValue* item = fl_value_get_list_value(args, i);
-    if (!item) {
-      g_warning("DisableControls: null item at index %zu", i);
-      continue;
-    }
+  core_.SetSkipIntervals(static_cast<int>(GetInt64FromFlValue(args, "forward")),
+                         static_cast<int>(GetInt64FromFlValue(args, "backward")));
+}
 
-    if (fl_value_get_type(item) == FL_VALUE_TYPE_STRING) {
-      const char* control = fl_value_get_string(item);
-      if (!control) {
-        g_warning("DisableControls: null control string at index %zu", i);
-        continue;
-      }
+// Set queue info
+void OsMediaControlsPluginImpl::SetQueueInfo(FlValue* args) {
+  // Note: MPRIS doesn't expose queue info in the basic Player interface
+  // This would require implementing org.mpris.MediaPlayer2.TrackList
+}
 
-      if (strcmp(control, "play") == 0) {
-        can_play_ = false;
-      } else if (strcmp(control, "pause") == 0) {
-        can_pause_ = false;
-      } else if (strcmp(control, "stop") == 0) {
-        can_stop_ = false;
-      } else if (strcmp(control, "next") == 0) {
-        can_go_next_ = false;
-      } else if (strcmp(control, "previous") == 0) {
-        can_go_previous_ = false;
-      } else if (strcmp(control, "seek") == 0) {
-        can_seek_ = false;
-      }
-    }
+// Configure event coalescing windows (milliseconds, 0 disables)
+void OsMediaControlsPluginImpl::SetEventCoalescing(FlValue* args) {
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return;
+  }
+
+  // Omitted windows keep their current value
+  int64_t window = -1;
+  int64_t dedup_window = -1;
+  if (fl_value_lookup_string(args, "window")) {
+    window = std::max<int64_t>(0, GetInt64FromFlValue(args, "window"));
+  }
+  if (fl_value_lookup_string(args, "dedupWindow")) {
+    dedup_window = std::max<int64_t>(0, GetInt64FromFlValue(args, "dedupWindow"));
   }
 
-  UpdateMPRISProperties();
+  core_.SetEventCoalescing(window, dedup_window);
 }
 
-// Set skip intervals
-void OsMediaControlsPluginImpl::SetSkipIntervals(FlValue* args) {
+// Enable or disable batched event delivery
+void OsMediaControlsPluginImpl::SetEventBatching(FlValue* args) {
   if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
     return;
   }
 
-  skip_forward_interval_ = static_cast<int>(GetInt64FromFlValue(args, "forward"));
-  skip_backward_interval_ = static_cast<int>(GetInt64FromFlValue(args, "backward"));
+  batch_deadline_ms_ = static_cast<guint>(
+      std::max<int64_t>(0, GetInt64FromFlValue(args, "deadline")));
+  batch_events_ = GetBoolFromFlValue(args, "enabled");
 
-  // Note: MPRIS doesn't have standard skip interval support
-  // This could be added as a custom extension if needed
+  if (!batch_events_) {
+    FlushEventBatch();
+  }
 }
 
-// Set queue info
-void OsMediaControlsPluginImpl::SetQueueInfo(FlValue* args) {
-  // Note: MPRIS doesn't expose queue info in the basic Player interface
-  // This would require implementing org.mpris.MediaPlayer2.TrackList
+// Enable or disable optimistic PlaybackStatus updates
+void OsMediaControlsPluginImpl::SetOptimisticUpdates(FlValue* args) {
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return;
+  }
+
+  int64_t timeout = GetInt64FromFlValue(args, "timeout");
+  core_.SetOptimisticUpdates(GetBoolFromFlValue(args, "enabled"),
+                             timeout > 0 ? static_cast<guint>(timeout) : 0);
 }
 
-// Clear all media info
-void OsMediaControlsPluginImpl::Clear() {
-  metadata_.clear();
-  artwork_data_.clear();
+// Enable or disable the persisted state snapshot
+void OsMediaControlsPluginImpl::SetStatePersistence(FlValue* args) {
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return;
+  }
 
-  // Clean up artwork file using helper function
-  CleanupArtworkFile(artwork_path_);
-  artwork_path_.clear();
+  core_.SetStatePersistence(GetBoolFromFlValue(args, "enabled"));
+}
 
-  playback_status_ = "Stopped";
-  position_ = 0;
-  rate_ = 1.0;
+// Record how long an event took to reach Dart and to be handled there. The
+// times are wall clock microseconds, which Dart can read too; the event's
+// receivedAt is echoed back rather than kept here.
+void OsMediaControlsPluginImpl::AcknowledgeEvent(FlValue* args) {
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return;
+  }
 
-  UpdateMPRISProperties();
-  UpdateMetadataProperty();
+  int64_t sequence = GetInt64FromFlValue(args, "sequence");
+  if (sequence <= 0 || static_cast<guint64>(sequence) > last_event_sequence_) {
+    return;
+  }
+
+  int64_t native_received_at = GetInt64FromFlValue(args, "nativeReceivedAt");
+  int64_t received_at = GetInt64FromFlValue(args, "receivedAt");
+  int64_t handled_at = GetInt64FromFlValue(args, "handledAt");
+  if (native_received_at > 0 && received_at >= native_received_at) {
+    native_to_isolate_.Record(static_cast<guint64>(received_at - native_received_at) * 1000);
+  }
+  if (received_at > 0 && handled_at >= received_at) {
+    handler_latency_.Record(static_cast<guint64>(handled_at - received_at) * 1000);
+  }
+  events_acknowledged_++;
 }
 
 // Start listening for events from Dart
 void OsMediaControlsPluginImpl::StartListening() {
   is_listening_ = true;
+
+  // Replay buffered events in one batch once the listen call has completed
+  if (pending_count_ > 0 && pending_flush_id_ == 0) {
+    pending_flush_id_ = g_idle_add(FlushPendingEvents, this);
+  }
 }
 
 // Stop listening for events from Dart
@@ -1087,23 +451,408 @@ void OsMediaControlsPluginImpl::StopListening() {
   is_listening_ = false;
 }
 
-// Send event to Dart via event channel
+// Convert a control event from the core into an event channel map
+void OsMediaControlsPluginImpl::HandleCoreEvent(const OsMediaControlsEvent& event) {
+  OS_MEDIA_CONTROLS_PROBE_SCOPE(send_event, os_media_controls_event_type_name(event.type),
+                                event.value);
+  FlValue* map = fl_value_new_map();
+  fl_value_set_string_take(map, "type",
+                           fl_value_new_string(os_media_controls_event_type_name(event.type)));
+  if (event.sequence > 0) {
+    // Dart compares wall clock times, so convert the monotonic stamp
+    guint64 age_ns = ScopedCallTimer::NowNs() - static_cast<guint64>(event.received_ns);
+    fl_value_set_string_take(map, "sequence", fl_value_new_int(event.sequence));
+    fl_value_set_string_take(map, "receivedAt",
+                             fl_value_new_int(g_get_real_time() - age_ns / 1000));
+    last_event_sequence_ = std::max(last_event_sequence_, event.sequence);
+  }
+  if (event.type == OS_MEDIA_CONTROLS_EVENT_SEEK) {
+    fl_value_set_string_take(map, "position", fl_value_new_float(event.value));
+  } else if (event.type == OS_MEDIA_CONTROLS_EVENT_SET_SPEED) {
+    fl_value_set_string_take(map, "speed", fl_value_new_float(event.value));
+  }
+
+  SendEvent(map);
+}
+
+// Send event to Dart via event channel, holding it while Dart is not
+// listening and batching it when enabled (takes ownership of event)
 void OsMediaControlsPluginImpl::SendEvent(FlValue* event) {
-  if (!event) {
+  if (!event_channel_) {
+    fl_value_unref(event);
     return;
   }
 
-  if (!is_listening_ || !event_channel_) {
-    fl_value_unref(event);
+  if (!is_listening_) {
+    BufferEvent(event);
+    return;
+  }
+
+  if (batch_events_) {
+    // Play/pause bypass the batch so the user's intent reaches Dart without
+    // waiting for the deadline; earlier events are flushed first to keep order
+    const char* type = GetEventType(event);
+    if (g_strcmp0(type, "play") == 0 || g_strcmp0(type, "pause") == 0) {
+      FlushEventBatch();
+      SendEventToChannel(event);
+      return;
+    }
+
+    event_batch_.push_back(event);
+    if (event_batch_.size() >= kMaxEventBatchSize) {
+      FlushEventBatch();
+    } else if (batch_flush_id_ == 0) {
+      batch_flush_id_ = batch_deadline_ms_ > 0
+          ? g_timeout_add(batch_deadline_ms_, HandleEventBatchTimeout, this)
+          : g_idle_add_full(G_PRIORITY_DEFAULT, HandleEventBatchTimeout, this, nullptr);
+    }
     return;
   }
 
+  SendEventToChannel(event);
+}
+
+// Send one message (an event map or a list of them) on the event channel
+// (takes ownership of message)
+void OsMediaControlsPluginImpl::SendEventToChannel(FlValue* message) {
   g_autoptr(GError) error = nullptr;
-  if (!fl_event_channel_send(event_channel_, event, nullptr, &error)) {
-    g_warning("Failed to send event: %s", error->message);
+  size_t events = fl_value_get_type(message) == FL_VALUE_TYPE_LIST
+                      ? fl_value_get_length(message)
+                      : 1;
+  if (fl_event_channel_send(event_channel_, message, nullptr, &error)) {
+    events_sent_ += events;
+  } else {
+    OS_MEDIA_CONTROLS_WARNING(kEvents, nullptr, "Failed to send event: %s", error->message);
+    event_send_failures_ += events;
   }
+  batch_messages_++;
+
+  fl_value_unref(message);
+}
 
-  fl_value_unref(event);
+// Send all batched events as a single list message
+void OsMediaControlsPluginImpl::FlushEventBatch() {
+  if (batch_flush_id_ > 0) {
+    g_source_remove(batch_flush_id_);
+    batch_flush_id_ = 0;
+  }
+
+  if (event_batch_.empty()) {
+    return;
+  }
+
+  // Dart stopped listening since these were batched; hold them for replay
+  if (!is_listening_) {
+    for (FlValue* event : event_batch_) {
+      BufferEvent(event);
+    }
+    event_batch_.clear();
+    return;
+  }
+
+  FlValue* batch = fl_value_new_list();
+  for (FlValue* event : event_batch_) {
+    fl_value_append_take(batch, event);
+  }
+  event_batch_.clear();
+
+  SendEventToChannel(batch);
+}
+
+gboolean OsMediaControlsPluginImpl::HandleEventBatchTimeout(gpointer user_data) {
+  auto* self = static_cast<OsMediaControlsPluginImpl*>(user_data);
+  self->batch_flush_id_ = 0;
+  self->FlushEventBatch();
+  return G_SOURCE_REMOVE;
+}
+
+// Hold an event until Dart listens (takes ownership of event)
+void OsMediaControlsPluginImpl::BufferEvent(FlValue* event) {
+  size_t capacity = pending_events_.size();
+
+  // Drop the buffered event this one supersedes and close the gap, so a
+  // burst of seeks cannot crowd out next/previous/stop. Each group has at
+  // most one entry, since every earlier one was dropped the same way.
+  const char* group = GetEventRetentionGroup(GetEventType(event));
+  if (group) {
+    for (size_t i = 0; i < pending_count_; i++) {
+      PendingEvent& pending = pending_events_[(pending_head_ + i) % capacity];
+      if (g_strcmp0(GetEventRetentionGroup(GetEventType(pending.event)), group) != 0) {
+        continue;
+      }
+
+      fl_value_unref(pending.event);
+      events_superseded_++;
+      for (size_t j = i + 1; j < pending_count_; j++) {
+        pending_events_[(pending_head_ + j - 1) % capacity] =
+            pending_events_[(pending_head_ + j) % capacity];
+      }
+      pending_count_--;
+      pending_events_[(pending_head_ + pending_count_) % capacity].event = nullptr;
+      break;
+    }
+  }
+
+  // Full: the oldest entry makes room
+  if (pending_count_ == capacity) {
+    PendingEvent& oldest = pending_events_[pending_head_];
+    fl_value_unref(oldest.event);
+    oldest.event = nullptr;
+    events_evicted_++;
+    pending_head_ = (pending_head_ + 1) % capacity;
+    pending_count_--;
+  }
+
+  pending_events_[(pending_head_ + pending_count_) % capacity] =
+      PendingEvent{event, g_get_monotonic_time()};
+  pending_count_++;
+  events_buffered_++;
+}
+
+gboolean OsMediaControlsPluginImpl::FlushPendingEvents(gpointer user_data) {
+  auto* self = static_cast<OsMediaControlsPluginImpl*>(user_data);
+  self->pending_flush_id_ = 0;
+
+  // Dart cancelled again before the flush ran; keep the events for next time
+  if (!self->is_listening_) {
+    return G_SOURCE_REMOVE;
+  }
+
+  gint64 now = g_get_monotonic_time();
+  size_t capacity = self->pending_events_.size();
+  while (self->pending_count_ > 0) {
+    PendingEvent pending = self->pending_events_[self->pending_head_];
+    self->pending_events_[self->pending_head_].event = nullptr;
+    self->pending_head_ = (self->pending_head_ + 1) % capacity;
+    self->pending_count_--;
+
+    if (now - pending.time > kPendingEventMaxAgeMs * 1000) {
+      fl_value_unref(pending.event);
+      self->events_expired_++;
+      continue;
+    }
+
+    self->SendEvent(pending.event);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+// Discard all buffered events
+void OsMediaControlsPluginImpl::ClearPendingEvents() {
+  if (pending_flush_id_ > 0) {
+    g_source_remove(pending_flush_id_);
+    pending_flush_id_ = 0;
+  }
+
+  for (PendingEvent& pending : pending_events_) {
+    if (pending.event) {
+      fl_value_unref(pending.event);
+      pending.event = nullptr;
+    }
+  }
+  pending_head_ = 0;
+  pending_count_ = 0;
+}
+
+// {calls, totalUs, maxUs, p50Us, p99Us, histogram}; histogram[i] counts
+// calls that took [2^i, 2^(i+1)) ns, trimmed after the last non-empty bucket
+static FlValue* CallStatsToFlValue(const CallStats& call) {
+  const LatencyHistogram& latency = call.latency;
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "calls", fl_value_new_int(call.calls));
+  fl_value_set_string_take(value, "totalUs", fl_value_new_float(latency.total_ns / 1000.0));
+  fl_value_set_string_take(value, "maxUs", fl_value_new_float(latency.max_ns / 1000.0));
+  fl_value_set_string_take(value, "p50Us", fl_value_new_float(latency.Quantile(0.50) / 1000.0));
+  fl_value_set_string_take(value, "p99Us", fl_value_new_float(latency.Quantile(0.99) / 1000.0));
+
+  size_t used = LatencyHistogram::kBuckets;
+  while (used > 0 && latency.buckets[used - 1] == 0) {
+    used--;
+  }
+  FlValue* histogram = fl_value_new_list();
+  for (size_t i = 0; i < used; i++) {
+    fl_value_append_take(histogram, fl_value_new_int(latency.buckets[i]));
+  }
+  fl_value_set_string_take(value, "histogram", histogram);
+  return value;
+}
+
+// Collect runtime statistics for the getStats method call
+FlValue* OsMediaControlsPluginImpl::GetStats() {
+  MediaControlsCore::Stats core_stats = core_.GetStats();
+  FlValue* stats = fl_value_new_map();
+
+  static_assert(G_N_ELEMENTS(kMethodNames) == kMethodCount,
+                "kMethodNames must have kMethodCount entries");
+  FlValue* method_calls = fl_value_new_map();
+  for (size_t i = 0; i < kMethodCount; i++) {
+    if (method_calls_[i].calls > 0) {
+      fl_value_set_string_take(method_calls, kMethodNames[i],
+                               CallStatsToFlValue(method_calls_[i]));
+    }
+  }
+  fl_value_set_string_take(stats, "methodCalls", method_calls);
+
+  FlValue* dbus_calls = fl_value_new_map();
+  for (const auto& entry : core_stats.dbus_calls) {
+    fl_value_set_string_take(dbus_calls, entry.first.c_str(), CallStatsToFlValue(entry.second));
+  }
+  fl_value_set_string_take(stats, "dbusCalls", dbus_calls);
+
+  FlValue* signals = fl_value_new_map();
+  fl_value_set_string_take(signals, "emitted", fl_value_new_int(core_stats.signals_emitted));
+  fl_value_set_string_take(signals, "bytes", fl_value_new_int(core_stats.signal_bytes));
+  fl_value_set_string_take(stats, "signals", signals);
+
+  FlValue* latency = fl_value_new_map();
+  fl_value_set_string_take(latency, "busToNative",
+                           CallStatsToFlValue(CallStats{core_stats.bus_to_native.count,
+                                                        core_stats.bus_to_native}));
+  fl_value_set_string_take(latency, "nativeToIsolate",
+                           CallStatsToFlValue(CallStats{native_to_isolate_.count,
+                                                        native_to_isolate_}));
+  fl_value_set_string_take(latency, "handler",
+                           CallStatsToFlValue(CallStats{handler_latency_.count, handler_latency_}));
+  fl_value_set_string_take(latency, "acknowledged", fl_value_new_int(events_acknowledged_));
+  fl_value_set_string_take(stats, "latency", latency);
+
+  const MediaControlsCore::StallStats& stall_stats = core_stats.stalls;
+  FlValue* stalls = fl_value_new_map();
+  fl_value_set_string_take(stalls, "thresholdMs", fl_value_new_int(stall_stats.threshold_ms));
+  fl_value_set_string_take(stalls, "duration",
+                           CallStatsToFlValue(CallStats{stall_stats.stalls, stall_stats.duration}));
+  fl_value_set_string_take(stalls, "callsWaiting", fl_value_new_int(stall_stats.calls_waiting));
+  fl_value_set_string_take(stalls, "maxCallsWaiting",
+                           fl_value_new_int(stall_stats.max_calls_waiting));
+  fl_value_set_string_take(stalls, "maxCallWaitUs",
+                           fl_value_new_float(stall_stats.max_call_wait_ns / 1000.0));
+  FlValue* last_waiting = fl_value_new_list();
+  for (const std::string& member : stall_stats.last_waiting) {
+    fl_value_append_take(last_waiting, fl_value_new_string(member.c_str()));
+  }
+  fl_value_set_string_take(stalls, "lastWaiting", last_waiting);
+  fl_value_set_string_take(stats, "stalls", stalls);
+
+  FlValue* senders = fl_value_new_map();
+  for (const auto& entry : core_stats.senders) {
+    FlValue* sender = fl_value_new_map();
+    fl_value_set_string_take(sender, "dropped", fl_value_new_int(entry.second.dropped));
+    fl_value_set_string_take(sender, "merged", fl_value_new_int(entry.second.merged));
+    fl_value_set_string_take(senders, entry.first.c_str(), sender);
+  }
+
+  FlValue* rate_limit = fl_value_new_map();
+  fl_value_set_string_take(rate_limit, "dropped",
+                           fl_value_new_int(core_stats.rate_limit_dropped));
+  fl_value_set_string_take(rate_limit, "merged",
+                           fl_value_new_int(core_stats.rate_limit_merged));
+  fl_value_set_string_take(rate_limit, "senders", senders);
+  fl_value_set_string_take(stats, "rateLimit", rate_limit);
+
+  FlValue* memory = fl_value_new_map();
+  fl_value_set_string_take(memory, "residentBytes", fl_value_new_int(core_stats.resident_bytes));
+  fl_value_set_string_take(memory, "artworkDataBytes",
+                           fl_value_new_int(core_stats.artwork_data_bytes));
+  fl_value_set_string_take(memory, "artworkFileBytes",
+                           fl_value_new_int(core_stats.artwork_file_bytes));
+  fl_value_set_string_take(memory, "artworkFiles",
+                           fl_value_new_int(core_stats.artwork_files));
+  fl_value_set_string_take(memory, "senderBucketBytes",
+                           fl_value_new_int(core_stats.sender_bucket_bytes));
+  fl_value_set_string_take(memory, "lowMemoryWarnings",
+                           fl_value_new_int(core_stats.low_memory_warnings));
+  fl_value_set_string_take(stats, "memory", memory);
+
+  FlValue* events = fl_value_new_map();
+  for (const auto& entry : core_stats.events) {
+    FlValue* counters = fl_value_new_map();
+    fl_value_set_string_take(counters, "delivered", fl_value_new_int(entry.second.delivered));
+    fl_value_set_string_take(counters, "merged", fl_value_new_int(entry.second.merged));
+    fl_value_set_string_take(counters, "dropped", fl_value_new_int(entry.second.dropped));
+    fl_value_set_string_take(events, os_media_controls_event_type_name(entry.first), counters);
+  }
+  fl_value_set_string_take(stats, "events", events);
+
+  FlValue* buffer = fl_value_new_map();
+  fl_value_set_string_take(buffer, "buffered", fl_value_new_int(events_buffered_));
+  fl_value_set_string_take(buffer, "superseded", fl_value_new_int(events_superseded_));
+  fl_value_set_string_take(buffer, "evicted", fl_value_new_int(events_evicted_));
+  fl_value_set_string_take(buffer, "expired", fl_value_new_int(events_expired_));
+  fl_value_set_string_take(buffer, "channelMessages", fl_value_new_int(batch_messages_));
+  fl_value_set_string_take(buffer, "sent", fl_value_new_int(events_sent_));
+  fl_value_set_string_take(buffer, "sendFailures", fl_value_new_int(event_send_failures_));
+  fl_value_set_string_take(stats, "eventBuffer", buffer);
+
+  FlValue* track = fl_value_new_map();
+  fl_value_set_string_take(track, "id", fl_value_new_string(core_stats.track_id.c_str()));
+  fl_value_set_string_take(track, "staleSetPosition",
+                           fl_value_new_int(core_stats.stale_set_position));
+  fl_value_set_string_take(stats, "track", track);
+
+  FlValue* optimistic = fl_value_new_map();
+  fl_value_set_string_take(optimistic, "applied",
+                           fl_value_new_int(core_stats.optimistic_applied));
+  fl_value_set_string_take(optimistic, "confirmed",
+                           fl_value_new_int(core_stats.optimistic_confirmed));
+  fl_value_set_string_take(optimistic, "rolledBack",
+                           fl_value_new_int(core_stats.optimistic_rolled_back));
+  fl_value_set_string_take(stats, "optimistic", optimistic);
+
+  FlValue* snapshot = fl_value_new_map();
+  fl_value_set_string_take(snapshot, "enabled", fl_value_new_bool(core_stats.snapshot.enabled));
+  fl_value_set_string_take(snapshot, "restored", fl_value_new_bool(core_stats.snapshot.restored));
+  fl_value_set_string_take(snapshot, "unconfirmed",
+                           fl_value_new_bool(core_stats.snapshot.unconfirmed));
+  fl_value_set_string_take(snapshot, "writes", fl_value_new_int(core_stats.snapshot.writes));
+  fl_value_set_string_take(snapshot, "writeFailures",
+                           fl_value_new_int(core_stats.snapshot.write_failures));
+  fl_value_set_string_take(snapshot, "bytesWritten",
+                           fl_value_new_int(core_stats.snapshot.bytes_written));
+  fl_value_set_string_take(stats, "snapshot", snapshot);
+
+  FlValue* log = fl_value_new_map();
+  fl_value_set_string_take(log, "emitted", fl_value_new_int(core_stats.log.emitted));
+  fl_value_set_string_take(log, "suppressed", fl_value_new_int(core_stats.log.suppressed));
+  FlValue* log_categories = fl_value_new_map();
+  for (const auto& entry : core_stats.log.suppressed_by_category) {
+    fl_value_set_string_take(log_categories, entry.first.c_str(),
+                             fl_value_new_int(entry.second));
+  }
+  fl_value_set_string_take(log, "suppressedByCategory", log_categories);
+  fl_value_set_string_take(stats, "log", log);
+
+  FlValue* startup = fl_value_new_map();
+  fl_value_set_string_take(startup, "registerNs", fl_value_new_int(registration_ns_));
+  fl_value_set_string_take(startup, "constructNs",
+                           fl_value_new_int(core_stats.startup.construct_ns));
+  fl_value_set_string_take(startup, "activated", fl_value_new_bool(core_stats.startup.activated));
+  fl_value_set_string_take(startup, "ready", fl_value_new_bool(core_stats.startup.ready));
+  fl_value_set_string_take(startup, "busReadyNs",
+                           fl_value_new_int(core_stats.startup.bus_ready_ns));
+  fl_value_set_string_take(stats, "startup", startup);
+
+  FlValue* bus = fl_value_new_map();
+  fl_value_set_string_take(bus, "disconnects", fl_value_new_int(core_stats.bus.disconnects));
+  fl_value_set_string_take(bus, "reconnects", fl_value_new_int(core_stats.bus.reconnects));
+  fl_value_set_string_take(bus, "failedAttempts",
+                           fl_value_new_int(core_stats.bus.failed_attempts));
+  fl_value_set_string_take(bus, "recovery",
+                           CallStatsToFlValue(CallStats{core_stats.bus.reconnects,
+                                                        core_stats.bus.recovery}));
+  fl_value_set_string_take(stats, "bus", bus);
+
+  FlValue* artwork = fl_value_new_map();
+  fl_value_set_string_take(artwork, "writes", fl_value_new_int(core_stats.artwork_writes));
+  fl_value_set_string_take(artwork, "writesAvoided",
+                           fl_value_new_int(core_stats.artwork_writes_avoided));
+  fl_value_set_string_take(artwork, "dedupHits", fl_value_new_int(core_stats.artwork_dedup_hits));
+  fl_value_set_string_take(artwork, "bytesWritten",
+                           fl_value_new_int(core_stats.artwork_bytes_written));
+  fl_value_set_string_take(artwork, "pending", fl_value_new_bool(core_stats.artwork_pending));
+  fl_value_set_string_take(stats, "artwork", artwork);
+
+  return stats;
 }
 
 }  // namespace os_media_controls
@@ -1175,6 +924,7 @@ static void os_media_controls_plugin_class_init(OsMediaControlsPluginClass* klas
 static void os_media_controls_plugin_init(OsMediaControlsPlugin* self) {}
 
 void os_media_controls_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
+  guint64 start = os_media_controls::ScopedCallTimer::NowNs();
   OsMediaControlsPlugin* plugin = OS_MEDIA_CONTROLS_PLUGIN(
       g_object_new(os_media_controls_plugin_get_type(), nullptr));
 
@@ -1208,6 +958,7 @@ void os_media_controls_plugin_register_with_registrar(FlPluginRegistrar* registr
   // Create implementation
   plugin->impl = new os_media_controls::OsMediaControlsPluginImpl(
       registrar, plugin->event_channel);
+  plugin->impl->set_registration_ns(os_media_controls::ScopedCallTimer::NowNs() - start);
 
   g_object_unref(plugin);
 }
@@ -0,0 +1,32 @@
+#include "probes.h"
+
+#ifdef OS_MEDIA_CONTROLS_USDT
+// Tracers increment these in place when they attach, which is why they live
+// in the .probes section
+#define OS_MEDIA_CONTROLS_DEFINE_PROBE_SEMAPHORE(probe)                              \
+  __attribute__((section(".probes"))) volatile unsigned short                        \
+      OS_MEDIA_CONTROLS_PROBE_SEMAPHORE(probe) = 0;
+OS_MEDIA_CONTROLS_PROBE_LIST(OS_MEDIA_CONTROLS_DEFINE_PROBE_SEMAPHORE)
+#undef OS_MEDIA_CONTROLS_DEFINE_PROBE_SEMAPHORE
+#endif
+
+#ifdef OS_MEDIA_CONTROLS_PERFETTO
+PERFETTO_TRACK_EVENT_STATIC_STORAGE_IN_NAMESPACE(os_media_controls::perfetto_categories);
+#endif
+
+namespace os_media_controls {
+
+void InitializeProbes() {
+#ifdef OS_MEDIA_CONTROLS_PERFETTO
+  static gsize initialized = 0;
+  if (g_once_init_enter(&initialized)) {
+    perfetto::TracingInitArgs args;
+    args.backends = perfetto::kSystemBackend;
+    perfetto::Tracing::Initialize(args);
+    perfetto_categories::TrackEvent::Register();
+    g_once_init_leave(&initialized, 1);
+  }
+#endif
+}
+
+}  // namespace os_media_controls
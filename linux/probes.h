@@ -0,0 +1,124 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_PROBES_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_PROBES_H_
+
+// Static tracepoints on the hot paths.
+//
+// With OS_MEDIA_CONTROLS_USDT (on by default when <sys/sdt.h> is available)
+// every span fires USDT probes in the "os_media_controls" provider:
+//
+//   <span>_entry  label, span arguments
+//   <span>_exit   label, duration in nanoseconds
+//
+// A probe is a single nop until a tracer attaches, and exit durations are
+// only measured while the probe's semaphore says one is attached. Example:
+//
+//   bpftrace -e 'usdt:libos_media_controls_plugin.so:os_media_controls:dbus_method_exit
+//                { @[str(arg0)] = hist(arg1); }'
+//
+// With OS_MEDIA_CONTROLS_PERFETTO the same spans are also Perfetto track
+// events in the "os_media_controls" category, recorded by the system tracing
+// service.
+//
+// Spans (entry arguments after the label):
+//   method_call              Flutter method name
+//   send_event               event type
+//   dbus_method              D-Bus method name; sender, parameter bytes
+//   get_property             property name; sender
+//   emit_properties_changed  interface; number of properties, signal bytes
+//   save_artwork             "artwork"; image bytes
+
+#include <glib.h>
+
+#include "os_media_controls/os_media_controls_core.h"
+
+#define OS_MEDIA_CONTROLS_PROBE_LIST(X) \
+  X(method_call_entry)                  \
+  X(method_call_exit)                   \
+  X(send_event_entry)                   \
+  X(send_event_exit)                    \
+  X(dbus_method_entry)                  \
+  X(dbus_method_exit)                   \
+  X(get_property_entry)                 \
+  X(get_property_exit)                  \
+  X(emit_properties_changed_entry)      \
+  X(emit_properties_changed_exit)       \
+  X(save_artwork_entry)                 \
+  X(save_artwork_exit)
+
+#ifdef OS_MEDIA_CONTROLS_USDT
+// Semaphores let the exit probes skip the clock read while nothing is attached
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define OS_MEDIA_CONTROLS_PROBE_SEMAPHORE(probe) os_media_controls_##probe##_semaphore
+#define OS_MEDIA_CONTROLS_DECLARE_PROBE_SEMAPHORE(probe) \
+  extern volatile unsigned short OS_MEDIA_CONTROLS_PROBE_SEMAPHORE(probe);
+OS_MEDIA_CONTROLS_PROBE_LIST(OS_MEDIA_CONTROLS_DECLARE_PROBE_SEMAPHORE)
+#undef OS_MEDIA_CONTROLS_DECLARE_PROBE_SEMAPHORE
+
+#define OS_MEDIA_CONTROLS_PROBE(probe, ...) STAP_PROBEV(os_media_controls, probe, __VA_ARGS__)
+#define OS_MEDIA_CONTROLS_PROBE_ENABLED(probe) \
+  G_UNLIKELY(OS_MEDIA_CONTROLS_PROBE_SEMAPHORE(probe) != 0)
+#else
+#define OS_MEDIA_CONTROLS_PROBE(probe, ...) \
+  do {                                      \
+  } while (0)
+#define OS_MEDIA_CONTROLS_PROBE_ENABLED(probe) false
+#endif
+
+#ifdef OS_MEDIA_CONTROLS_PERFETTO
+#include <perfetto.h>
+
+PERFETTO_DEFINE_CATEGORIES_IN_NAMESPACE(
+    os_media_controls::perfetto_categories,
+    perfetto::Category("os_media_controls").SetDescription("os_media_controls hot paths"));
+
+#define OS_MEDIA_CONTROLS_TRACK_EVENT(span, label)                                   \
+  PERFETTO_USE_CATEGORIES_FROM_NAMESPACE_SCOPED(os_media_controls::perfetto_categories); \
+  TRACE_EVENT("os_media_controls", #span, "name", label)
+#else
+#define OS_MEDIA_CONTROLS_TRACK_EVENT(span, label) \
+  do {                                             \
+  } while (0)
+#endif
+
+// Fires <span>_entry now and <span>_exit when the enclosing scope ends. label
+// must stay valid until then. Use at most once per scope.
+#define OS_MEDIA_CONTROLS_PROBE_SCOPE(span, label, ...)                               \
+  OS_MEDIA_CONTROLS_PROBE(span##_entry, label, ##__VA_ARGS__);                        \
+  OS_MEDIA_CONTROLS_TRACK_EVENT(span, label);                                         \
+  os_media_controls::ProbeScope span##_probe_scope(                                   \
+      OS_MEDIA_CONTROLS_PROBE_ENABLED(span##_exit), [&](guint64 duration_ns) {        \
+        OS_MEDIA_CONTROLS_PROBE(span##_exit, label, duration_ns);                     \
+      })
+
+namespace os_media_controls {
+
+// Calls fire with the scope's duration on exit, if enabled when it was entered
+template <typename Fire>
+class ProbeScope {
+ public:
+  ProbeScope(bool enabled, Fire fire)
+      : start_(enabled ? ScopedCallTimer::NowNs() : 0), fire_(fire) {}
+  ~ProbeScope() {
+    if (start_ != 0) {
+      fire_(ScopedCallTimer::NowNs() - start_);
+    }
+  }
+
+  // Disallow copy and assign.
+  ProbeScope(const ProbeScope&) = delete;
+  ProbeScope& operator=(const ProbeScope&) = delete;
+
+ private:
+  guint64 start_;
+  Fire fire_;
+};
+
+// Connects to the Perfetto system backend once per process (no-op without
+// OS_MEDIA_CONTROLS_PERFETTO)
+void InitializeProbes();
+
+}  // namespace os_media_controls
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_PROBES_H_
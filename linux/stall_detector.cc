@@ -0,0 +1,267 @@
+#include "stall_detector.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+// Longest member name kept for a waiting call
+static constexpr size_t kMemberLength = 48;
+
+// Incoming calls remembered for attributing them to a stall
+static constexpr size_t kWaitingCallCapacity = 64;
+
+// Member names reported for the latest stall
+static constexpr size_t kMaxReportedCalls = 8;
+
+namespace os_media_controls {
+
+// Ring of recently received method calls for our objects. Shared between
+// the GDBus worker thread (writer), the watchdog and the main thread. A
+// removed filter may still be running on the worker thread, so the filter
+// holds a reference of its own that its destroy notify drops.
+struct WaitingCallLog {
+  struct Call {
+    guint64 time_ns;
+    char member[kMemberLength];
+  };
+
+  GMutex mutex;
+  Call calls[kWaitingCallCapacity];
+  size_t next;
+  size_t size;
+  gatomicrefcount ref_count;
+
+  WaitingCallLog() : next(0), size(0) {
+    g_mutex_init(&mutex);
+    g_atomic_ref_count_init(&ref_count);
+  }
+  ~WaitingCallLog() { g_mutex_clear(&mutex); }
+
+  WaitingCallLog* Ref() {
+    g_atomic_ref_count_inc(&ref_count);
+    return this;
+  }
+
+  static void Unref(gpointer data) {
+    auto* log = static_cast<WaitingCallLog*>(data);
+    if (g_atomic_ref_count_dec(&log->ref_count)) {
+      delete log;
+    }
+  }
+
+  // Calls received at or after since_ns; caller holds mutex
+  template <typename Visit>
+  void ForEachSince(guint64 since_ns, Visit visit) const {
+    for (size_t i = 0; i < size; i++) {
+      const Call& call = calls[(next + kWaitingCallCapacity - size + i) % kWaitingCallCapacity];
+      if (call.time_ns >= since_ns) {
+        visit(call);
+      }
+    }
+  }
+};
+
+// The main context source; it only observes iterations
+struct StallSource {
+  GSource source;
+  StallDetector* detector;
+};
+
+StallDetector::StallDetector(GDBusConnection* connection, guint threshold_ms)
+    : threshold_ms_(threshold_ms),
+      threshold_ns_(static_cast<guint64>(threshold_ms) * 1000000),
+      source_(nullptr),
+      busy_since_ns_(ScopedCallTimer::NowNs()),
+      watchdog_parked_(false),
+      connection_(nullptr),
+      filter_id_(0),
+      waiting_calls_(new WaitingCallLog()),
+      thread_(nullptr),
+      stop_(false),
+      stats_() {
+  g_mutex_init(&mutex_);
+  g_cond_init(&cond_);
+  stats_.threshold_ms = threshold_ms;
+
+  // High priority, so it is prepared and checked before any ready source
+  // cuts the iteration short
+  static GSourceFuncs funcs = {Prepare, Check, Dispatch, nullptr, nullptr, nullptr};
+  source_ = g_source_new(&funcs, sizeof(StallSource));
+  reinterpret_cast<StallSource*>(source_)->detector = this;
+  g_source_set_priority(source_, G_PRIORITY_HIGH);
+  g_source_attach(source_, nullptr);
+
+  SetConnection(connection);
+
+  thread_ = g_thread_new("omc-stall-watchdog", RunWatchdog, this);
+}
+
+StallDetector::~StallDetector() {
+  g_mutex_lock(&mutex_);
+  stop_ = true;
+  g_cond_signal(&cond_);
+  g_mutex_unlock(&mutex_);
+  g_thread_join(thread_);
+
+  g_source_destroy(source_);
+  g_source_unref(source_);
+
+  SetConnection(nullptr);
+  WaitingCallLog::Unref(waiting_calls_);
+
+  g_cond_clear(&cond_);
+  g_mutex_clear(&mutex_);
+}
+
+void StallDetector::SetConnection(GDBusConnection* connection) {
+  if (connection_) {
+    g_dbus_connection_remove_filter(connection_, filter_id_);
+    filter_id_ = 0;
+    g_clear_object(&connection_);
+  }
+
+  if (connection) {
+    connection_ = G_DBUS_CONNECTION(g_object_ref(connection));
+    filter_id_ = g_dbus_connection_add_filter(connection_, FilterMessage,
+                                              waiting_calls_->Ref(), WaitingCallLog::Unref);
+  }
+}
+
+void StallDetector::GetStats(MediaControlsCore::StallStats* stats) const {
+  *stats = stats_;
+}
+
+// The context is about to poll: whatever ran since it last woke is over
+gboolean StallDetector::Prepare(GSource* source, gint* timeout) {
+  StallDetector* self = reinterpret_cast<StallSource*>(source)->detector;
+  guint64 now = ScopedCallTimer::NowNs();
+  guint64 since = self->busy_since_ns_.exchange(0);
+  if (since != 0 && now - since >= self->threshold_ns_) {
+    self->RecordStall(since, now);
+  }
+  *timeout = -1;
+  return FALSE;
+}
+
+// The context woke from poll and is about to dispatch
+gboolean StallDetector::Check(GSource* source) {
+  StallDetector* self = reinterpret_cast<StallSource*>(source)->detector;
+  self->busy_since_ns_.store(ScopedCallTimer::NowNs());
+  if (self->watchdog_parked_.exchange(false)) {
+    g_mutex_lock(&self->mutex_);
+    g_cond_signal(&self->cond_);
+    g_mutex_unlock(&self->mutex_);
+  }
+  return FALSE;
+}
+
+gboolean StallDetector::Dispatch(GSource* source, GSourceFunc callback, gpointer user_data) {
+  return G_SOURCE_CONTINUE;
+}
+
+void StallDetector::RecordStall(guint64 start_ns, guint64 end_ns) {
+  stats_.stalls++;
+  stats_.duration.Record(end_ns - start_ns);
+
+  guint64 waiting = 0;
+  std::vector<std::string> members;
+  g_mutex_lock(&waiting_calls_->mutex);
+  waiting_calls_->ForEachSince(start_ns, [&](const WaitingCallLog::Call& call) {
+    if (call.time_ns > end_ns) {
+      return;
+    }
+    waiting++;
+    stats_.max_call_wait_ns = std::max(stats_.max_call_wait_ns, end_ns - call.time_ns);
+    if (members.size() < kMaxReportedCalls) {
+      members.emplace_back(call.member);
+    }
+  });
+  g_mutex_unlock(&waiting_calls_->mutex);
+
+  stats_.calls_waiting += waiting;
+  stats_.max_calls_waiting = std::max(stats_.max_calls_waiting, waiting);
+  if (waiting > 0) {
+    stats_.last_waiting = std::move(members);
+  }
+}
+
+gpointer StallDetector::RunWatchdog(gpointer user_data) {
+  auto* self = static_cast<StallDetector*>(user_data);
+  guint64 warned_since = 0;  // Start of the stall last warned about
+
+  g_mutex_lock(&self->mutex_);
+  while (!self->stop_) {
+    // While the loop polls there is nothing to time; Check() wakes us. The
+    // stamp is read again after parking so a wakeup in between is not missed.
+    if (self->busy_since_ns_.load() == 0) {
+      self->watchdog_parked_.store(true);
+      if (self->busy_since_ns_.load() == 0) {
+        g_cond_wait(&self->cond_, &self->mutex_);
+      }
+      self->watchdog_parked_.store(false);
+      continue;
+    }
+
+    // Look again when the current iteration would reach the threshold, or a
+    // threshold later while a stall already warned about goes on
+    guint64 now = ScopedCallTimer::NowNs();
+    guint64 since = self->busy_since_ns_.load();
+    if (since == 0) {
+      continue;
+    }
+    guint64 busy_ns = now > since ? now - since : 0;
+    if (busy_ns < self->threshold_ns_ || since == warned_since) {
+      guint64 wait_ns =
+          busy_ns < self->threshold_ns_ ? self->threshold_ns_ - busy_ns : self->threshold_ns_;
+      g_cond_wait_until(&self->cond_, &self->mutex_,
+                        g_get_monotonic_time() + wait_ns / 1000 + 1);
+      continue;
+    }
+    warned_since = since;
+
+    guint waiting = 0;
+    std::string first_member;
+    g_mutex_lock(&self->waiting_calls_->mutex);
+    self->waiting_calls_->ForEachSince(since, [&](const WaitingCallLog::Call& call) {
+      if (waiting++ == 0) {
+        first_member = call.member;
+      }
+    });
+    g_mutex_unlock(&self->waiting_calls_->mutex);
+
+    // The mainloop category writes at most one of these every 10 seconds
+    OS_MEDIA_CONTROLS_WARNING(kMainLoop, nullptr,
+                              "Main loop has not dispatched for %" G_GUINT64_FORMAT
+                              " ms; %u D-Bus calls waiting%s%s",
+                              busy_ns / 1000000, waiting, waiting > 0 ? ", first " : "",
+                              first_member.c_str());
+  }
+  g_mutex_unlock(&self->mutex_);
+  return nullptr;
+}
+
+GDBusMessage* StallDetector::FilterMessage(GDBusConnection* connection,
+                                           GDBusMessage* message,
+                                           gboolean incoming,
+                                           gpointer user_data) {
+  if (!incoming || g_dbus_message_get_message_type(message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL ||
+      !g_str_has_prefix(g_dbus_message_get_path(message), "/org/mpris/MediaPlayer2")) {
+    return message;
+  }
+
+  auto* log = static_cast<WaitingCallLog*>(user_data);
+  guint64 now = ScopedCallTimer::NowNs();
+  const char* member = g_dbus_message_get_member(message);
+  g_mutex_lock(&log->mutex);
+  WaitingCallLog::Call& call = log->calls[log->next];
+  call.time_ns = now;
+  g_strlcpy(call.member, member ? member : "", sizeof(call.member));
+  log->next = (log->next + 1) % kWaitingCallCapacity;
+  log->size = std::min(log->size + 1, kWaitingCallCapacity);
+  g_mutex_unlock(&log->mutex);
+  return message;
+}
+
+}  // namespace os_media_controls
@@ -0,0 +1,78 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STALL_DETECTOR_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STALL_DETECTOR_H_
+
+#include "os_media_controls/os_media_controls_core.h"
+
+#include <gio/gio.h>
+
+#include <atomic>
+
+namespace os_media_controls {
+
+struct WaitingCallLog;
+
+// Measures how long the default main context goes without dispatching.
+//
+// A source on the main context that never dispatches stamps the time the
+// context wakes from poll and clears the stamp when it is about to poll
+// again. Time in between is spent dispatching or outside the loop; when it
+// reaches the threshold it is recorded as a stall together with the D-Bus
+// calls that arrived during it (seen by a connection filter, which runs on
+// GDBus's worker thread). A watchdog thread notices stalls while they are
+// still going on and logs a rate-limited warning.
+//
+// Nothing here wakes an idle loop: the stamps are taken on iterations that
+// run anyway, and the watchdog sleeps without a timeout while the loop polls.
+class StallDetector {
+ public:
+  // connection may be nullptr, in which case waiting calls are not tracked
+  StallDetector(GDBusConnection* connection, guint threshold_ms);
+  ~StallDetector();
+
+  // Disallow copy and assign.
+  StallDetector(const StallDetector&) = delete;
+  StallDetector& operator=(const StallDetector&) = delete;
+
+  guint threshold_ms() const { return threshold_ms_; }
+
+  // Track calls on another connection (or none) from now on, e.g. after the
+  // bus reconnected. Main thread only.
+  void SetConnection(GDBusConnection* connection);
+
+  // Main thread only
+  void GetStats(MediaControlsCore::StallStats* stats) const;
+
+ private:
+  static gboolean Prepare(GSource* source, gint* timeout);
+  static gboolean Check(GSource* source);
+  static gboolean Dispatch(GSource* source, GSourceFunc callback, gpointer user_data);
+  static gpointer RunWatchdog(gpointer user_data);
+  static GDBusMessage* FilterMessage(GDBusConnection* connection,
+                                     GDBusMessage* message,
+                                     gboolean incoming,
+                                     gpointer user_data);
+  void RecordStall(guint64 start_ns, guint64 end_ns);
+
+  guint threshold_ms_;
+  guint64 threshold_ns_;
+  GSource* source_;
+  std::atomic<guint64> busy_since_ns_;  // When the loop left poll, 0 while it polls
+  std::atomic<bool> watchdog_parked_;  // The watchdog waits for the loop to wake
+
+  GDBusConnection* connection_;
+  guint filter_id_;
+  WaitingCallLog* waiting_calls_;  // Shared with the connection filter, reference counted
+
+  // Watchdog thread
+  GThread* thread_;
+  GMutex mutex_;
+  GCond cond_;
+  bool stop_;  // Guarded by mutex_
+
+  // Main thread
+  MediaControlsCore::StallStats stats_;
+};
+
+}  // namespace os_media_controls
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STALL_DETECTOR_H_
@@ -0,0 +1,214 @@
+#include "state_file.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Attempts a reader makes before giving up on a writer that keeps the
+// sequence odd (it normally stays odd for well under a microsecond)
+static constexpr int kMaxReadAttempts = 10000;
+
+namespace os_media_controls {
+
+// Copy src into a fixed-size, NUL-terminated field without splitting a
+// multi-byte UTF-8 sequence. The rest of the field is zeroed.
+static void CopyStateString(char* dest, size_t size, const std::string& src) {
+  size_t length = std::min(src.size(), size - 1);
+  if (length < src.size()) {
+    while (length > 0 && (static_cast<unsigned char>(src[length]) & 0xC0) == 0x80) {
+      length--;
+    }
+  }
+  memcpy(dest, src.data(), length);
+  memset(dest + length, 0, size - length);
+}
+
+StateFileWriter::StateFileWriter() : layout_(nullptr) {}
+
+StateFileWriter::~StateFileWriter() {
+  Close();
+}
+
+bool StateFileWriter::Open(const std::string& path) {
+  Close();
+
+  // Build the file under a temporary name so readers never map a file whose
+  // header is not initialized yet
+  std::string temp_path = path + ".tmp";
+  int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  if (ftruncate(fd, sizeof(OsMediaControlsStateLayout)) != 0) {
+    close(fd);
+    unlink(temp_path.c_str());
+    return false;
+  }
+
+  void* mapping = mmap(nullptr, sizeof(OsMediaControlsStateLayout),
+                       PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+
+  layout_ = static_cast<OsMediaControlsStateLayout*>(mapping);
+  layout_->magic = OS_MEDIA_CONTROLS_STATE_MAGIC;
+  layout_->version = OS_MEDIA_CONTROLS_STATE_VERSION;
+  layout_->sequence = 0;
+  layout_->state.pid = getpid();
+  layout_->state.rate = 1.0;
+
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    munmap(layout_, sizeof(OsMediaControlsStateLayout));
+    layout_ = nullptr;
+    unlink(temp_path.c_str());
+    return false;
+  }
+
+  path_ = path;
+  return true;
+}
+
+void StateFileWriter::Close() {
+  if (layout_) {
+    munmap(layout_, sizeof(OsMediaControlsStateLayout));
+    layout_ = nullptr;
+  }
+
+  if (!path_.empty()) {
+    unlink(path_.c_str());
+    path_.clear();
+  }
+}
+
+void StateFileWriter::Publish(OsMediaControlsStatus status,
+                              int64_t position_us,
+                              int64_t anchor_time_us,
+                              double rate,
+                              const std::string& title,
+                              const std::string& artist,
+                              const std::string& art_url) {
+  if (!layout_) {
+    return;
+  }
+
+  // Odd sequence: readers that overlap this write will retry
+  uint32_t sequence = __atomic_load_n(&layout_->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&layout_->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  OsMediaControlsState& state = layout_->state;
+  state.generation++;
+  state.status = status;
+  state.position_us = position_us;
+  state.anchor_time_us = anchor_time_us;
+  state.rate = rate;
+  CopyStateString(state.title, sizeof(state.title), title);
+  CopyStateString(state.artist, sizeof(state.artist), artist);
+  CopyStateString(state.art_url, sizeof(state.art_url), art_url);
+
+  __atomic_store_n(&layout_->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+}  // namespace os_media_controls
+
+struct _OsMediaControlsStateReader {
+  const OsMediaControlsStateLayout* layout;
+};
+
+OsMediaControlsStateReader* os_media_controls_state_reader_open(const char* path) {
+  if (!path) {
+    return nullptr;
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(OsMediaControlsStateLayout))) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* mapping = mmap(nullptr, sizeof(OsMediaControlsStateLayout), PROT_READ,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+
+  auto* layout = static_cast<const OsMediaControlsStateLayout*>(mapping);
+  if (layout->magic != OS_MEDIA_CONTROLS_STATE_MAGIC) {
+    munmap(mapping, sizeof(OsMediaControlsStateLayout));
+    return nullptr;
+  }
+
+  auto* reader = static_cast<OsMediaControlsStateReader*>(
+      malloc(sizeof(OsMediaControlsStateReader)));
+  if (!reader) {
+    munmap(mapping, sizeof(OsMediaControlsStateLayout));
+    return nullptr;
+  }
+  reader->layout = layout;
+  return reader;
+}
+
+void os_media_controls_state_reader_close(OsMediaControlsStateReader* reader) {
+  if (!reader) {
+    return;
+  }
+  munmap(const_cast<OsMediaControlsStateLayout*>(reader->layout),
+         sizeof(OsMediaControlsStateLayout));
+  free(reader);
+}
+
+bool os_media_controls_state_reader_read(OsMediaControlsStateReader* reader,
+                                         OsMediaControlsState* out) {
+  if (!reader || !out || reader->layout->version != OS_MEDIA_CONTROLS_STATE_VERSION) {
+    return false;
+  }
+
+  const OsMediaControlsStateLayout* layout = reader->layout;
+  for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+    uint32_t before = __atomic_load_n(&layout->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      sched_yield();
+      continue;
+    }
+
+    memcpy(out, &layout->state, sizeof(OsMediaControlsState));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t after = __atomic_load_n(&layout->sequence, __ATOMIC_RELAXED);
+    if (before == after) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int64_t os_media_controls_state_position_at(const OsMediaControlsState* state,
+                                            int64_t now_us) {
+  if (!state) {
+    return 0;
+  }
+  if (state->status != OS_MEDIA_CONTROLS_STATUS_PLAYING) {
+    return state->position_us;
+  }
+  return state->position_us +
+         static_cast<int64_t>((now_us - state->anchor_time_us) * state->rate);
+}
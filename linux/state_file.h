@@ -0,0 +1,44 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_FILE_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_FILE_H_
+
+#include "os_media_controls/os_media_controls_state.h"
+
+#include <string>
+
+namespace os_media_controls {
+
+// Single writer side of the memory-mapped state file
+class StateFileWriter {
+ public:
+  StateFileWriter();
+  ~StateFileWriter();
+
+  // Disallow copy and assign.
+  StateFileWriter(const StateFileWriter&) = delete;
+  StateFileWriter& operator=(const StateFileWriter&) = delete;
+
+  // Create the file at path (replacing any existing one) and map it
+  bool Open(const std::string& path);
+
+  // Unmap and remove the file
+  void Close();
+
+  bool IsOpen() const { return layout_ != nullptr; }
+
+  // Publish a new state under the seqlock and bump the generation
+  void Publish(OsMediaControlsStatus status,
+               int64_t position_us,
+               int64_t anchor_time_us,
+               double rate,
+               const std::string& title,
+               const std::string& artist,
+               const std::string& art_url);
+
+ private:
+  std::string path_;
+  OsMediaControlsStateLayout* layout_;
+};
+
+}  // namespace os_media_controls
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_FILE_H_
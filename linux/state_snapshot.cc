@@ -0,0 +1,332 @@
+#include "state_snapshot.h"
+
+#include "log.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <cerrno>
+#include <utility>
+
+// File holding the serialized snapshot inside the snapshot directory
+static const char kSnapshotFile[] = "snapshot";
+
+// Prefix of stored artwork files, followed by the SHA-1 of the image
+static const char kArtworkPrefix[] = "artwork_";
+
+// Bumped whenever kSnapshotType changes; other versions are ignored
+static constexpr guint32 kSnapshotVersion = 1;
+
+// version, status, position, rate, metadata, track id, art URL, artwork key, controls
+static const char kSnapshotType[] = "(usdda{ss}sssu)";
+
+// Quiet period before a change is captured
+static constexpr guint kSnapshotDelayMs = 1000;
+
+// Minimum time between snapshots that only differ in position
+static constexpr gint64 kPositionIntervalMs = 30000;
+
+namespace os_media_controls {
+
+// Everything but the position (and artwork bytes, compared via artwork_changed)
+static bool SameExceptPosition(const PlayerSnapshot& a, const PlayerSnapshot& b) {
+  return a.playback_status == b.playback_status && a.rate == b.rate &&
+         a.metadata == b.metadata && a.track_id == b.track_id && a.art_url == b.art_url &&
+         a.controls == b.controls && !b.artwork_changed;
+}
+
+StateSnapshot::StateSnapshot(const std::string& directory,
+                             const std::string& artwork_key,
+                             Capture capture)
+    : directory_(directory),
+      capture_(std::move(capture)),
+      timeout_id_(0),
+      last_(),
+      has_last_(false),
+      last_submit_time_(0),
+      thread_(nullptr),
+      artwork_key_(artwork_key),
+      stop_(false),
+      stats_() {
+  g_mutex_init(&mutex_);
+  g_cond_init(&cond_);
+  thread_ = g_thread_new("omc-state-snapshot", RunWorker, this);
+}
+
+StateSnapshot::~StateSnapshot() {
+  if (timeout_id_ > 0) {
+    g_source_remove(timeout_id_);
+    timeout_id_ = 0;
+  }
+
+  g_mutex_lock(&mutex_);
+  stop_ = true;
+  g_cond_signal(&cond_);
+  g_mutex_unlock(&mutex_);
+  g_thread_join(thread_);
+
+  g_cond_clear(&cond_);
+  g_mutex_clear(&mutex_);
+}
+
+std::string StateSnapshot::DefaultDirectory() {
+  const char* program = g_get_prgname();
+  g_autofree gchar* directory = g_build_filename(
+      g_get_user_cache_dir(), "os_media_controls", program && *program ? program : "default",
+      nullptr);
+  return directory;
+}
+
+bool StateSnapshot::Exists(const std::string& directory) {
+  g_autofree gchar* path = g_build_filename(directory.c_str(), kSnapshotFile, nullptr);
+  return g_file_test(path, G_FILE_TEST_IS_REGULAR);
+}
+
+bool StateSnapshot::Load(const std::string& directory, PlayerSnapshot* snapshot) {
+  g_autofree gchar* path = g_build_filename(directory.c_str(), kSnapshotFile, nullptr);
+  g_autoptr(GError) error = nullptr;
+  GMappedFile* mapped = g_mapped_file_new(path, FALSE, &error);
+  if (!mapped) {
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      OS_MEDIA_CONTROLS_WARNING(kState, nullptr, "Failed to map state snapshot %s: %s", path,
+                                error->message);
+    }
+    return false;
+  }
+
+  // The variant references the mapping; a truncated or corrupt file reads as
+  // default values and fails the version check
+  g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+  g_autoptr(GVariant) variant =
+      g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(kSnapshotType), bytes, FALSE));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant* swapped = g_variant_byteswap(variant);
+    g_variant_unref(variant);
+    variant = swapped;
+  }
+
+  guint32 version = 0;
+  const gchar* status;
+  const gchar* track_id;
+  const gchar* art_url;
+  const gchar* artwork_key;
+  g_autoptr(GVariantIter) metadata = nullptr;
+  g_variant_get(variant, "(u&sdda{ss}&s&s&su)", &version, &status, &snapshot->position,
+                &snapshot->rate, &metadata, &track_id, &art_url, &artwork_key,
+                &snapshot->controls);
+  if (version != kSnapshotVersion) {
+    return false;
+  }
+
+  snapshot->playback_status = status;
+  snapshot->track_id = track_id;
+  snapshot->art_url = art_url;
+  snapshot->metadata.clear();
+  const gchar* key;
+  const gchar* value;
+  while (g_variant_iter_next(metadata, "{&s&s}", &key, &value)) {
+    snapshot->metadata[key] = value;
+  }
+
+  // Stored artwork replaces the URL if it is still there
+  snapshot->artwork_key.clear();
+  if (*artwork_key) {
+    std::string file = directory + "/" + kArtworkPrefix + artwork_key;
+    if (g_file_test(file.c_str(), G_FILE_TEST_IS_REGULAR)) {
+      snapshot->artwork_key = artwork_key;
+      snapshot->art_url = "file://" + file;
+    }
+  }
+  snapshot->artwork_changed = false;
+  snapshot->artwork.clear();
+  return true;
+}
+
+void StateSnapshot::Remove(const std::string& directory) {
+  GDir* dir = g_dir_open(directory.c_str(), 0, nullptr);
+  if (!dir) {
+    return;
+  }
+
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != nullptr) {
+    // Including temporary files of an interrupted write
+    if (g_str_has_prefix(name, kArtworkPrefix) || g_str_has_prefix(name, kSnapshotFile)) {
+      g_autofree gchar* path = g_build_filename(directory.c_str(), name, nullptr);
+      g_unlink(path);
+    }
+  }
+  g_dir_close(dir);
+  g_rmdir(directory.c_str());
+}
+
+void StateSnapshot::MarkDirty() {
+  if (timeout_id_ == 0) {
+    timeout_id_ = g_timeout_add(kSnapshotDelayMs, HandleTimeout, this);
+  }
+}
+
+void StateSnapshot::Flush() {
+  if (timeout_id_ > 0) {
+    g_source_remove(timeout_id_);
+    timeout_id_ = 0;
+  }
+
+  auto snapshot = std::make_unique<PlayerSnapshot>();
+  capture_(snapshot.get());
+  if (has_last_ && SameExceptPosition(last_, *snapshot) &&
+      last_.position == snapshot->position) {
+    return;
+  }
+  Submit(std::move(snapshot));
+}
+
+StateSnapshot::Stats StateSnapshot::GetStats() {
+  g_mutex_lock(&mutex_);
+  Stats stats = stats_;
+  g_mutex_unlock(&mutex_);
+  return stats;
+}
+
+gboolean StateSnapshot::HandleTimeout(gpointer user_data) {
+  auto* self = static_cast<StateSnapshot*>(user_data);
+  self->timeout_id_ = 0;
+
+  auto snapshot = std::make_unique<PlayerSnapshot>();
+  self->capture_(snapshot.get());
+
+  // Periodic position updates during playback only move the position, which
+  // is not worth a write every second
+  if (self->has_last_ && SameExceptPosition(self->last_, *snapshot)) {
+    if (self->last_.position == snapshot->position) {
+      return G_SOURCE_REMOVE;
+    }
+    gint64 since_ms = (g_get_monotonic_time() - self->last_submit_time_) / 1000;
+    if (since_ms < kPositionIntervalMs) {
+      self->timeout_id_ = g_timeout_add(static_cast<guint>(kPositionIntervalMs - since_ms),
+                                        HandleTimeout, self);
+      return G_SOURCE_REMOVE;
+    }
+  }
+
+  self->Submit(std::move(snapshot));
+  return G_SOURCE_REMOVE;
+}
+
+// Hand a snapshot to the worker, replacing one it has not started on
+void StateSnapshot::Submit(std::unique_ptr<PlayerSnapshot> snapshot) {
+  std::vector<uint8_t> artwork = std::move(snapshot->artwork);
+  last_ = *snapshot;
+  last_.artwork_changed = false;
+  snapshot->artwork = std::move(artwork);
+  has_last_ = true;
+  last_submit_time_ = g_get_monotonic_time();
+
+  g_mutex_lock(&mutex_);
+  if (pending_ && pending_->artwork_changed && !snapshot->artwork_changed) {
+    snapshot->artwork_changed = true;
+    snapshot->artwork = std::move(pending_->artwork);
+  }
+  pending_ = std::move(snapshot);
+  g_cond_signal(&cond_);
+  g_mutex_unlock(&mutex_);
+}
+
+gpointer StateSnapshot::RunWorker(gpointer user_data) {
+  auto* self = static_cast<StateSnapshot*>(user_data);
+
+  g_mutex_lock(&self->mutex_);
+  while (true) {
+    while (!self->pending_ && !self->stop_) {
+      g_cond_wait(&self->cond_, &self->mutex_);
+    }
+    if (!self->pending_) {
+      break;
+    }
+
+    std::unique_ptr<PlayerSnapshot> snapshot = std::move(self->pending_);
+    g_mutex_unlock(&self->mutex_);
+    guint64 bytes = 0;
+    bool written = self->WriteFiles(snapshot.get(), &bytes);
+    g_mutex_lock(&self->mutex_);
+
+    if (written) {
+      self->stats_.writes++;
+    } else {
+      self->stats_.write_failures++;
+    }
+    self->stats_.bytes_written += bytes;
+  }
+  g_mutex_unlock(&self->mutex_);
+  return nullptr;
+}
+
+// Worker thread: store new artwork, then replace the snapshot, then drop the
+// artwork it no longer refers to, so the file on disk is always complete
+bool StateSnapshot::WriteFiles(PlayerSnapshot* snapshot, guint64* bytes) {
+  if (g_mkdir_with_parents(directory_.c_str(), 0700) != 0) {
+    OS_MEDIA_CONTROLS_WARNING(kState, nullptr, "Failed to create state snapshot directory %s: %s",
+                              directory_.c_str(), g_strerror(errno));
+    return false;
+  }
+
+  std::string old_key = artwork_key_;
+  if (snapshot->artwork_changed) {
+    artwork_key_.clear();
+    if (!snapshot->artwork.empty()) {
+      g_autofree gchar* key = g_compute_checksum_for_data(
+          G_CHECKSUM_SHA1, snapshot->artwork.data(), snapshot->artwork.size());
+      std::string path = directory_ + "/" + kArtworkPrefix + key;
+      g_autoptr(GError) error = nullptr;
+      if (g_file_test(path.c_str(), G_FILE_TEST_IS_REGULAR)) {
+        artwork_key_ = key;
+      } else if (g_file_set_contents(path.c_str(),
+                                     reinterpret_cast<const gchar*>(snapshot->artwork.data()),
+                                     snapshot->artwork.size(), &error)) {
+        artwork_key_ = key;
+        *bytes += snapshot->artwork.size();
+      } else {
+        OS_MEDIA_CONTROLS_WARNING(kState, nullptr, "Failed to store snapshot artwork: %s",
+                                  error->message);
+      }
+    }
+  }
+
+  GVariantBuilder metadata;
+  g_variant_builder_init(&metadata, G_VARIANT_TYPE("a{ss}"));
+  for (const auto& entry : snapshot->metadata) {
+    g_variant_builder_add(&metadata, "{ss}", entry.first.c_str(), entry.second.c_str());
+  }
+
+  // Snapshots are stored little-endian
+  g_autoptr(GVariant) variant = g_variant_ref_sink(g_variant_new(
+      kSnapshotType, kSnapshotVersion, snapshot->playback_status.c_str(), snapshot->position,
+      snapshot->rate, &metadata, snapshot->track_id.c_str(), snapshot->art_url.c_str(),
+      artwork_key_.c_str(), snapshot->controls));
+  g_autoptr(GVariant) normal = g_variant_get_normal_form(variant);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    g_autoptr(GVariant) swapped = g_variant_byteswap(normal);
+    std::swap(normal, swapped);
+  }
+
+  // g_file_set_contents writes a temporary file and renames it over the old one
+  g_autofree gchar* path = g_build_filename(directory_.c_str(), kSnapshotFile, nullptr);
+  g_autoptr(GError) error = nullptr;
+  gsize size = g_variant_get_size(normal);
+  if (!g_file_set_contents(path, static_cast<const gchar*>(g_variant_get_data(normal)), size,
+                           &error)) {
+    OS_MEDIA_CONTROLS_WARNING(kState, nullptr, "Failed to write state snapshot %s: %s", path,
+                              error->message);
+    return false;
+  }
+  *bytes += size;
+
+  if (!old_key.empty() && old_key != artwork_key_) {
+    std::string old_path = directory_ + "/" + kArtworkPrefix + old_key;
+    g_unlink(old_path.c_str());
+  }
+  return true;
+}
+
+}  // namespace os_media_controls
@@ -0,0 +1,106 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_SNAPSHOT_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_SNAPSHOT_H_
+
+#include <glib.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace os_media_controls {
+
+// Player state kept across restarts
+struct PlayerSnapshot {
+  std::string playback_status;  // "Playing", "Paused" or "Stopped"
+  double position;  // Microseconds
+  double rate;
+  std::map<std::string, std::string> metadata;
+  std::string track_id;  // mpris:trackid object path
+  std::string art_url;  // Artwork URL when the player has no binary artwork
+  guint32 controls;  // OsMediaControlsControl mask
+  std::string artwork_key;  // SHA-1 of the stored binary artwork, set by Load()
+
+  // Binary artwork, only copied when it changed since the last capture
+  bool artwork_changed;
+  std::vector<uint8_t> artwork;
+};
+
+// Opt-in snapshot of the last published state under
+// $XDG_CACHE_HOME/os_media_controls/<program>/, so a restarted player can show
+// it before the app has set anything.
+//
+// The snapshot is one little-endian GVariant, mapped rather than read when
+// loading. Binary artwork is stored next to it under its SHA-1, so an
+// unchanged cover is written once. Changes are coalesced on the main loop and
+// written atomically by a worker thread; updates that only move the position
+// are written at most every kPositionIntervalMs.
+class StateSnapshot {
+ public:
+  using Capture = std::function<void(PlayerSnapshot* snapshot)>;
+
+  struct Stats {
+    guint64 writes;
+    guint64 write_failures;
+    guint64 bytes_written;  // Snapshot and artwork files
+  };
+
+  // artwork_key is the stored artwork the snapshot on disk refers to
+  StateSnapshot(const std::string& directory, const std::string& artwork_key, Capture capture);
+
+  // Writes snapshots already handed to the worker, then stops it
+  ~StateSnapshot();
+
+  // Disallow copy and assign.
+  StateSnapshot(const StateSnapshot&) = delete;
+  StateSnapshot& operator=(const StateSnapshot&) = delete;
+
+  static std::string DefaultDirectory();
+
+  // Whether persistence was enabled for directory (a snapshot file exists)
+  static bool Exists(const std::string& directory);
+
+  // Map and decode the snapshot; false if it is missing or unreadable
+  static bool Load(const std::string& directory, PlayerSnapshot* snapshot);
+
+  // Delete the snapshot and stored artwork
+  static void Remove(const std::string& directory);
+
+  // The player state changed; capture it once the change settles
+  void MarkDirty();
+
+  // Capture now if anything differs from the last written snapshot
+  void Flush();
+
+  Stats GetStats();
+
+ private:
+  static gboolean HandleTimeout(gpointer user_data);
+  static gpointer RunWorker(gpointer user_data);
+  void Submit(std::unique_ptr<PlayerSnapshot> snapshot);
+  bool WriteFiles(PlayerSnapshot* snapshot, guint64* bytes);
+
+  std::string directory_;
+  Capture capture_;
+
+  // Main thread
+  guint timeout_id_;
+  PlayerSnapshot last_;  // Last snapshot handed to the worker, without artwork
+  bool has_last_;
+  gint64 last_submit_time_;
+
+  // Worker thread
+  GThread* thread_;
+  std::string artwork_key_;
+
+  GMutex mutex_;
+  GCond cond_;
+  std::unique_ptr<PlayerSnapshot> pending_;  // Guarded by mutex_
+  bool stop_;  // Guarded by mutex_
+  Stats stats_;  // Guarded by mutex_
+};
+
+}  // namespace os_media_controls
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_STATE_SNAPSHOT_H_
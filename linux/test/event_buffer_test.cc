@@ -0,0 +1,116 @@
+// Regression tests for the plugin's buffer of events that arrive while Dart is
+// not listening.
+//
+// The plugin is constructed without an event channel, so events are fed to
+// BufferEvent directly and never leave the buffer; no Flutter engine is
+// needed. Only built in an application build, which provides flutter_linux.
+
+#include "os_media_controls/os_media_controls_plugin.h"
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <string>
+#include <vector>
+
+namespace os_media_controls {
+
+class EventBufferTest {
+ public:
+  EventBufferTest() : plugin_(nullptr, nullptr) {}
+
+  void Buffer(const char* type) {
+    FlValue* event = fl_value_new_map();
+    fl_value_set_string_take(event, "type", fl_value_new_string(type));
+    plugin_.BufferEvent(event);
+  }
+
+  // Types of the buffered events, oldest first
+  std::vector<std::string> Pending() {
+    std::vector<std::string> types;
+    size_t capacity = plugin_.pending_events_.size();
+    for (size_t i = 0; i < plugin_.pending_count_; i++) {
+      FlValue* event = plugin_.pending_events_[(plugin_.pending_head_ + i) % capacity].event;
+      g_assert_nonnull(event);
+      types.push_back(fl_value_get_string(fl_value_lookup_string(event, "type")));
+    }
+    return types;
+  }
+
+  guint64 superseded() const { return plugin_.events_superseded_; }
+  guint64 evicted() const { return plugin_.events_evicted_; }
+  guint64 expired() const { return plugin_.events_expired_; }
+
+ private:
+  OsMediaControlsPluginImpl plugin_;
+};
+
+}  // namespace os_media_controls
+
+using os_media_controls::EventBufferTest;
+
+static std::string Join(const std::vector<std::string>& types) {
+  std::string joined;
+  for (const std::string& type : types) {
+    joined += joined.empty() ? type : "," + type;
+  }
+  return joined;
+}
+
+static void TestSupersededEventsFreeTheirSlots() {
+  EventBufferTest buffer;
+  buffer.Buffer("next");
+  for (int i = 0; i < 100; i++) {
+    buffer.Buffer("seek");
+  }
+
+  // A seek burst longer than the buffer keeps only the latest seek and never
+  // evicts the next that came before it
+  g_assert_cmpstr(Join(buffer.Pending()).c_str(), ==, "next,seek");
+  g_assert_cmpuint(buffer.superseded(), ==, 99);
+  g_assert_cmpuint(buffer.evicted(), ==, 0);
+  g_assert_cmpuint(buffer.expired(), ==, 0);
+}
+
+static void TestSupersedingKeepsOrder() {
+  EventBufferTest buffer;
+  for (const char* type : {"play", "next", "seek", "previous", "pause", "seek", "stop"}) {
+    buffer.Buffer(type);
+  }
+
+  g_assert_cmpstr(Join(buffer.Pending()).c_str(), ==, "next,previous,pause,seek,stop");
+}
+
+static void TestFullBufferEvictsOldest() {
+  EventBufferTest buffer;
+  for (int i = 0; i < 40; i++) {
+    buffer.Buffer(i % 2 == 0 ? "next" : "previous");
+  }
+
+  std::vector<std::string> pending = buffer.Pending();
+  g_assert_cmpuint(pending.size(), ==, 32);
+  g_assert_cmpstr(pending.front().c_str(), ==, "next");
+  g_assert_cmpuint(buffer.evicted(), ==, 8);
+  g_assert_cmpuint(buffer.superseded(), ==, 0);
+  g_assert_cmpuint(buffer.expired(), ==, 0);
+}
+
+int main(int argc, char** argv) {
+  g_test_init(&argc, &argv, nullptr);
+
+  // Keep the core's state out of the real user directories; it is never
+  // activated, so it writes nothing there
+  g_autofree gchar* runtime_dir = g_dir_make_tmp("os_media_controls_test.XXXXXX", nullptr);
+  g_assert_nonnull(runtime_dir);
+  g_setenv("XDG_RUNTIME_DIR", runtime_dir, TRUE);
+  g_setenv("XDG_CACHE_HOME", runtime_dir, TRUE);
+
+  g_test_add_func("/event-buffer/superseded-events-free-their-slots",
+                  TestSupersededEventsFreeTheirSlots);
+  g_test_add_func("/event-buffer/superseding-keeps-order", TestSupersedingKeepsOrder);
+  g_test_add_func("/event-buffer/full-buffer-evicts-oldest", TestFullBufferEvictsOldest);
+  int result = g_test_run();
+  g_rmdir(runtime_dir);
+  return result;
+}
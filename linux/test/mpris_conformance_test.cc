@@ -0,0 +1,1386 @@
+// MPRIS conformance and regression tests for the core's D-Bus surface.
+//
+// Every test hosts a fresh core on a private dbus-daemon (GTestDBus) and
+// talks to it from a separate client connection, so calls, property reads and
+// signals all cross the bus the way they do for a shell. Signal counts are
+// asserted exactly: a change that makes emission chattier fails here.
+//
+// Time-dependent behavior that compares timestamps (rate limiting, the
+// duplicate command window, position extrapolation) runs on a fake monotonic
+// clock. Coalescing and optimistic timeouts are main loop timers and use
+// short real windows instead.
+//
+// Exits with 77 (skipped) when dbus-daemon is not installed.
+
+#include "os_media_controls/os_media_controls_core.h"
+#include "log.h"
+#include "state_snapshot.h"
+#include "trace.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+static const char kBusName[] = "org.mpris.MediaPlayer2.OsMediaControls";
+static const char kObjectPath[] = "/org/mpris/MediaPlayer2";
+static const char kRootInterface[] = "org.mpris.MediaPlayer2";
+static const char kPlayerInterface[] = "org.mpris.MediaPlayer2.Player";
+static const char kNoTrackId[] = "/org/mpris/MediaPlayer2/TrackList/NoTrack";
+
+// Properties carried by every PropertiesChanged from UpdateMPRISProperties
+static const char kPlayerStateKeys[] =
+    "CanGoNext,CanGoPrevious,CanPause,CanPlay,CanSeek,PlaybackStatus,Rate";
+
+// A message from the core's logger, captured instead of printed
+struct LogRecord {
+  GLogLevelFlags level;
+  std::string message;
+  std::string category;
+  std::string key;
+  guint64 suppressed;
+};
+
+static GTestDBus* test_bus = nullptr;
+static GMutex log_mutex;  // The stall watchdog logs from its own thread
+static std::vector<LogRecord> log_records;
+static gint64 fake_now = 0;
+
+static gint64 FakeClock(gpointer user_data) {
+  return fake_now;
+}
+
+static GLogWriterOutput RecordLog(GLogLevelFlags level, const GLogField* fields,
+                                  gsize n_fields, gpointer user_data) {
+  LogRecord record = {level, "", "", "", 0};
+  bool ours = false;
+  for (gsize i = 0; i < n_fields; i++) {
+    if (fields[i].length != -1) {
+      continue;
+    }
+    const char* value = static_cast<const char*>(fields[i].value);
+    if (g_str_equal(fields[i].key, "GLIB_DOMAIN")) {
+      ours = g_strcmp0(value, "os_media_controls") == 0;
+    } else if (g_str_equal(fields[i].key, "MESSAGE")) {
+      record.message = value;
+    } else if (g_str_equal(fields[i].key, "OS_MEDIA_CONTROLS_CATEGORY")) {
+      record.category = value;
+    } else if (g_str_equal(fields[i].key, "OS_MEDIA_CONTROLS_KEY")) {
+      record.key = value;
+    } else if (g_str_equal(fields[i].key, "OS_MEDIA_CONTROLS_SUPPRESSED")) {
+      record.suppressed = g_ascii_strtoull(value, nullptr, 10);
+    }
+  }
+  if (!ours) {
+    return g_log_writer_default(level, fields, n_fields, user_data);
+  }
+
+  g_mutex_lock(&log_mutex);
+  log_records.push_back(record);
+  g_mutex_unlock(&log_mutex);
+  return G_LOG_WRITER_HANDLED;
+}
+
+// Captured messages whose text starts with prefix
+static std::vector<LogRecord> LogRecords(const char* prefix) {
+  std::vector<LogRecord> matching;
+  g_mutex_lock(&log_mutex);
+  for (const LogRecord& record : log_records) {
+    if (g_str_has_prefix(record.message.c_str(), prefix)) {
+      matching.push_back(record);
+    }
+  }
+  g_mutex_unlock(&log_mutex);
+  return matching;
+}
+
+struct Signal {
+  std::string name;
+  GVariant* parameters;
+};
+
+struct Fixture {
+  os_media_controls::MediaControlsCore* core = nullptr;
+  GDBusConnection* client = nullptr;
+  guint subscription = 0;
+  std::vector<Signal> signals;
+  std::vector<OsMediaControlsEvent> events;
+};
+
+struct CallResult {
+  bool done = false;
+  GVariant* reply = nullptr;
+  GError* error = nullptr;
+};
+
+static void HandleCallDone(GObject* source, GAsyncResult* result, gpointer user_data) {
+  auto* call = static_cast<CallResult*>(user_data);
+  call->reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &call->error);
+  call->done = true;
+}
+
+// Call a method from the client. The core runs on this thread too, so the
+// call is asynchronous and the main context is iterated until it completes.
+static GVariant* CallFull(Fixture* fixture, const char* bus_name, const char* object_path,
+                          const char* interface, const char* method, GVariant* parameters,
+                          GError** error) {
+  CallResult call;
+  g_dbus_connection_call(fixture->client, bus_name, object_path, interface, method, parameters,
+                         nullptr, G_DBUS_CALL_FLAGS_NONE, 5000, nullptr, HandleCallDone, &call);
+  while (!call.done) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  // Dispatch anything that arrived ahead of the reply (signals)
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  if (call.error) {
+    g_propagate_error(error, call.error);
+  }
+  return call.reply;
+}
+
+static GVariant* Call(Fixture* fixture, const char* interface, const char* method,
+                      GVariant* parameters, GError** error) {
+  return CallFull(fixture, kBusName, kObjectPath, interface, method, parameters, error);
+}
+
+// Call a method that must succeed, discarding the reply
+static void CallOk(Fixture* fixture, const char* interface, const char* method,
+                   GVariant* parameters) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) reply = Call(fixture, interface, method, parameters, &error);
+  g_assert_no_error(error);
+}
+
+static GVariant* GetProperty(Fixture* fixture, const char* interface, const char* name) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) reply =
+      Call(fixture, "org.freedesktop.DBus.Properties", "Get",
+           g_variant_new("(ss)", interface, name), &error);
+  g_assert_no_error(error);
+  GVariant* value = nullptr;
+  g_variant_get(reply, "(v)", &value);
+  return value;
+}
+
+// Compare against GVariant text format, e.g. "['file', 'http']"
+static void AssertVariant(GVariant* actual, const char* expected) {
+  g_assert_nonnull(actual);
+  g_autoptr(GVariant) expected_value = g_variant_ref_sink(g_variant_new_parsed(expected));
+  g_autofree gchar* actual_text = g_variant_print(actual, TRUE);
+  g_autofree gchar* expected_text = g_variant_print(expected_value, TRUE);
+  g_assert_cmpstr(actual_text, ==, expected_text);
+}
+
+static void AssertProperty(Fixture* fixture, const char* interface, const char* name,
+                           const char* expected) {
+  g_autoptr(GVariant) value = GetProperty(fixture, interface, name);
+  AssertVariant(value, expected);
+}
+
+// Sorted, comma separated keys of an a{sv}
+static std::string Keys(GVariant* dict) {
+  std::vector<std::string> keys;
+  GVariantIter iter;
+  const gchar* key;
+  g_variant_iter_init(&iter, dict);
+  while (g_variant_iter_next(&iter, "{&sv}", &key, nullptr)) {
+    keys.push_back(key);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::string joined;
+  for (const std::string& k : keys) {
+    joined += (joined.empty() ? "" : ",") + k;
+  }
+  return joined;
+}
+
+static void AssertEntry(GVariant* dict, const char* key, const char* expected) {
+  g_autoptr(GVariant) value = g_variant_lookup_value(dict, key, nullptr);
+  if (!value) {
+    g_error("%s missing from %s", key, g_variant_print(dict, TRUE));
+  }
+  AssertVariant(value, expected);
+}
+
+// Changed properties of the index-th signal, which must be a PropertiesChanged
+// for interface carrying exactly keys and no invalidated properties
+static GVariant* ChangedProperties(Fixture* fixture, size_t index, const char* interface,
+                                   const char* keys) {
+  g_assert_cmpuint(index, <, fixture->signals.size());
+  const Signal& signal = fixture->signals[index];
+  g_assert_cmpstr(signal.name.c_str(), ==, "PropertiesChanged");
+
+  const gchar* changed_interface;
+  GVariant* changed;
+  g_autoptr(GVariant) invalidated = nullptr;
+  g_variant_get(signal.parameters, "(&s@a{sv}@as)", &changed_interface, &changed,
+                &invalidated);
+  g_assert_cmpstr(changed_interface, ==, interface);
+  g_assert_cmpuint(g_variant_n_children(invalidated), ==, 0);
+  g_assert_cmpstr(Keys(changed).c_str(), ==, keys);
+  return changed;
+}
+
+// Round trip through the core so every signal it emitted so far has arrived
+static void Sync(Fixture* fixture) {
+  g_autoptr(GVariant) identity = GetProperty(fixture, kRootInterface, "Identity");
+}
+
+static void ClearSignals(Fixture* fixture) {
+  for (Signal& signal : fixture->signals) {
+    g_variant_unref(signal.parameters);
+  }
+  fixture->signals.clear();
+}
+
+static void HandleSignal(GDBusConnection* connection, const gchar* sender_name,
+                         const gchar* object_path, const gchar* interface_name,
+                         const gchar* signal_name, GVariant* parameters, gpointer user_data) {
+  auto* fixture = static_cast<Fixture*>(user_data);
+  fixture->signals.push_back({signal_name, g_variant_ref(parameters)});
+}
+
+// Run the main loop for the given real time, letting core timers fire
+static void RunFor(guint milliseconds) {
+  bool elapsed = false;
+  g_timeout_add(milliseconds, [](gpointer data) -> gboolean {
+    *static_cast<bool*>(data) = true;
+    return G_SOURCE_REMOVE;
+  }, &elapsed);
+  while (!elapsed) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+}
+
+static bool HasName(Fixture* fixture) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) reply = CallFull(
+      fixture, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+      "NameHasOwner", g_variant_new("(s)", kBusName), &error);
+  g_assert_no_error(error);
+  gboolean has_owner = FALSE;
+  g_variant_get(reply, "(b)", &has_owner);
+  return has_owner;
+}
+
+// Wait until the core owns its bus name, which it requests asynchronously
+static void WaitForName(Fixture* fixture) {
+  bool has_owner = HasName(fixture);
+  for (int i = 0; i < 500 && !has_owner; i++) {
+    RunFor(10);
+    has_owner = HasName(fixture);
+  }
+  g_assert_true(has_owner);
+}
+
+static void ConnectClient(Fixture* fixture) {
+  g_autoptr(GError) error = nullptr;
+  fixture->client = g_dbus_connection_new_for_address_sync(
+      g_test_dbus_get_bus_address(test_bus),
+      static_cast<GDBusConnectionFlags>(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                        G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+      nullptr, nullptr, &error);
+  g_assert_no_error(error);
+
+  fixture->subscription = g_dbus_connection_signal_subscribe(
+      fixture->client, kBusName, nullptr, nullptr, kObjectPath, nullptr,
+      G_DBUS_SIGNAL_FLAGS_NONE, HandleSignal, fixture, nullptr);
+}
+
+static void DisconnectClient(Fixture* fixture) {
+  g_dbus_connection_signal_unsubscribe(fixture->client, fixture->subscription);
+  g_dbus_connection_close_sync(fixture->client, nullptr, nullptr);
+  g_clear_object(&fixture->client);
+}
+
+static void SetUp(Fixture* fixture, gconstpointer user_data) {
+  new (fixture) Fixture();
+  fake_now = 1000 * G_USEC_PER_SEC;
+  os_media_controls::ResetLog();
+  g_mutex_lock(&log_mutex);
+  log_records.clear();
+  g_mutex_unlock(&log_mutex);
+
+  fixture->core = new os_media_controls::MediaControlsCore();
+  fixture->core->SetMonotonicClock(FakeClock, nullptr);
+  fixture->core->SetEventCallback([fixture](const OsMediaControlsEvent& event) {
+    fixture->events.push_back(event);
+  });
+
+  ConnectClient(fixture);
+  fixture->core->Activate();
+  WaitForName(fixture);
+
+  // Drop anything a previous test's core left in flight
+  Sync(fixture);
+  ClearSignals(fixture);
+}
+
+static void TearDown(Fixture* fixture, gconstpointer user_data) {
+  DisconnectClient(fixture);
+  delete fixture->core;
+  ClearSignals(fixture);
+  fixture->~Fixture();
+}
+
+static void TestRootProperties(Fixture* fixture, gconstpointer user_data) {
+  AssertProperty(fixture, kRootInterface, "CanQuit", "false");
+  AssertProperty(fixture, kRootInterface, "CanRaise", "false");
+  AssertProperty(fixture, kRootInterface, "HasTrackList", "false");
+  AssertProperty(fixture, kRootInterface, "Identity", "'MPRIS conformance test'");
+  AssertProperty(fixture, kRootInterface, "SupportedUriSchemes", "['file', 'http', 'https']");
+  AssertProperty(fixture, kRootInterface, "SupportedMimeTypes",
+                 "['audio/mpeg', 'audio/flac', 'audio/wav']");
+  g_assert_cmpuint(fixture->signals.size(), ==, 0);
+}
+
+static void TestPlayerDefaults(Fixture* fixture, gconstpointer user_data) {
+  AssertProperty(fixture, kPlayerInterface, "PlaybackStatus", "'Stopped'");
+  AssertProperty(fixture, kPlayerInterface, "Rate", "1.0");
+  AssertProperty(fixture, kPlayerInterface, "MinimumRate", "0.1");
+  AssertProperty(fixture, kPlayerInterface, "MaximumRate", "10.0");
+  AssertProperty(fixture, kPlayerInterface, "Volume", "1.0");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 0");
+  AssertProperty(fixture, kPlayerInterface, "CanGoNext", "false");
+  AssertProperty(fixture, kPlayerInterface, "CanGoPrevious", "false");
+  AssertProperty(fixture, kPlayerInterface, "CanPlay", "true");
+  AssertProperty(fixture, kPlayerInterface, "CanPause", "true");
+  AssertProperty(fixture, kPlayerInterface, "CanSeek", "false");
+  AssertProperty(fixture, kPlayerInterface, "CanControl", "true");
+
+  g_autoptr(GVariant) metadata = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertVariant(metadata, "{'mpris:trackid': <objectpath '/org/mpris/MediaPlayer2/TrackList/NoTrack'>}");
+  g_assert_cmpuint(fixture->signals.size(), ==, 0);
+}
+
+static void TestGetAllMatchesGet(Fixture* fixture, gconstpointer user_data) {
+  for (const char* interface : {kRootInterface, kPlayerInterface}) {
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(GVariant) reply = Call(fixture, "org.freedesktop.DBus.Properties", "GetAll",
+                                     g_variant_new("(s)", interface), &error);
+    g_assert_no_error(error);
+    g_autoptr(GVariant) all = g_variant_get_child_value(reply, 0);
+
+    GVariantIter iter;
+    const gchar* name;
+    GVariant* value;
+    g_variant_iter_init(&iter, all);
+    while (g_variant_iter_next(&iter, "{&sv}", &name, &value)) {
+      g_autoptr(GVariant) single = GetProperty(fixture, interface, name);
+      g_autofree gchar* text = g_variant_print(value, TRUE);
+      AssertVariant(single, text);
+      g_variant_unref(value);
+    }
+  }
+}
+
+static void TestUnknownProperty(Fixture* fixture, gconstpointer user_data) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) reply = Call(fixture, "org.freedesktop.DBus.Properties", "Get",
+                                   g_variant_new("(ss)", kPlayerInterface, "Shuffle"), &error);
+  g_assert_null(reply);
+  g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY);
+}
+
+static void TestSetMetadata(Fixture* fixture, gconstpointer user_data) {
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Hoppípolla";
+  metadata.artist = "Sigur Rós";
+  metadata.album = "Takk...";
+  metadata.album_artist = "Sigur Rós";
+  metadata.duration = 268.5;
+  metadata.track_id = "abc";
+  metadata.artwork_url = "https://example.com/takk.jpg";
+  fixture->core->SetMetadata(metadata);
+  Sync(fixture);
+
+  // Exactly one signal, carrying only Metadata
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+  g_autoptr(GVariant) changed =
+      ChangedProperties(fixture, 0, kPlayerInterface, "Metadata");
+  g_autoptr(GVariant) signalled = g_variant_lookup_value(changed, "Metadata", nullptr);
+
+  g_autoptr(GVariant) current = GetProperty(fixture, kPlayerInterface, "Metadata");
+  for (GVariant* dict : {signalled, current}) {
+    g_assert_cmpstr(Keys(dict).c_str(), ==,
+                    "mpris:artUrl,mpris:length,mpris:trackid,xesam:album,xesam:albumArtist,"
+                    "xesam:artist,xesam:title");
+    AssertEntry(dict, "xesam:title", "'Hoppípolla'");
+    AssertEntry(dict, "xesam:artist", "['Sigur Rós']");
+    AssertEntry(dict, "xesam:album", "'Takk...'");
+    AssertEntry(dict, "xesam:albumArtist", "['Sigur Rós']");
+    AssertEntry(dict, "mpris:length", "int64 268500000");
+    AssertEntry(dict, "mpris:artUrl", "'https://example.com/takk.jpg'");
+    AssertEntry(dict, "mpris:trackid", "objectpath '/org/mpris/MediaPlayer2/Track/app_abc'");
+  }
+}
+
+static void TestMetadataInvalidUtf8(Fixture* fixture, gconstpointer user_data) {
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "bad \xff title";
+  metadata.artist = "bad \xfe artist";
+
+  fixture->core->SetMetadata(metadata);
+  Sync(fixture);
+
+  // Invalid titles become empty strings; invalid artists are left out
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+  g_autoptr(GVariant) current = GetProperty(fixture, kPlayerInterface, "Metadata");
+  g_assert_cmpstr(Keys(current).c_str(), ==, "mpris:trackid,xesam:title");
+  AssertEntry(current, "xesam:title", "''");
+
+  // The PropertiesChanged payload and every read hit the bad title, but only
+  // the first is logged
+  for (int i = 0; i < 2; i++) {
+    g_autoptr(GVariant) again = GetProperty(fixture, kPlayerInterface, "Metadata");
+  }
+  std::vector<LogRecord> warnings = LogRecords("Invalid UTF-8");
+  g_assert_cmpuint(warnings.size(), ==, 1);
+  g_assert_cmpint(warnings[0].level, ==, G_LOG_LEVEL_WARNING);
+  g_assert_cmpstr(warnings[0].category.c_str(), ==, "metadata");
+  auto log_stats = fixture->core->GetStats().log;
+  g_assert_cmpuint(log_stats.suppressed, ==, 3);
+  g_assert_cmpuint(log_stats.suppressed_by_category["metadata"], ==, 3);
+
+  os_media_controls::LogSuppressedSummary();
+  std::vector<LogRecord> summary = LogRecords("3 log messages suppressed");
+  g_assert_cmpuint(summary.size(), ==, 1);
+  g_assert_cmpstr(summary[0].message.c_str(), ==, "3 log messages suppressed (metadata: 3)");
+  g_assert_cmpuint(summary[0].suppressed, ==, 3);
+}
+
+static void TestArtworkMaterializedOnRead(Fixture* fixture, gconstpointer user_data) {
+  std::vector<uint8_t> artwork(4096, 0x5a);
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Cover";
+  metadata.artwork = artwork.data();
+  metadata.artwork_length = artwork.size();
+  fixture->core->SetMetadata(metadata);
+  Sync(fixture);
+
+  // Nobody has read Metadata yet, so no URL is announced
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+  g_autoptr(GVariant) changed = ChangedProperties(fixture, 0, kPlayerInterface, "Metadata");
+  g_autoptr(GVariant) signalled = g_variant_lookup_value(changed, "Metadata", nullptr);
+  g_assert_cmpstr(Keys(signalled).c_str(), ==, "mpris:trackid,xesam:title");
+
+  // A client read writes the artwork out and returns a readable URL
+  g_autoptr(GVariant) current = GetProperty(fixture, kPlayerInterface, "Metadata");
+  g_autoptr(GVariant) url = g_variant_lookup_value(current, "mpris:artUrl", G_VARIANT_TYPE_STRING);
+  g_assert_nonnull(url);
+  const gchar* uri = g_variant_get_string(url, nullptr);
+  g_assert_true(g_str_has_prefix(uri, "file://"));
+  g_autofree gchar* contents = nullptr;
+  gsize length = 0;
+  g_assert_true(g_file_get_contents(uri + 7, &contents, &length, nullptr));
+  g_assert_cmpuint(length, ==, artwork.size());
+
+  // Reading does not emit anything by itself
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+}
+
+static void TestSetPlaybackState(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 5.0, 1.5);
+  Sync(fixture);
+
+  // One PropertiesChanged with the player state; Position is never signalled
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+  g_autoptr(GVariant) changed =
+      ChangedProperties(fixture, 0, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(changed, "PlaybackStatus", "'Playing'");
+  AssertEntry(changed, "Rate", "1.5");
+  AssertEntry(changed, "CanPlay", "true");
+  AssertEntry(changed, "CanPause", "true");
+  AssertEntry(changed, "CanGoNext", "false");
+  AssertEntry(changed, "CanGoPrevious", "false");
+  AssertEntry(changed, "CanSeek", "false");
+
+  AssertProperty(fixture, kPlayerInterface, "PlaybackStatus", "'Playing'");
+  AssertProperty(fixture, kPlayerInterface, "Rate", "1.5");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 5000000");
+
+  // Buffering keeps the current status
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_BUFFERING, 5.0, 0);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 2);
+  g_autoptr(GVariant) buffering =
+      ChangedProperties(fixture, 1, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(buffering, "PlaybackStatus", "'Playing'");
+  AssertEntry(buffering, "Rate", "1.5");
+
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_NONE, 0, 1.0);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 3);
+  g_autoptr(GVariant) stopped =
+      ChangedProperties(fixture, 2, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(stopped, "PlaybackStatus", "'Stopped'");
+}
+
+static void TestPositionExtrapolation(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 10.0, 2.0);
+  fake_now += 1500000;
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 13000000");
+
+  // Paused positions stand still
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 20.0, 1.0);
+  fake_now += 5000000;
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 20000000");
+}
+
+static void TestControls(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_NEXT |
+                                        OS_MEDIA_CONTROLS_CONTROL_PREVIOUS |
+                                        OS_MEDIA_CONTROLS_CONTROL_SEEK,
+                                    true);
+  fixture->core->SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_PAUSE, false);
+  Sync(fixture);
+
+  g_assert_cmpuint(fixture->signals.size(), ==, 2);
+  g_autoptr(GVariant) changed =
+      ChangedProperties(fixture, 1, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(changed, "CanGoNext", "true");
+  AssertEntry(changed, "CanGoPrevious", "true");
+  AssertEntry(changed, "CanSeek", "true");
+  AssertEntry(changed, "CanPause", "false");
+  AssertEntry(changed, "CanPlay", "true");
+
+  AssertProperty(fixture, kPlayerInterface, "CanGoNext", "true");
+  AssertProperty(fixture, kPlayerInterface, "CanPause", "false");
+}
+
+static void TestSilentSetters(Fixture* fixture, gconstpointer user_data) {
+  // Nothing on the bus changes, so nothing is emitted
+  fixture->core->SetSkipIntervals(15, 15);
+  fixture->core->SetEventCoalescing(100, 50);
+  fixture->core->SetOptimisticUpdates(true, 500);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 0);
+}
+
+static void TestClear(Fixture* fixture, gconstpointer user_data) {
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Title";
+  fixture->core->SetMetadata(metadata);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 30.0, 1.25);
+  Sync(fixture);
+  ClearSignals(fixture);
+
+  fixture->core->Clear();
+  Sync(fixture);
+
+  // Player state, then metadata
+  g_assert_cmpuint(fixture->signals.size(), ==, 2);
+  g_autoptr(GVariant) state = ChangedProperties(fixture, 0, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(state, "PlaybackStatus", "'Stopped'");
+  AssertEntry(state, "Rate", "1.0");
+  g_autoptr(GVariant) changed = ChangedProperties(fixture, 1, kPlayerInterface, "Metadata");
+  AssertEntry(changed, "Metadata", "{'mpris:trackid': <objectpath '/org/mpris/MediaPlayer2/TrackList/NoTrack'>}");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 0");
+}
+
+// Every method in the introspection XML, with the event it must deliver
+static void TestMethodEvents(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetEventCoalescing(0, 0);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 10.0, 1.0);
+  Sync(fixture);
+  ClearSignals(fixture);
+
+  struct Case {
+    const char* method;
+    OsMediaControlsEventType type;
+  };
+  const Case transport[] = {
+      {"Play", OS_MEDIA_CONTROLS_EVENT_PLAY},
+      {"Pause", OS_MEDIA_CONTROLS_EVENT_PAUSE},
+      {"PlayPause", OS_MEDIA_CONTROLS_EVENT_PLAY},  // Paused, so it plays
+      {"Stop", OS_MEDIA_CONTROLS_EVENT_STOP},
+      {"Next", OS_MEDIA_CONTROLS_EVENT_NEXT},
+      {"Previous", OS_MEDIA_CONTROLS_EVENT_PREVIOUS},
+  };
+  for (const Case& test_case : transport) {
+    fixture->events.clear();
+    CallOk(fixture, kPlayerInterface, test_case.method, nullptr);
+    g_assert_cmpuint(fixture->events.size(), ==, 1);
+    g_assert_cmpint(fixture->events[0].type, ==, test_case.type);
+  }
+
+  // PlayPause follows PlaybackStatus
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 10.0, 1.0);
+  fixture->events.clear();
+  CallOk(fixture, kPlayerInterface, "PlayPause", nullptr);
+  g_assert_cmpuint(fixture->events.size(), ==, 1);
+  g_assert_cmpint(fixture->events[0].type, ==, OS_MEDIA_CONTROLS_EVENT_PAUSE);
+
+  // Seek is relative to the current position
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 10.0, 1.0);
+  fixture->events.clear();
+  CallOk(fixture, kPlayerInterface, "Seek", g_variant_new("(x)", G_GINT64_CONSTANT(2500000)));
+  g_assert_cmpuint(fixture->events.size(), ==, 1);
+  g_assert_cmpint(fixture->events[0].type, ==, OS_MEDIA_CONTROLS_EVENT_SEEK);
+  g_assert_cmpfloat_with_epsilon(fixture->events[0].value, 12.5, 1e-9);
+
+  // SetPosition only applies to the current track
+  fixture->events.clear();
+  CallOk(fixture, kPlayerInterface, "SetPosition",
+         g_variant_new("(ox)", kNoTrackId, G_GINT64_CONSTANT(30000000)));
+  CallOk(fixture, kPlayerInterface, "SetPosition",
+         g_variant_new("(ox)", "/org/mpris/MediaPlayer2/Track/other",
+                       G_GINT64_CONSTANT(40000000)));
+  g_assert_cmpuint(fixture->events.size(), ==, 1);
+  g_assert_cmpint(fixture->events[0].type, ==, OS_MEDIA_CONTROLS_EVENT_SEEK);
+  g_assert_cmpfloat_with_epsilon(fixture->events[0].value, 30.0, 1e-9);
+  g_assert_cmpuint(fixture->core->GetStats().stale_set_position, ==, 1);
+
+  // Writing Rate asks the embedder to change speed
+  fixture->events.clear();
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) set_reply =
+      Call(fixture, "org.freedesktop.DBus.Properties", "Set",
+           g_variant_new("(ssv)", kPlayerInterface, "Rate", g_variant_new_double(1.25)), &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(fixture->events.size(), ==, 1);
+  g_assert_cmpint(fixture->events[0].type, ==, OS_MEDIA_CONTROLS_EVENT_SET_SPEED);
+  g_assert_cmpfloat_with_epsilon(fixture->events[0].value, 1.25, 1e-9);
+
+  // Raise and Quit succeed without events; OpenUri is not supported
+  fixture->events.clear();
+  CallOk(fixture, kRootInterface, "Raise", nullptr);
+  CallOk(fixture, kRootInterface, "Quit", nullptr);
+  g_autoptr(GVariant) open_reply = Call(fixture, kPlayerInterface, "OpenUri",
+                                        g_variant_new("(s)", "file:///tmp/a.mp3"), &error);
+  g_assert_null(open_reply);
+  g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD);
+  g_assert_cmpuint(fixture->events.size(), ==, 0);
+
+  // Handling commands never emits on its own (optimistic updates are off);
+  // only the two SetPlaybackState calls above did
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 2);
+}
+
+static void TestDuplicateCommandWindow(Fixture* fixture, gconstpointer user_data) {
+  CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  fake_now += 49000;
+  CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  g_assert_cmpuint(fixture->events.size(), ==, 1);
+
+  // Other commands are not duplicates, and the window ends after 50 ms
+  CallOk(fixture, kPlayerInterface, "Previous", nullptr);
+  fake_now += 51000;
+  CallOk(fixture, kPlayerInterface, "Previous", nullptr);
+  g_assert_cmpuint(fixture->events.size(), ==, 3);
+
+  auto stats = fixture->core->GetStats();
+  g_assert_cmpuint(stats.events[OS_MEDIA_CONTROLS_EVENT_NEXT].dropped, ==, 1);
+  g_assert_cmpuint(stats.events[OS_MEDIA_CONTROLS_EVENT_PREVIOUS].dropped, ==, 0);
+}
+
+static void TestRateLimit(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetEventCoalescing(-1, 0);
+
+  // A burst of 40 is admitted with the clock standing still
+  for (int i = 0; i < 40; i++) {
+    CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  }
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) reply = Call(fixture, kPlayerInterface, "Next", nullptr, &error);
+  g_assert_null(reply);
+  g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED);
+  g_assert_cmpuint(fixture->events.size(), ==, 40);
+
+  // Tokens refill at 20 per second
+  fake_now += G_USEC_PER_SEC / 2;
+  for (int i = 0; i < 10; i++) {
+    CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  }
+  g_clear_error(&error);
+  g_autoptr(GVariant) limited = Call(fixture, kPlayerInterface, "Next", nullptr, &error);
+  g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED);
+  g_assert_cmpuint(fixture->events.size(), ==, 50);
+  g_assert_cmpuint(fixture->core->GetStats().rate_limit_dropped, ==, 2);
+}
+
+static void TestRateLimitedSeeks(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetEventCoalescing(-1, 0);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 10.0, 1.0);
+
+  // Unknown methods do not use up the sender's tokens
+  for (int i = 0; i < 50; i++) {
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(GVariant) reply =
+        Call(fixture, kPlayerInterface, "OpenUri", g_variant_new("(s)", "file:///a"), &error);
+    g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD);
+  }
+  for (int i = 0; i < 40; i++) {
+    CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  }
+
+  // A merged seek is superseded by a later admitted one
+  CallOk(fixture, kPlayerInterface, "SetPosition",
+         g_variant_new("(ox)", kNoTrackId, G_GINT64_CONSTANT(5000000)));
+  fake_now += G_USEC_PER_SEC / 20;
+  CallOk(fixture, kPlayerInterface, "SetPosition",
+         g_variant_new("(ox)", kNoTrackId, G_GINT64_CONSTANT(7000000)));
+  RunFor(100);
+  g_assert_cmpuint(fixture->events.size(), ==, 41);
+  g_assert_cmpfloat_with_epsilon(fixture->events.back().value, 7.0, 1e-9);
+
+  // A merged seek is dropped if the track changes before it is flushed
+  CallOk(fixture, kPlayerInterface, "Seek", g_variant_new("(x)", G_GINT64_CONSTANT(1000000)));
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Next";
+  fixture->core->SetMetadata(metadata);
+  RunFor(100);
+  g_assert_cmpuint(fixture->events.size(), ==, 41);
+  g_assert_cmpuint(fixture->core->GetStats().stale_set_position, ==, 1);
+}
+
+static void TestSeekCoalescing(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetEventCoalescing(30, -1);
+  for (double position : {1.0, 2.0, 3.0}) {
+    CallOk(fixture, kPlayerInterface, "SetPosition",
+           g_variant_new("(ox)", kNoTrackId, static_cast<gint64>(position * G_USEC_PER_SEC)));
+  }
+
+  // Leading edge right away, the latest value when the window closes
+  g_assert_cmpuint(fixture->events.size(), ==, 1);
+  g_assert_cmpfloat_with_epsilon(fixture->events[0].value, 1.0, 1e-9);
+  RunFor(100);
+  g_assert_cmpuint(fixture->events.size(), ==, 2);
+  g_assert_cmpfloat_with_epsilon(fixture->events[1].value, 3.0, 1e-9);
+  g_assert_cmpuint(fixture->core->GetStats().events[OS_MEDIA_CONTROLS_EVENT_SEEK].merged, ==, 1);
+}
+
+static void TestOptimisticUpdates(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 10.0, 1.0);
+  fixture->core->SetOptimisticUpdates(true, 30);
+  Sync(fixture);
+  ClearSignals(fixture);
+
+  // Play flips PlaybackStatus at once, with a PlaybackStatus-only signal
+  CallOk(fixture, kPlayerInterface, "Play", nullptr);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+  g_autoptr(GVariant) optimistic =
+      ChangedProperties(fixture, 0, kPlayerInterface, "PlaybackStatus");
+  AssertEntry(optimistic, "PlaybackStatus", "'Playing'");
+
+  // Unconfirmed, it is rolled back when the timeout expires
+  RunFor(100);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 2);
+  g_autoptr(GVariant) rolled_back =
+      ChangedProperties(fixture, 1, kPlayerInterface, "PlaybackStatus");
+  AssertEntry(rolled_back, "PlaybackStatus", "'Paused'");
+
+  // Confirmed, only the embedder's own update follows
+  fake_now += G_USEC_PER_SEC;
+  CallOk(fixture, kPlayerInterface, "Play", nullptr);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 10.0, 1.0);
+  RunFor(100);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 4);
+  g_autoptr(GVariant) confirmed =
+      ChangedProperties(fixture, 3, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(confirmed, "PlaybackStatus", "'Playing'");
+
+  // A contradicting state while pending keeps the optimistic status, but its
+  // position and rate are published at once
+  fake_now += G_USEC_PER_SEC;
+  CallOk(fixture, kPlayerInterface, "Pause", nullptr);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 20.0, 2.0);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 6);
+  g_autoptr(GVariant) contradicted =
+      ChangedProperties(fixture, 5, kPlayerInterface, kPlayerStateKeys);
+  AssertEntry(contradicted, "PlaybackStatus", "'Paused'");
+  AssertEntry(contradicted, "Rate", "2.0");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 20000000");
+
+  // and it is what the timeout rolls back to
+  RunFor(100);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 7);
+  g_autoptr(GVariant) restored =
+      ChangedProperties(fixture, 6, kPlayerInterface, "PlaybackStatus");
+  AssertEntry(restored, "PlaybackStatus", "'Playing'");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 20000000");
+
+  auto stats = fixture->core->GetStats();
+  g_assert_cmpuint(stats.optimistic_applied, ==, 3);
+  g_assert_cmpuint(stats.optimistic_confirmed, ==, 1);
+  g_assert_cmpuint(stats.optimistic_rolled_back, ==, 2);
+}
+
+static void TestRecordAndReplay(Fixture* fixture, gconstpointer user_data) {
+  using os_media_controls::TraceRecord;
+  using os_media_controls::TraceRecordType;
+
+  fixture->core->SetEventCoalescing(0, -1);
+  g_autofree gchar* path = g_build_filename(g_getenv("XDG_RUNTIME_DIR"), "test.trace", nullptr);
+  g_assert_true(fixture->core->StartTrace(path));
+
+  static const uint8_t kArtwork[] = {0x89, 'P', 'N', 'G', 0, 1, 2, 3};
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Traced";
+  metadata.artwork = kArtwork;
+  metadata.artwork_length = sizeof(kArtwork);
+  fixture->core->SetMetadata(metadata);
+  fake_now += 1000;
+  fixture->core->SetMetadata(metadata);
+  fake_now += 1000;
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 5.0, 1.0);
+  fake_now += 1000;
+  CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  CallOk(fixture, "org.freedesktop.DBus.Properties", "Set",
+         g_variant_new("(ssv)", kPlayerInterface, "Rate", g_variant_new_double(1.5)));
+  fixture->core->StopTrace();
+  g_assert_cmpuint(fixture->events.size(), ==, 2);
+
+  os_media_controls::TraceReader reader;
+  g_autoptr(GError) error = nullptr;
+  g_assert_true(reader.Open(path, &error));
+  std::vector<TraceRecord> records;
+  TraceRecord record;
+  while (reader.Next(&record, &error)) {
+    records.push_back(record);
+  }
+  g_assert_no_error(error);
+
+  const TraceRecordType expected[] = {
+      TraceRecordType::kSetMetadata, TraceRecordType::kSetMetadata,
+      TraceRecordType::kSetPlaybackState, TraceRecordType::kDBusMethodCall,
+      TraceRecordType::kDBusSetProperty};
+  const gint64 expected_times[] = {0, 1000, 2000, 3000, 3000};
+  g_assert_cmpuint(records.size(), ==, G_N_ELEMENTS(expected));
+  for (size_t i = 0; i < records.size(); i++) {
+    g_assert_cmpint(static_cast<int>(records[i].type), ==, static_cast<int>(expected[i]));
+    g_assert_cmpint(records[i].time, ==, expected_times[i]);
+  }
+
+  // Unchanged artwork is recorded as a flag only
+  g_autoptr(GVariant) first_artwork = g_variant_get_child_value(records[0].payload, 7);
+  g_autoptr(GVariant) second_artwork = g_variant_get_child_value(records[1].payload, 7);
+  g_assert_cmpuint(g_variant_n_children(first_artwork), ==, sizeof(kArtwork));
+  g_assert_cmpuint(g_variant_n_children(second_artwork), ==, 0);
+  AssertVariant(records[2].payload, "(3, 5.0, 1.0)");
+  const gchar *sender, *interface, *method;
+  g_autoptr(GVariant) parameters = nullptr;
+  g_variant_get(records[3].payload, "(&s&s&sv)", &sender, &interface, &method, &parameters);
+  g_assert_cmpstr(sender, ==, g_dbus_connection_get_unique_name(fixture->client));
+  g_assert_cmpstr(method, ==, "Next");
+
+  // Replaying into a cleared core restores the state and repeats the events
+  fixture->core->Clear();
+  fake_now += G_USEC_PER_SEC;
+  os_media_controls::TraceReplayer replayer(fixture->core);
+  for (TraceRecord& replayed : records) {
+    replayer.Apply(replayed);
+    g_variant_unref(replayed.payload);
+  }
+  g_assert_cmpuint(fixture->events.size(), ==, 4);
+  g_assert_cmpint(fixture->events[2].type, ==, OS_MEDIA_CONTROLS_EVENT_NEXT);
+  g_assert_cmpint(fixture->events[3].type, ==, OS_MEDIA_CONTROLS_EVENT_SET_SPEED);
+  g_assert_cmpfloat_with_epsilon(fixture->events[3].value, 1.5, 1e-9);
+
+  AssertProperty(fixture, kPlayerInterface, "PlaybackStatus", "'Playing'");
+  AssertProperty(fixture, kPlayerInterface, "Rate", "1.5");
+  g_autoptr(GVariant) replayed_metadata = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertEntry(replayed_metadata, "xesam:title", "'Traced'");
+  g_assert_true(g_variant_lookup(replayed_metadata, "mpris:artUrl", "&s", nullptr));
+  g_unlink(path);
+
+  // A trace with arguments GDBus would have rejected replays without applying them
+  g_autofree gchar* corrupt_path =
+      g_build_filename(g_getenv("XDG_RUNTIME_DIR"), "corrupt.trace", nullptr);
+  {
+    os_media_controls::TraceWriter writer;
+    g_assert_true(writer.Open(corrupt_path));
+    writer.Write(TraceRecordType::kDBusMethodCall, 0,
+                 g_variant_new("(sssv)", ":1.1", kPlayerInterface, "Seek",
+                               g_variant_new("(s)", "ten")));
+    writer.Write(TraceRecordType::kDBusMethodCall, 0,
+                 g_variant_new("(sssv)", ":1.1", kPlayerInterface, "SetPosition",
+                               g_variant_new("(x)", G_GINT64_CONSTANT(1))));
+    writer.Write(TraceRecordType::kDBusSetProperty, 0,
+                 g_variant_new("(sssv)", ":1.1", kPlayerInterface, "Rate",
+                               g_variant_new_string("fast")));
+    writer.Write(TraceRecordType::kDBusMethodCall, 0,
+                 g_variant_new("(sssv)", ":1.1", kPlayerInterface, "Next", g_variant_new("()")));
+  }
+  g_assert_true(reader.Open(corrupt_path, &error));
+  fake_now += G_USEC_PER_SEC;
+  size_t events_before = fixture->events.size();
+  while (reader.Next(&record, &error)) {
+    replayer.Apply(record);
+    g_variant_unref(record.payload);
+  }
+  g_assert_no_error(error);
+  g_assert_cmpuint(replayer.skipped(), ==, 3);
+  g_assert_cmpuint(fixture->events.size(), ==, events_before + 1);
+  g_assert_cmpint(fixture->events.back().type, ==, OS_MEDIA_CONTROLS_EVENT_NEXT);
+  AssertProperty(fixture, kPlayerInterface, "Rate", "1.5");
+  g_unlink(corrupt_path);
+}
+
+static void TestStatsAndDebugInterface(Fixture* fixture, gconstpointer user_data) {
+  guint64 signals_before = fixture->core->GetStats().signals_emitted;
+  fixture->core->SetEventCoalescing(0, -1);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 1.0, 1.0);
+  CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  Sync(fixture);
+
+  auto stats = fixture->core->GetStats();
+  g_assert_cmpuint(stats.api_calls["setPlaybackState"].calls, ==, 1);
+  g_assert_cmpuint(stats.dbus_calls["Next"].calls, ==, 1);
+  g_assert_cmpuint(stats.dbus_calls["Get"].calls, >=, 1);
+  g_assert_cmpuint(stats.dbus_calls["Next"].latency.count, ==, 1);
+  g_assert_cmpuint(stats.signals_emitted - signals_before, ==, fixture->signals.size());
+  g_assert_cmpuint(stats.signal_bytes, >, 0);
+  g_assert_cmpuint(stats.events[OS_MEDIA_CONTROLS_EVENT_NEXT].delivered, ==, 1);
+
+  // The debug object only exists once enabled
+  static const char kDebugPath[] = "/org/mpris/MediaPlayer2/OsMediaControls";
+  static const char kDebugInterface[] = "org.mpris.MediaPlayer2.OsMediaControls.Debug";
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GVariant) missing =
+      CallFull(fixture, kBusName, kDebugPath, kDebugInterface, "GetStats", nullptr, &error);
+  g_assert_null(missing);
+  g_assert_nonnull(error);
+  g_clear_error(&error);
+
+  fixture->core->SetDebugInterfaceEnabled(true);
+  g_autoptr(GVariant) reply =
+      CallFull(fixture, kBusName, kDebugPath, kDebugInterface, "GetStats", nullptr, &error);
+  g_assert_no_error(error);
+  g_autoptr(GVariant) exported = g_variant_get_child_value(reply, 0);
+  g_autoptr(GVariant) dbus_calls = g_variant_lookup_value(exported, "dbusCalls", nullptr);
+  g_autoptr(GVariant) next = g_variant_lookup_value(dbus_calls, "Next", nullptr);
+  AssertEntry(next, "calls", "uint64 1");
+  g_autoptr(GVariant) signals = g_variant_lookup_value(exported, "signals", nullptr);
+  g_autofree gchar* emitted = g_strdup_printf("uint64 %" G_GUINT64_FORMAT, stats.signals_emitted);
+  AssertEntry(signals, "emitted", emitted);
+}
+
+// Send a Get, then block the main thread so that it waits for the stall to end
+static void GetDuringStall(Fixture* fixture, guint stall_ms) {
+  CallResult call;
+  g_dbus_connection_call(fixture->client, kBusName, kObjectPath,
+                         "org.freedesktop.DBus.Properties", "Get",
+                         g_variant_new("(ss)", kPlayerInterface, "PlaybackStatus"), nullptr,
+                         G_DBUS_CALL_FLAGS_NONE, 5000, nullptr, HandleCallDone, &call);
+  g_usleep(stall_ms * 1000);
+  while (!call.done) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  g_assert_no_error(call.error);
+  g_variant_unref(call.reply);
+}
+
+static void TestStallDetection(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetStallDetection(50);
+  RunFor(20);
+
+  GetDuringStall(fixture, 300);
+  std::vector<LogRecord> warnings = LogRecords("Main loop has not dispatched");
+  g_assert_cmpuint(warnings.size(), ==, 1);
+  g_assert_cmpstr(warnings[0].category.c_str(), ==, "mainloop");
+
+  auto stalls = fixture->core->GetStats().stalls;
+  g_assert_cmpuint(stalls.threshold_ms, ==, 50);
+  g_assert_cmpuint(stalls.stalls, ==, 1);
+  g_assert_cmpuint(stalls.duration.max_ns, >=, 200 * G_GUINT64_CONSTANT(1000000));
+  g_assert_cmpuint(stalls.calls_waiting, ==, 1);
+  g_assert_cmpuint(stalls.last_waiting.size(), ==, 1);
+  g_assert_cmpstr(stalls.last_waiting[0].c_str(), ==, "Get");
+
+  fixture->core->SetStallDetection(0);
+  g_assert_cmpuint(fixture->core->GetStats().stalls.threshold_ms, ==, 0);
+}
+
+static void TestEventStamps(Fixture* fixture, gconstpointer user_data) {
+  fixture->core->SetEventCoalescing(0, 0);
+  guint64 before = os_media_controls::ScopedCallTimer::NowNs();
+  CallOk(fixture, kPlayerInterface, "Next", nullptr);
+  CallOk(fixture, "org.freedesktop.DBus.Properties", "Set",
+         g_variant_new("(ssv)", kPlayerInterface, "Rate", g_variant_new_double(2.0)));
+  guint64 after = os_media_controls::ScopedCallTimer::NowNs();
+
+  g_assert_cmpuint(fixture->events.size(), ==, 2);
+  g_assert_cmpuint(fixture->events[0].sequence, >, 0);
+  g_assert_cmpuint(fixture->events[1].sequence, ==, fixture->events[0].sequence + 1);
+  for (const OsMediaControlsEvent& event : fixture->events) {
+    g_assert_cmpint(event.received_ns, >=, static_cast<gint64>(before));
+    g_assert_cmpint(event.received_ns, <=, static_cast<gint64>(after));
+  }
+
+  // Only method calls carry an arrival stamp from the connection filter
+  g_assert_cmpuint(fixture->core->GetStats().bus_to_native.count, >=, 1);
+}
+
+static void TestStateSnapshot(Fixture* fixture, gconstpointer user_data) {
+  static const uint8_t kArtwork[] = {0x89, 'P', 'N', 'G', 4, 5, 6, 7};
+  fixture->core->SetStatePersistence(true);
+  fixture->core->SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_NEXT | OS_MEDIA_CONTROLS_CONTROL_SEEK,
+                                    true);
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Persisted";
+  metadata.album = "Restored album";
+  metadata.artwork = kArtwork;
+  metadata.artwork_length = sizeof(kArtwork);
+  fixture->core->SetMetadata(metadata);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 42.0, 1.0);
+
+  // Destroying the core writes the pending snapshot before returning
+  delete fixture->core;
+  fixture->core = new os_media_controls::MediaControlsCore();
+  WaitForName(fixture);
+  g_assert_true(fixture->core->GetStats().snapshot.restored);
+  g_assert_true(fixture->core->GetStats().snapshot.unconfirmed);
+
+  // Restored paused, with the artwork stored next to the snapshot
+  AssertProperty(fixture, kPlayerInterface, "PlaybackStatus", "'Paused'");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 42000000");
+  AssertProperty(fixture, kPlayerInterface, "CanGoNext", "true");
+  AssertProperty(fixture, kPlayerInterface, "CanSeek", "true");
+  g_autoptr(GVariant) restored = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertEntry(restored, "xesam:title", "'Persisted'");
+  const gchar* art_url = nullptr;
+  g_assert_true(g_variant_lookup(restored, "mpris:artUrl", "&s", &art_url));
+  g_assert_true(g_str_has_prefix(art_url, "file://"));
+  g_autofree gchar* art_contents = nullptr;
+  gsize art_length = 0;
+  g_assert_true(g_file_get_contents(art_url + 7, &art_contents, &art_length, nullptr));
+  g_assert_cmpmem(art_contents, art_length, kArtwork, sizeof(kArtwork));
+
+  // The first metadata from the app replaces the restored fields
+  OsMediaControlsMetadata next = {};
+  next.title = "Fresh";
+  fixture->core->SetMetadata(next);
+  g_assert_false(fixture->core->GetStats().snapshot.unconfirmed);
+  g_autoptr(GVariant) fresh = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertEntry(fresh, "xesam:title", "'Fresh'");
+  g_assert_false(g_variant_lookup(fresh, "xesam:album", "&s", nullptr));
+  g_assert_false(g_variant_lookup(fresh, "mpris:artUrl", "&s", nullptr));
+
+  // Disabling removes the snapshot, so the next core starts empty
+  fixture->core->SetStatePersistence(false);
+  g_assert_false(g_file_test(art_url + 7, G_FILE_TEST_EXISTS));
+  delete fixture->core;
+  fixture->core = new os_media_controls::MediaControlsCore();
+  fixture->core->Activate();
+  WaitForName(fixture);
+  g_assert_false(fixture->core->GetStats().snapshot.enabled);
+  g_assert_false(fixture->core->GetStats().snapshot.restored);
+  AssertProperty(fixture, kPlayerInterface, "PlaybackStatus", "'Stopped'");
+}
+
+namespace os_media_controls {
+
+class MemoryShedTest {
+ public:
+  static void Shed(MediaControlsCore* core, GMemoryMonitorWarningLevel level) {
+    core->ShedMemory(level);
+  }
+
+  // Hand the current state to the snapshot writer, as its timer would
+  static void FlushSnapshot(MediaControlsCore* core) { core->state_snapshot_->Flush(); }
+
+  // What the snapshot writer would capture now
+  static PlayerSnapshot Capture(MediaControlsCore* core) {
+    PlayerSnapshot snapshot = {};
+    core->CaptureStateSnapshot(&snapshot);
+    return snapshot;
+  }
+};
+
+}  // namespace os_media_controls
+
+using os_media_controls::MemoryShedTest;
+
+static void AssertArtworkServed(Fixture* fixture, const std::string& expected_url,
+                                const uint8_t* artwork, size_t length) {
+  g_autoptr(GVariant) metadata = GetProperty(fixture, kPlayerInterface, "Metadata");
+  const gchar* url = nullptr;
+  g_assert_true(g_variant_lookup(metadata, "mpris:artUrl", "&s", &url));
+  g_assert_cmpstr(url, ==, expected_url.c_str());
+  g_autofree gchar* contents = nullptr;
+  gsize contents_length = 0;
+  g_assert_true(g_file_get_contents(url + 7, &contents, &contents_length, nullptr));
+  g_assert_cmpmem(contents, contents_length, artwork, length);
+}
+
+static void AssertSameSnapshot(const os_media_controls::PlayerSnapshot& actual,
+                               const os_media_controls::PlayerSnapshot& expected) {
+  g_assert_cmpstr(actual.playback_status.c_str(), ==, expected.playback_status.c_str());
+  g_assert_cmpfloat(actual.position, ==, expected.position);
+  g_assert_true(actual.metadata == expected.metadata);
+  g_assert_cmpstr(actual.track_id.c_str(), ==, expected.track_id.c_str());
+  g_assert_cmpstr(actual.art_url.c_str(), ==, expected.art_url.c_str());
+  g_assert_false(actual.artwork_changed);
+}
+
+static void TestMemoryShedding(Fixture* fixture, gconstpointer user_data) {
+  static const uint8_t kOldArtwork[] = {0x89, 'P', 'N', 'G', 8, 9, 10, 11};
+  static const uint8_t kArtwork[] = {0x89, 'P', 'N', 'G', 12, 13, 14, 15};
+  fixture->core->SetStatePersistence(true);
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Shed";
+  metadata.artwork = kOldArtwork;
+  metadata.artwork_length = sizeof(kOldArtwork);
+  fixture->core->SetMetadata(metadata);
+  // A cover a client has read, left behind for tier 2 once it is replaced
+  g_autoptr(GVariant) old_metadata = GetProperty(fixture, kPlayerInterface, "Metadata");
+  metadata.artwork = kArtwork;
+  metadata.artwork_length = sizeof(kArtwork);
+  fixture->core->SetMetadata(metadata);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 30.0, 1.0);
+
+  // Once a client has read the cover and the snapshot has stored it, nothing
+  // else needs the retained bytes
+  g_autoptr(GVariant) current = GetProperty(fixture, kPlayerInterface, "Metadata");
+  const gchar* art_url = nullptr;
+  g_assert_true(g_variant_lookup(current, "mpris:artUrl", "&s", &art_url));
+  std::string url = art_url;
+  MemoryShedTest::FlushSnapshot(fixture->core);
+  os_media_controls::PlayerSnapshot before = MemoryShedTest::Capture(fixture->core);
+
+  // Each tier keeps serving the current cover and leaves the snapshot as it was
+  MemoryShedTest::Shed(fixture->core, G_MEMORY_MONITOR_WARNING_LEVEL_LOW);
+  g_assert_cmpuint(fixture->core->GetStats().artwork_data_bytes, ==, 0);
+  AssertArtworkServed(fixture, url, kArtwork, sizeof(kArtwork));
+  AssertSameSnapshot(MemoryShedTest::Capture(fixture->core), before);
+
+  MemoryShedTest::Shed(fixture->core, G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM);
+  AssertArtworkServed(fixture, url, kArtwork, sizeof(kArtwork));
+  AssertSameSnapshot(MemoryShedTest::Capture(fixture->core), before);
+
+  MemoryShedTest::Shed(fixture->core, G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL);
+  AssertArtworkServed(fixture, url, kArtwork, sizeof(kArtwork));
+  AssertSameSnapshot(MemoryShedTest::Capture(fixture->core), before);
+  g_assert_cmpuint(fixture->core->GetStats().low_memory_warnings, ==, 3);
+
+  // Resending the shed cover is recognized by its hash rather than stored anew
+  fixture->core->SetMetadata(metadata);
+  AssertArtworkServed(fixture, url, kArtwork, sizeof(kArtwork));
+  AssertSameSnapshot(MemoryShedTest::Capture(fixture->core), before);
+
+  // The stored snapshot still carries the cover into the next run
+  delete fixture->core;
+  fixture->core = new os_media_controls::MediaControlsCore();
+  WaitForName(fixture);
+  g_autoptr(GVariant) restored = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertEntry(restored, "xesam:title", "'Shed'");
+  const gchar* restored_url = nullptr;
+  g_assert_true(g_variant_lookup(restored, "mpris:artUrl", "&s", &restored_url));
+  g_autofree gchar* restored_contents = nullptr;
+  gsize restored_length = 0;
+  g_assert_true(
+      g_file_get_contents(restored_url + 7, &restored_contents, &restored_length, nullptr));
+  g_assert_cmpmem(restored_contents, restored_length, kArtwork, sizeof(kArtwork));
+
+  fixture->core->SetStatePersistence(false);
+}
+
+static void TestLazyActivation(Fixture* fixture, gconstpointer user_data) {
+  // A new core stays off the bus and out of the runtime directory until
+  // something changes its state
+  delete fixture->core;
+  g_autofree gchar* artwork_dir = g_strdup_printf(
+      "%s/os_media_controls_artwork/%d", g_getenv("XDG_RUNTIME_DIR"), getpid());
+  fixture->core = new os_media_controls::MediaControlsCore();
+  RunFor(50);
+  g_assert_false(HasName(fixture));
+  g_assert_false(g_file_test(artwork_dir, G_FILE_TEST_EXISTS));
+  auto startup = fixture->core->GetStats().startup;
+  g_assert_false(startup.activated);
+  g_assert_cmpuint(startup.construct_ns, >, 0);
+
+  // Calls made while connecting show up once the name is owned
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Early";
+  fixture->core->SetMetadata(metadata);
+  fixture->core->SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_NEXT, true);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 5.0, 1.0);
+  g_assert_true(g_file_test(artwork_dir, G_FILE_TEST_IS_DIR));
+  g_assert_false(fixture->core->GetStats().startup.ready);
+  WaitForName(fixture);
+
+  AssertProperty(fixture, kPlayerInterface, "PlaybackStatus", "'Paused'");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 5000000");
+  AssertProperty(fixture, kPlayerInterface, "CanGoNext", "true");
+  g_autoptr(GVariant) metadata_value = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertEntry(metadata_value, "xesam:title", "'Early'");
+  startup = fixture->core->GetStats().startup;
+  g_assert_true(startup.ready);
+  g_assert_cmpuint(startup.bus_ready_ns, >, 0);
+
+  // Destroying a core that is still connecting must not leave the callback
+  // pointing at it
+  delete fixture->core;
+  fixture->core = new os_media_controls::MediaControlsCore();
+  fixture->core->Activate();
+  delete fixture->core;
+  fixture->core = new os_media_controls::MediaControlsCore();
+  RunFor(50);
+}
+
+static void TestBusReconnection(Fixture* fixture, gconstpointer user_data) {
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Survivor";
+  fixture->core->SetMetadata(metadata);
+  fixture->core->SetControlsEnabled(OS_MEDIA_CONTROLS_CONTROL_NEXT, true);
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PAUSED, 12.0, 1.0);
+  fixture->core->SetStallDetection(50);
+  RunFor(20);
+  GetDuringStall(fixture, 150);
+  Sync(fixture);
+  ClearSignals(fixture);
+
+  // Kill the bus daemon and start another one, as when the broker restarts
+  DisconnectClient(fixture);
+  g_test_dbus_down(test_bus);
+  g_object_unref(test_bus);
+  test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(test_bus);
+  ConnectClient(fixture);
+  WaitForName(fixture);
+  Sync(fixture);
+
+  // The state set before the restart comes back in one PropertiesChanged
+  // without the embedder setting anything again
+  g_assert_cmpuint(fixture->signals.size(), ==, 1);
+  g_autoptr(GVariant) changed = ChangedProperties(
+      fixture, 0, kPlayerInterface,
+      "CanGoNext,CanGoPrevious,CanPause,CanPlay,CanSeek,Metadata,PlaybackStatus,Rate");
+  AssertEntry(changed, "PlaybackStatus", "'Paused'");
+  AssertEntry(changed, "CanGoNext", "true");
+  g_autoptr(GVariant) replayed = g_variant_lookup_value(changed, "Metadata", nullptr);
+  AssertEntry(replayed, "xesam:title", "'Survivor'");
+  AssertProperty(fixture, kPlayerInterface, "Position", "int64 12000000");
+
+  auto bus = fixture->core->GetStats().bus;
+  g_assert_cmpuint(bus.disconnects, ==, 1);
+  g_assert_cmpuint(bus.reconnects, ==, 1);
+  g_assert_cmpuint(bus.recovery.count, ==, 1);
+  g_assert_cmpuint(bus.recovery.max_ns, <, 5 * G_GUINT64_CONSTANT(1000000000));
+  g_test_minimized_result(bus.recovery.max_ns / 1e6, "session bus recovery: %.1f ms",
+                          bus.recovery.max_ns / 1e6);
+
+  // Updates flow again on the new connection
+  fixture->core->SetPlaybackState(OS_MEDIA_CONTROLS_PLAYBACK_PLAYING, 12.0, 1.0);
+  Sync(fixture);
+  g_assert_cmpuint(fixture->signals.size(), ==, 2);
+
+  // The watchdog keeps its counters and sees calls on the new connection
+  guint64 waiting_before = fixture->core->GetStats().stalls.calls_waiting;
+  g_assert_cmpuint(waiting_before, >=, 1);
+  GetDuringStall(fixture, 150);
+  auto stalls = fixture->core->GetStats().stalls;
+  g_assert_cmpuint(stalls.stalls, >=, 2);
+  g_assert_cmpuint(stalls.calls_waiting, >, waiting_before);
+  g_assert_cmpuint(stalls.last_waiting.size(), ==, 1);
+  g_assert_cmpstr(stalls.last_waiting[0].c_str(), ==, "Get");
+  fixture->core->SetStallDetection(0);
+}
+
+static void TestLateBus(Fixture* fixture, gconstpointer user_data) {
+  // The session bus is not up yet when the core activates
+  delete fixture->core;
+  DisconnectClient(fixture);
+  g_test_dbus_down(test_bus);
+  g_object_unref(test_bus);
+  g_autofree gchar* missing_bus =
+      g_strdup_printf("unix:path=%s/no_such_bus", g_getenv("XDG_RUNTIME_DIR"));
+  g_setenv("DBUS_SESSION_BUS_ADDRESS", missing_bus, TRUE);
+
+  fixture->core = new os_media_controls::MediaControlsCore();
+  OsMediaControlsMetadata metadata = {};
+  metadata.title = "Patient";
+  fixture->core->SetMetadata(metadata);
+  RunFor(250);
+  g_assert_cmpuint(fixture->core->GetStats().bus.failed_attempts, >=, 1);
+  g_assert_false(fixture->core->GetStats().startup.ready);
+
+  // It keeps trying and is published once the bus comes up
+  test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(test_bus);
+  ConnectClient(fixture);
+  WaitForName(fixture);
+  g_autoptr(GVariant) published = GetProperty(fixture, kPlayerInterface, "Metadata");
+  AssertEntry(published, "xesam:title", "'Patient'");
+  auto stats = fixture->core->GetStats();
+  g_assert_true(stats.startup.ready);
+  g_assert_cmpuint(stats.bus.reconnects, ==, 0);
+}
+
+static void AddTest(const char* path, void (*test)(Fixture*, gconstpointer)) {
+  g_test_add(path, Fixture, nullptr, SetUp, test, TearDown);
+}
+
+int main(int argc, char** argv) {
+  g_test_init(&argc, &argv, nullptr);
+  g_log_set_writer_func(RecordLog, nullptr, nullptr);
+
+  g_autofree gchar* daemon = g_find_program_in_path("dbus-daemon");
+  if (!daemon) {
+    g_printerr("dbus-daemon not found, skipping\n");
+    return 77;
+  }
+
+  // Keep artwork, the state file and snapshots out of the real user directories
+  g_autofree gchar* runtime_dir = g_dir_make_tmp("os_media_controls_test.XXXXXX", nullptr);
+  g_assert_nonnull(runtime_dir);
+  g_setenv("XDG_RUNTIME_DIR", runtime_dir, TRUE);
+  g_setenv("XDG_CACHE_HOME", runtime_dir, TRUE);
+  g_set_application_name("MPRIS conformance test");
+
+  test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(test_bus);
+
+  AddTest("/mpris/root-properties", TestRootProperties);
+  AddTest("/mpris/player-defaults", TestPlayerDefaults);
+  AddTest("/mpris/get-all-matches-get", TestGetAllMatchesGet);
+  AddTest("/mpris/unknown-property", TestUnknownProperty);
+  AddTest("/mpris/set-metadata", TestSetMetadata);
+  AddTest("/mpris/metadata-invalid-utf8", TestMetadataInvalidUtf8);
+  AddTest("/mpris/artwork-materialized-on-read", TestArtworkMaterializedOnRead);
+  AddTest("/mpris/set-playback-state", TestSetPlaybackState);
+  AddTest("/mpris/position-extrapolation", TestPositionExtrapolation);
+  AddTest("/mpris/controls", TestControls);
+  AddTest("/mpris/silent-setters", TestSilentSetters);
+  AddTest("/mpris/clear", TestClear);
+  AddTest("/mpris/method-events", TestMethodEvents);
+  AddTest("/mpris/duplicate-command-window", TestDuplicateCommandWindow);
+  AddTest("/mpris/rate-limit", TestRateLimit);
+  AddTest("/mpris/rate-limited-seeks", TestRateLimitedSeeks);
+  AddTest("/mpris/seek-coalescing", TestSeekCoalescing);
+  AddTest("/mpris/optimistic-updates", TestOptimisticUpdates);
+  AddTest("/mpris/record-and-replay", TestRecordAndReplay);
+  AddTest("/mpris/stats-and-debug-interface", TestStatsAndDebugInterface);
+  AddTest("/mpris/stall-detection", TestStallDetection);
+  AddTest("/mpris/event-stamps", TestEventStamps);
+  AddTest("/mpris/state-snapshot", TestStateSnapshot);
+  AddTest("/mpris/memory-shedding", TestMemoryShedding);
+  AddTest("/mpris/lazy-activation", TestLazyActivation);
+  AddTest("/mpris/bus-reconnection", TestBusReconnection);
+  AddTest("/mpris/late-bus", TestLateBus);
+
+  int result = g_test_run();
+
+  g_test_dbus_down(test_bus);
+  g_object_unref(test_bus);
+
+  // The core removes its own files; only the shared artwork directory is left
+  g_autofree gchar* artwork_dir = g_build_filename(runtime_dir, "os_media_controls_artwork", nullptr);
+  g_rmdir(artwork_dir);
+  g_autofree gchar* snapshot_dir = g_build_filename(runtime_dir, "os_media_controls", nullptr);
+  g_rmdir(snapshot_dir);
+  g_rmdir(runtime_dir);
+  return result;
+}
@@ -0,0 +1,115 @@
+// Concurrency stress test for the seqlock-protected state file.
+//
+// One thread publishes states whose fields are all derived from a single
+// counter while several reader threads check that every snapshot they get is
+// internally consistent, i.e. never mixes fields from two writes.
+
+#include "state_file.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr uint64_t kWrites = 200000;
+static constexpr int kReaders = 4;
+
+static std::string TitleFor(uint64_t value) {
+  // Vary the length so torn copies leave mismatched terminators behind
+  return "title-" + std::to_string(value) + std::string(value % 97, 'x');
+}
+
+static std::string ArtistFor(uint64_t value) {
+  return "artist-" + std::to_string(value);
+}
+
+static bool IsConsistent(const OsMediaControlsState& state) {
+  uint64_t value = state.generation;
+  if (value == 0) {
+    return true;
+  }
+  return state.position_us == static_cast<int64_t>(value) &&
+         state.anchor_time_us == static_cast<int64_t>(value * 2) &&
+         state.rate == static_cast<double>(value) &&
+         state.status == value % 3 &&
+         TitleFor(value) == state.title && ArtistFor(value) == state.artist;
+}
+
+int main() {
+  const char* temp_dir = getenv("TMPDIR");
+  std::string path = std::string(temp_dir ? temp_dir : "/tmp") +
+                     "/os_media_controls_state_test." + std::to_string(getpid());
+
+  os_media_controls::StateFileWriter writer;
+  if (!writer.Open(path)) {
+    fprintf(stderr, "FAIL: cannot create %s\n", path.c_str());
+    return 1;
+  }
+
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> reads(0);
+  std::atomic<uint64_t> failures(0);
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kReaders; i++) {
+    readers.emplace_back([&]() {
+      OsMediaControlsStateReader* reader = os_media_controls_state_reader_open(path.c_str());
+      if (!reader) {
+        failures++;
+        return;
+      }
+      uint64_t last_generation = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        OsMediaControlsState state;
+        if (!os_media_controls_state_reader_read(reader, &state)) {
+          continue;
+        }
+        reads++;
+        if (!IsConsistent(state) || state.generation < last_generation) {
+          failures++;
+        }
+        last_generation = state.generation;
+      }
+      os_media_controls_state_reader_close(reader);
+    });
+  }
+
+  for (uint64_t value = 1; value <= kWrites; value++) {
+    writer.Publish(static_cast<OsMediaControlsStatus>(value % 3),
+                   static_cast<int64_t>(value), static_cast<int64_t>(value * 2),
+                   static_cast<double>(value), TitleFor(value), ArtistFor(value), "");
+  }
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+
+  // Strings longer than the field are cut at a UTF-8 boundary
+  std::string long_title(OS_MEDIA_CONTROLS_STATE_TITLE_SIZE - 2, 'a');
+  long_title += "\xc3\xa9";
+  writer.Publish(OS_MEDIA_CONTROLS_STATUS_PAUSED, 0, 0, 1.0, long_title, "", "");
+  OsMediaControlsStateReader* reader = os_media_controls_state_reader_open(path.c_str());
+  OsMediaControlsState state;
+  if (!reader || !os_media_controls_state_reader_read(reader, &state) ||
+      std::string(state.title) != long_title.substr(0, long_title.size() - 2)) {
+    fprintf(stderr, "FAIL: truncated title does not end on a character boundary\n");
+    failures++;
+  }
+  os_media_controls_state_reader_close(reader);
+
+  writer.Close();
+  if (access(path.c_str(), F_OK) == 0) {
+    fprintf(stderr, "FAIL: state file was not removed\n");
+    failures++;
+  }
+
+  printf("writes=%llu reads=%llu failures=%llu\n",
+         static_cast<unsigned long long>(kWrites),
+         static_cast<unsigned long long>(reads.load()),
+         static_cast<unsigned long long>(failures.load()));
+  return failures == 0 ? 0 : 1;
+}
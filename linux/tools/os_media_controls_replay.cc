@@ -0,0 +1,218 @@
+// Replays a trace recorded with OS_MEDIA_CONTROLS_TRACE=<path> (or
+// MediaControlsCore::StartTrace) into a fresh core.
+//
+// Usage: os_media_controls_replay [--max-speed] [--repeat=N] [--private-bus] trace
+//
+// At original speed records are applied at their recorded offsets. With
+// --max-speed they are applied back to back, one per main loop iteration, and
+// the core's clock follows the recorded timestamps so rate limiting and
+// duplicate windows behave as they did when recording (coalescing and
+// optimistic timeouts still run on real timers). --private-bus replays against
+// a private dbus-daemon instead of the session bus.
+//
+// Prints one JSON object with the wall time and, per record type, the count
+// and the time spent applying it.
+
+#include "os_media_controls/os_media_controls_core.h"
+#include "trace.h"
+
+#include <gio/gio.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using os_media_controls::MediaControlsCore;
+using os_media_controls::TraceReader;
+using os_media_controls::TraceRecord;
+using os_media_controls::TraceRecordType;
+using os_media_controls::TraceRecordTypeName;
+using os_media_controls::TraceReplayer;
+
+static constexpr size_t kRecordTypeCount = static_cast<size_t>(TraceRecordType::kCount);
+
+class Replay {
+ public:
+  Replay(const std::vector<TraceRecord>& records, bool max_speed, int repeat)
+      : records_(records), max_speed_(max_speed), repeat_(repeat), replayer_(&core_),
+        apply_times_(kRecordTypeCount) {
+    core_.SetEventCallback([this](const OsMediaControlsEvent&) { events_++; });
+    if (max_speed_) {
+      core_.SetMonotonicClock(VirtualClock, this);
+    }
+  }
+
+  void Run();
+
+ private:
+  void ScheduleNext();
+  static gboolean ApplyNext(gpointer user_data);
+  static gint64 VirtualClock(gpointer user_data);
+  void PrintSummary(gint64 wall_time);
+
+  const std::vector<TraceRecord>& records_;
+  bool max_speed_;
+  int repeat_;
+  MediaControlsCore core_;
+  TraceReplayer replayer_;
+  GMainLoop* loop_ = nullptr;
+
+  size_t next_ = 0;
+  int pass_ = 0;
+  gint64 pass_start_ = 0;  // Real time the current pass started at
+  gint64 clock_base_ = g_get_monotonic_time();  // Virtual time of the first record
+  gint64 pass_offset_ = 0;  // Virtual time added per completed pass
+  guint64 events_ = 0;
+  std::vector<std::vector<gint64>> apply_times_;  // Nanoseconds, per record type
+};
+
+gint64 Replay::VirtualClock(gpointer user_data) {
+  auto* self = static_cast<Replay*>(user_data);
+  size_t index = std::min(self->next_, self->records_.size() - 1);
+  return self->clock_base_ + self->pass_offset_ + self->records_[index].time;
+}
+
+void Replay::ScheduleNext() {
+  if (next_ >= records_.size()) {
+    if (++pass_ >= repeat_) {
+      g_main_loop_quit(loop_);
+      return;
+    }
+    pass_offset_ += records_.back().time + 1;
+    next_ = 0;
+    pass_start_ = g_get_monotonic_time();
+  }
+
+  gint64 wait = 0;
+  if (!max_speed_) {
+    wait = pass_start_ + records_[next_].time - g_get_monotonic_time();
+  }
+  if (wait < 1000) {
+    g_idle_add(ApplyNext, this);
+  } else {
+    g_timeout_add(wait / 1000, ApplyNext, this);
+  }
+}
+
+gboolean Replay::ApplyNext(gpointer user_data) {
+  auto* self = static_cast<Replay*>(user_data);
+  const TraceRecord& record = self->records_[self->next_];
+
+  gint64 start = g_get_monotonic_time();
+  self->replayer_.Apply(record);
+  self->apply_times_[static_cast<size_t>(record.type)].push_back(
+      (g_get_monotonic_time() - start) * 1000);
+
+  self->next_++;
+  self->ScheduleNext();
+  return G_SOURCE_REMOVE;
+}
+
+void Replay::Run() {
+  loop_ = g_main_loop_new(nullptr, FALSE);
+  gint64 start = g_get_monotonic_time();
+  pass_start_ = start;
+  ScheduleNext();
+  g_main_loop_run(loop_);
+  PrintSummary(g_get_monotonic_time() - start);
+  g_main_loop_unref(loop_);
+}
+
+void Replay::PrintSummary(gint64 wall_time) {
+  printf("{\"records\":%zu,\"repeat\":%d,\"max_speed\":%s,\"trace_ms\":%.1f,"
+         "\"wall_ms\":%.1f,\"events\":%" G_GUINT64_FORMAT ",\"skipped\":%" G_GUINT64_FORMAT
+         ",\"types\":{",
+         records_.size(), repeat_, max_speed_ ? "true" : "false",
+         records_.back().time / 1000.0, wall_time / 1000.0, events_, replayer_.skipped());
+
+  bool first = true;
+  for (size_t type = 0; type < kRecordTypeCount; type++) {
+    std::vector<gint64>& times = apply_times_[type];
+    if (times.empty()) {
+      continue;
+    }
+    std::sort(times.begin(), times.end());
+    gint64 total = 0;
+    for (gint64 time : times) {
+      total += time;
+    }
+    printf("%s\"%s\":{\"count\":%zu,\"total_us\":%.1f,\"p50_ns\":%" G_GINT64_FORMAT
+           ",\"p99_ns\":%" G_GINT64_FORMAT "}",
+           first ? "" : ",", TraceRecordTypeName(static_cast<TraceRecordType>(type)),
+           times.size(), total / 1000.0, times[times.size() / 2],
+           times[std::min(times.size() - 1, times.size() * 99 / 100)]);
+    first = false;
+  }
+  printf("}}\n");
+}
+
+int main(int argc, char** argv) {
+  bool max_speed = false;
+  bool private_bus = false;
+  int repeat = 1;
+  const char* path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--max-speed") == 0) {
+      max_speed = true;
+    } else if (strcmp(argv[i], "--private-bus") == 0) {
+      private_bus = true;
+    } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = atoi(argv[i] + 9);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      path = nullptr;
+      break;
+    }
+  }
+  if (!path || repeat < 1) {
+    fprintf(stderr, "Usage: %s [--max-speed] [--repeat=N] [--private-bus] trace\n", argv[0]);
+    return 1;
+  }
+
+  // Load everything up front so file I/O does not skew the replay
+  TraceReader reader;
+  GError* error = nullptr;
+  if (!reader.Open(path, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+  std::vector<TraceRecord> records;
+  TraceRecord record;
+  while (reader.Next(&record, &error)) {
+    records.push_back(record);
+  }
+  if (error) {
+    fprintf(stderr, "%s: %s after %zu records\n", path, error->message, records.size());
+    g_error_free(error);
+    return 1;
+  }
+  if (records.empty()) {
+    fprintf(stderr, "%s: no records\n", path);
+    return 1;
+  }
+
+  GTestDBus* bus = nullptr;
+  if (private_bus) {
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+  }
+
+  {
+    Replay replay(records, max_speed, repeat);
+    replay.Run();
+  }
+
+  if (bus) {
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+  }
+  for (TraceRecord& loaded : records) {
+    g_variant_unref(loaded.payload);
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+// Prints the player state published by the os_media_controls Linux plugin.
+//
+// Usage: os_media_controls_state [--watch] [path]
+//
+// Without a path, every state file in $XDG_RUNTIME_DIR is printed. With
+// --watch the state is printed again whenever its generation changes.
+
+#include "os_media_controls/os_media_controls_state.h"
+
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int64_t MonotonicTimeUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const char* StatusName(uint32_t status) {
+  switch (status) {
+    case OS_MEDIA_CONTROLS_STATUS_PLAYING:
+      return "Playing";
+    case OS_MEDIA_CONTROLS_STATUS_PAUSED:
+      return "Paused";
+    default:
+      return "Stopped";
+  }
+}
+
+static void PrintState(const OsMediaControlsState& state) {
+  int64_t position_ms = os_media_controls_state_position_at(&state, MonotonicTimeUs()) / 1000;
+  printf("pid=%d generation=%llu status=%s position_ms=%lld rate=%g\n",
+         state.pid, static_cast<unsigned long long>(state.generation),
+         StatusName(state.status), static_cast<long long>(position_ms), state.rate);
+  printf("  title=%s\n  artist=%s\n  art_url=%s\n", state.title, state.artist,
+         state.art_url);
+}
+
+static std::vector<std::string> FindStateFiles() {
+  std::vector<std::string> paths;
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (!runtime_dir) {
+    return paths;
+  }
+
+  DIR* dir = opendir(runtime_dir);
+  if (!dir) {
+    return paths;
+  }
+
+  size_t prefix_length = strlen(OS_MEDIA_CONTROLS_STATE_FILE_PREFIX);
+  while (struct dirent* entry = readdir(dir)) {
+    if (strncmp(entry->d_name, OS_MEDIA_CONTROLS_STATE_FILE_PREFIX, prefix_length) != 0) {
+      continue;
+    }
+    // Skip files that are still being created
+    const char* suffix = strrchr(entry->d_name, '.');
+    if (suffix && strcmp(suffix, ".tmp") == 0) {
+      continue;
+    }
+    paths.push_back(std::string(runtime_dir) + "/" + entry->d_name);
+  }
+  closedir(dir);
+  return paths;
+}
+
+int main(int argc, char** argv) {
+  bool watch = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--watch") == 0) {
+      watch = true;
+    } else if (strcmp(argv[i], "--help") == 0) {
+      printf("Usage: %s [--watch] [path]\n", argv[0]);
+      return 0;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+
+  if (paths.empty()) {
+    paths = FindStateFiles();
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "No os_media_controls state files found\n");
+    return 1;
+  }
+
+  std::vector<OsMediaControlsStateReader*> readers;
+  for (const std::string& path : paths) {
+    OsMediaControlsStateReader* reader = os_media_controls_state_reader_open(path.c_str());
+    if (!reader) {
+      fprintf(stderr, "Cannot read state file %s\n", path.c_str());
+      continue;
+    }
+    readers.push_back(reader);
+  }
+  if (readers.empty()) {
+    return 1;
+  }
+
+  std::vector<uint64_t> generations(readers.size(), UINT64_MAX);
+  do {
+    for (size_t i = 0; i < readers.size(); i++) {
+      OsMediaControlsState state;
+      if (!os_media_controls_state_reader_read(readers[i], &state)) {
+        continue;
+      }
+      if (state.generation == generations[i]) {
+        continue;
+      }
+      generations[i] = state.generation;
+      PrintState(state);
+    }
+    fflush(stdout);
+    if (watch) {
+      usleep(100000);
+    }
+  } while (watch);
+
+  for (OsMediaControlsStateReader* reader : readers) {
+    os_media_controls_state_reader_close(reader);
+  }
+  return 0;
+}
@@ -0,0 +1,369 @@
+#include "trace.h"
+
+#include "log.h"
+#include "os_media_controls/os_media_controls_core.h"
+
+#include <gio/gio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+static const char kTraceMagic[8] = {'O', 'M', 'C', 'T', 'R', 'A', 'C', 'E'};
+static constexpr guint32 kTraceVersion = 1;
+
+// Largest payload a reader accepts (artwork is the only big field)
+static constexpr guint64 kMaxPayloadSize = 64 * 1024 * 1024;
+
+static const char kObjectPath[] = "/org/mpris/MediaPlayer2";
+
+namespace os_media_controls {
+
+struct TraceRecordInfo {
+  const char* name;
+  const char* type;
+};
+
+static const TraceRecordInfo kTraceRecordInfo[] = {
+    {"setMetadata", "(ayayayaydayayayb)"},
+    {"setPlaybackState", "(idd)"},
+    {"setControlsEnabled", "(ub)"},
+    {"setSkipIntervals", "(ii)"},
+    {"setEventCoalescing", "(xx)"},
+    {"setOptimisticUpdates", "(bu)"},
+    {"clear", "()"},
+    {"dbusMethodCall", "(sssv)"},
+    {"dbusGetProperty", "(sss)"},
+    {"dbusSetProperty", "(sssv)"},
+};
+static_assert(G_N_ELEMENTS(kTraceRecordInfo) == static_cast<size_t>(TraceRecordType::kCount),
+              "kTraceRecordInfo must list every record type");
+
+const char* TraceRecordTypeName(TraceRecordType type) {
+  if (type >= TraceRecordType::kCount) {
+    return "unknown";
+  }
+  return kTraceRecordInfo[static_cast<size_t>(type)].name;
+}
+
+// LEB128
+static size_t EncodeVarint(guint64 value, uint8_t* out) {
+  size_t length = 0;
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[length++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return length;
+}
+
+static bool ReadVarint(FILE* file, guint64* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return false;
+    }
+    *value |= static_cast<guint64>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TraceWriter::TraceWriter() : file_(nullptr), last_time_(0), has_last_time_(false) {}
+
+TraceWriter::~TraceWriter() {
+  Close();
+}
+
+bool TraceWriter::Open(const std::string& path) {
+  Close();
+
+  file_ = fopen(path.c_str(), "wbe");
+  if (!file_) {
+    return false;
+  }
+
+  uint8_t header[16];
+  memcpy(header, kTraceMagic, sizeof(kTraceMagic));
+  guint32 version = GUINT32_TO_LE(kTraceVersion);
+  guint32 reserved = 0;
+  memcpy(header + 8, &version, sizeof(version));
+  memcpy(header + 12, &reserved, sizeof(reserved));
+  if (fwrite(header, sizeof(header), 1, file_) != 1) {
+    Close();
+    return false;
+  }
+
+  has_last_time_ = false;
+  return true;
+}
+
+void TraceWriter::Close() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+void TraceWriter::Write(TraceRecordType type, gint64 time, GVariant* payload) {
+  g_autoptr(GVariant) owned = g_variant_ref_sink(payload);
+  if (!file_) {
+    return;
+  }
+
+  // Payloads are stored little-endian
+  g_autoptr(GVariant) normal = g_variant_get_normal_form(owned);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    g_autoptr(GVariant) swapped = g_variant_byteswap(normal);
+    std::swap(normal, swapped);
+  }
+
+  gint64 delta = has_last_time_ ? std::max<gint64>(0, time - last_time_) : 0;
+  last_time_ = time;
+  has_last_time_ = true;
+
+  gsize size = g_variant_get_size(normal);
+  uint8_t header[1 + 10 + 10];
+  size_t header_length = 0;
+  header[header_length++] = static_cast<uint8_t>(type);
+  header_length += EncodeVarint(delta, header + header_length);
+  header_length += EncodeVarint(size, header + header_length);
+
+  if (fwrite(header, header_length, 1, file_) != 1 ||
+      (size > 0 && fwrite(g_variant_get_data(normal), size, 1, file_) != 1)) {
+    OS_MEDIA_CONTROLS_WARNING(kState, nullptr,
+                              "Failed to write trace record, stopping the trace: %s",
+                              g_strerror(errno));
+    Close();
+  }
+}
+
+TraceReader::TraceReader() : file_(nullptr), first_record_offset_(0), time_(0) {}
+
+TraceReader::~TraceReader() {
+  if (file_) {
+    fclose(file_);
+  }
+}
+
+bool TraceReader::Open(const std::string& path, GError** error) {
+  if (file_) {
+    fclose(file_);
+  }
+
+  file_ = fopen(path.c_str(), "rbe");
+  if (!file_) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno), "Failed to open %s: %s",
+                path.c_str(), g_strerror(errno));
+    return false;
+  }
+
+  uint8_t header[16];
+  guint32 version = 0;
+  if (fread(header, sizeof(header), 1, file_) == 1) {
+    memcpy(&version, header + 8, sizeof(version));
+    version = GUINT32_FROM_LE(version);
+  }
+  if (memcmp(header, kTraceMagic, sizeof(kTraceMagic)) != 0 || version != kTraceVersion) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is not a version %u trace",
+                path.c_str(), kTraceVersion);
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+
+  first_record_offset_ = ftell(file_);
+  time_ = 0;
+  return true;
+}
+
+void TraceReader::Rewind() {
+  if (file_) {
+    fseek(file_, first_record_offset_, SEEK_SET);
+    time_ = 0;
+  }
+}
+
+bool TraceReader::Next(TraceRecord* record, GError** error) {
+  if (!file_) {
+    return false;
+  }
+
+  int type = fgetc(file_);
+  if (type == EOF) {
+    return false;
+  }
+
+  guint64 delta = 0;
+  guint64 size = 0;
+  if (type >= static_cast<int>(TraceRecordType::kCount) || !ReadVarint(file_, &delta) ||
+      !ReadVarint(file_, &size) || size > kMaxPayloadSize) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Corrupt trace record");
+    return false;
+  }
+
+  gpointer data = g_malloc(size);
+  if (size > 0 && fread(data, size, 1, file_) != 1) {
+    g_free(data);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated trace record");
+    return false;
+  }
+
+  // GVariant accepts untrusted serialized data; malformed payloads read as
+  // default values
+  g_autoptr(GBytes) bytes = g_bytes_new_take(data, size);
+  GVariant* payload = g_variant_new_from_bytes(
+      G_VARIANT_TYPE(kTraceRecordInfo[type].type), bytes, FALSE);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant* swapped = g_variant_byteswap(payload);
+    g_variant_unref(g_variant_ref_sink(payload));
+    payload = swapped;
+  }
+
+  time_ += delta;
+  record->type = static_cast<TraceRecordType>(type);
+  record->time = time_;
+  record->payload = g_variant_ref_sink(payload);
+  return true;
+}
+
+// Whether parameters are what GDBus would pass for an exported method or
+// property. Unknown names pass; the handlers reject them without reading.
+static bool MatchesMethodArgs(GDBusNodeInfo* node,
+                              const gchar* interface_name,
+                              const gchar* method_name,
+                              GVariant* parameters) {
+  GDBusInterfaceInfo* interface = g_dbus_node_info_lookup_interface(node, interface_name);
+  GDBusMethodInfo* method =
+      interface ? g_dbus_interface_info_lookup_method(interface, method_name) : nullptr;
+  if (!method) {
+    return true;
+  }
+
+  std::string signature = "(";
+  for (GDBusArgInfo** arg = method->in_args; arg && *arg; arg++) {
+    signature += (*arg)->signature;
+  }
+  signature += ")";
+  return g_strcmp0(g_variant_get_type_string(parameters), signature.c_str()) == 0;
+}
+
+static bool MatchesPropertyType(GDBusNodeInfo* node,
+                                const gchar* interface_name,
+                                const gchar* property_name,
+                                GVariant* value) {
+  GDBusInterfaceInfo* interface = g_dbus_node_info_lookup_interface(node, interface_name);
+  GDBusPropertyInfo* property =
+      interface ? g_dbus_interface_info_lookup_property(interface, property_name) : nullptr;
+  return !property || g_strcmp0(g_variant_get_type_string(value), property->signature) == 0;
+}
+
+void TraceReplayer::Apply(const TraceRecord& record) {
+  GVariant* payload = record.payload;
+  GError* error = nullptr;
+
+  switch (record.type) {
+    case TraceRecordType::kSetMetadata: {
+      OsMediaControlsMetadata metadata = {};
+      g_autoptr(GVariant) artwork = nullptr;
+      gboolean artwork_unchanged = FALSE;
+      g_variant_get(payload, "(^&ay^&ay^&ay^&ayd^&ay^&ay@ayb)", &metadata.title,
+                    &metadata.artist, &metadata.album, &metadata.album_artist,
+                    &metadata.duration, &metadata.track_id, &metadata.artwork_url, &artwork,
+                    &artwork_unchanged);
+      if (!artwork_unchanged) {
+        gsize length = 0;
+        auto* data = static_cast<const uint8_t*>(
+            g_variant_get_fixed_array(artwork, &length, sizeof(uint8_t)));
+        artwork_.assign(data, data + length);
+      }
+      metadata.artwork = artwork_.data();
+      metadata.artwork_length = artwork_.size();
+      core_->SetMetadata(metadata);
+      break;
+    }
+    case TraceRecordType::kSetPlaybackState: {
+      gint32 state;
+      double position, speed;
+      g_variant_get(payload, "(idd)", &state, &position, &speed);
+      core_->SetPlaybackState(static_cast<OsMediaControlsPlaybackState>(state), position,
+                              speed);
+      break;
+    }
+    case TraceRecordType::kSetControlsEnabled: {
+      guint32 controls;
+      gboolean enabled;
+      g_variant_get(payload, "(ub)", &controls, &enabled);
+      core_->SetControlsEnabled(controls, enabled);
+      break;
+    }
+    case TraceRecordType::kSetSkipIntervals: {
+      gint32 forward, backward;
+      g_variant_get(payload, "(ii)", &forward, &backward);
+      core_->SetSkipIntervals(forward, backward);
+      break;
+    }
+    case TraceRecordType::kSetEventCoalescing: {
+      gint64 window_ms, dedup_window_ms;
+      g_variant_get(payload, "(xx)", &window_ms, &dedup_window_ms);
+      core_->SetEventCoalescing(window_ms, dedup_window_ms);
+      break;
+    }
+    case TraceRecordType::kSetOptimisticUpdates: {
+      gboolean enabled;
+      guint32 timeout_ms;
+      g_variant_get(payload, "(bu)", &enabled, &timeout_ms);
+      core_->SetOptimisticUpdates(enabled, timeout_ms);
+      break;
+    }
+    case TraceRecordType::kClear:
+      core_->Clear();
+      break;
+    case TraceRecordType::kDBusMethodCall: {
+      const gchar *sender, *interface_name, *method_name;
+      g_autoptr(GVariant) parameters = nullptr;
+      g_variant_get(payload, "(&s&s&sv)", &sender, &interface_name, &method_name, &parameters);
+      if (!MatchesMethodArgs(MediaControlsCore::MprisNodeInfo(), interface_name, method_name,
+                             parameters)) {
+        skipped_++;
+        break;
+      }
+      core_->DispatchMethodCall(sender, interface_name, method_name, parameters, &error);
+      break;
+    }
+    case TraceRecordType::kDBusGetProperty: {
+      const gchar *sender, *interface_name, *property_name;
+      g_variant_get(payload, "(&s&s&s)", &sender, &interface_name, &property_name);
+      GVariant* value = MediaControlsCore::HandleGetProperty(
+          nullptr, sender, kObjectPath, interface_name, property_name, &error, core_);
+      if (value) {
+        g_variant_unref(g_variant_ref_sink(value));
+      }
+      break;
+    }
+    case TraceRecordType::kDBusSetProperty: {
+      const gchar *sender, *interface_name, *property_name;
+      g_autoptr(GVariant) value = nullptr;
+      g_variant_get(payload, "(&s&s&sv)", &sender, &interface_name, &property_name, &value);
+      if (!MatchesPropertyType(MediaControlsCore::MprisNodeInfo(), interface_name,
+                               property_name, value)) {
+        skipped_++;
+        break;
+      }
+      MediaControlsCore::HandleSetProperty(nullptr, sender, kObjectPath, interface_name,
+                                           property_name, value, &error, core_);
+      break;
+    }
+    case TraceRecordType::kCount:
+      break;
+  }
+
+  // Errors are part of the recorded behavior (e.g. rate limiting); replies
+  // have no receiver here
+  g_clear_error(&error);
+}
+
+}  // namespace os_media_controls
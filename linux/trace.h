@@ -0,0 +1,117 @@
+#ifndef FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_TRACE_H_
+#define FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_TRACE_H_
+
+#include <glib.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace os_media_controls {
+
+class MediaControlsCore;
+
+// Traces are a header followed by records:
+//
+//   header  "OMCTRACE", uint32 version (little-endian), uint32 reserved
+//   record  uint8 type, varint microseconds since the previous record,
+//           varint payload size, payload
+//
+// Payloads are serialized GVariants of the type listed for each record. Times
+// come from the core's monotonic clock.
+enum class TraceRecordType : uint8_t {
+  kSetMetadata,  // (ayayayaydayayayb) bytestrings, duration, artwork, unchanged flag
+  kSetPlaybackState,  // (idd) state, position, speed
+  kSetControlsEnabled,  // (ub)
+  kSetSkipIntervals,  // (ii)
+  kSetEventCoalescing,  // (xx)
+  kSetOptimisticUpdates,  // (bu)
+  kClear,  // ()
+  kDBusMethodCall,  // (sssv) sender, interface, method, parameters
+  kDBusGetProperty,  // (sss) sender, interface, property
+  kDBusSetProperty,  // (sssv) sender, interface, property, value
+  kCount,
+};
+
+// Name of a record type ("setMetadata", "dbusMethodCall", ...)
+const char* TraceRecordTypeName(TraceRecordType type);
+
+struct TraceRecord {
+  TraceRecordType type;
+  gint64 time;  // Microseconds since the first record
+  GVariant* payload;  // Owned
+};
+
+// Appends records to a trace file. Writes are buffered; Close() flushes.
+class TraceWriter {
+ public:
+  TraceWriter();
+  ~TraceWriter();
+
+  // Disallow copy and assign.
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  // Create the file at path, replacing any existing one
+  bool Open(const std::string& path);
+
+  void Close();
+
+  bool IsOpen() const { return file_ != nullptr; }
+
+  // Takes ownership of a floating payload
+  void Write(TraceRecordType type, gint64 time, GVariant* payload);
+
+ private:
+  FILE* file_;
+  gint64 last_time_;
+  bool has_last_time_;
+};
+
+// Reads records back; payloads are validated against the record type
+class TraceReader {
+ public:
+  TraceReader();
+  ~TraceReader();
+
+  // Disallow copy and assign.
+  TraceReader(const TraceReader&) = delete;
+  TraceReader& operator=(const TraceReader&) = delete;
+
+  bool Open(const std::string& path, GError** error);
+
+  // Returns false at the end of the trace or on a truncated/corrupt record
+  // (with error set)
+  bool Next(TraceRecord* record, GError** error);
+
+  // Start over from the first record
+  void Rewind();
+
+ private:
+  FILE* file_;
+  long first_record_offset_;
+  gint64 time_;
+};
+
+// Applies recorded calls to a core: API calls directly, D-Bus calls through
+// the same handlers the bus connection uses (without a connection). D-Bus
+// arguments are type-checked the way GDBus does first.
+class TraceReplayer {
+ public:
+  explicit TraceReplayer(MediaControlsCore* core) : core_(core), skipped_(0) {}
+
+  void Apply(const TraceRecord& record);
+
+  // D-Bus records whose arguments do not match the exported interfaces. GDBus
+  // rejects those before they reach the handlers, so they are not applied.
+  guint64 skipped() const { return skipped_; }
+
+ private:
+  MediaControlsCore* core_;
+  std::vector<uint8_t> artwork_;  // Last recorded artwork bytes
+  guint64 skipped_;
+};
+
+}  // namespace os_media_controls
+
+#endif  // FLUTTER_PLUGIN_OS_MEDIA_CONTROLS_TRACE_H_